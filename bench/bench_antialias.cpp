@@ -0,0 +1,91 @@
+// Measures the cost of anti-aliased (coverage) masks against binary masks:
+// rasterization and PNG encoding of one 4K layer holding a ring of circles.
+//
+//   bench_antialias [iterations]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gcode_generator.h>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+using Stratum::Slicer::Segment2D;
+
+void addCircle(std::vector<Segment2D>& segs,
+               double cx,
+               double cy,
+               double r,
+               int n)
+{
+  const double pi = std::acos(-1.0);
+  for (int i = 0; i < n; ++i) {
+    const double a0 = 2 * pi * i / n, a1 = 2 * pi * (i + 1) / n;
+    segs.push_back({{cx + r * std::cos(a0), cy + r * std::sin(a0)},
+                    {cx + r * std::cos(a1), cy + r * std::sin(a1)}});
+  }
+}
+
+template<typename F>
+double millis(int iterations, F&& f)
+{
+  const auto t0 = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    f();
+  const std::chrono::duration<double, std::milli> dt = Clock::now() - t0;
+  return dt.count() / iterations;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+  const int w = 3840, h = 2160;
+  const double pitch = 0.05;
+
+  std::vector<Segment2D> segs;
+  for (int k = 0; k < 24; ++k) {
+    const double a = k * 0.2618;
+    addCircle(segs, 96 + 70 * std::cos(a), 54 + 40 * std::sin(a), 6.5, 720);
+  }
+
+  std::vector<uint8_t> png;
+
+  Stratum::BitMask bits(w, h);
+  const double bin_raster = millis(iterations, [&]
+  {
+    bits.clear();
+    Stratum::Slicer::rasterizeCenteredSegments(bits, pitch, segs, 0.0, 0.0);
+  });
+  const double bin_encode =
+      millis(iterations, [&] { Stratum::encodeMonoPNG(png, bits); });
+  std::printf("%-10s raster %8.2f ms  encode %8.2f ms  png %8zu bytes\n",
+              "binary",
+              bin_raster,
+              bin_encode,
+              png.size());
+
+  Stratum::GreyMask grey(w, h);
+  for (int n : {1, 2, 4, 8}) {
+    const double raster = millis(iterations, [&]
+    {
+      Stratum::Slicer::rasterizeCoverage(grey, pitch, n, segs, 0.0, 0.0);
+    });
+    const double encode =
+        millis(iterations, [&] { Stratum::encodeGreyPNG(png, grey); });
+    char name[16];
+    std::snprintf(name, sizeof(name), "aa %dx%d", n, n);
+    std::printf("%-10s raster %8.2f ms  encode %8.2f ms  png %8zu bytes"
+                "  (%.1fx binary)\n",
+                name,
+                raster,
+                encode,
+                png.size(),
+                (raster + encode) / (bin_raster + bin_encode));
+  }
+  return 0;
+}
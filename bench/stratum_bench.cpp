@@ -0,0 +1,499 @@
+// Benchmark suite over procedural meshes. Each mesh is written as a binary
+// STL and run through the reader, the slicing, stitching, rasterizing, PNG,
+// hatching and parsing stages, and end-to-end G-code generation for every
+// printer type. Results go to stdout (or --json FILE) as JSON so runs of
+// different versions can be compared; progress goes to stderr.
+//
+//   stratum_bench [--triangles N] [--iterations K] [--mesh NAME]...
+//                 [--layer-height MM] [--workers N] [--json FILE]
+//
+// Meshes: sphere, torus, gyroid (a sheet-gyroid lattice block) and islands
+// (a plate of separate pins). --triangles is the approximate size of each.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <numbers>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gcode_generator.h>
+#include <gcode_parser.h>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+using Stratum::Slicer::Triangle;
+using Stratum::Slicer::Vec3;
+
+constexpr double kPi = std::numbers::pi;
+
+/*
+ * Mesh generators. Every mesh is closed, consistently oriented and sits on
+ * z = 0 inside a 20 mm cube.
+ */
+
+void addQuad(std::vector<Triangle>& t, Vec3 a, Vec3 b, Vec3 c, Vec3 d)
+{
+  t.push_back({a, b, c});
+  t.push_back({a, c, d});
+}
+
+// Point of a parametric surface; u runs around, v from pole to pole or
+// around the tube.
+template<typename Surface>
+std::vector<Triangle> gridSurface(int nu, int nv, bool poles, Surface&& at)
+{
+  std::vector<Triangle> t;
+  for (int i = 0; i < nu; ++i) {
+    for (int j = 0; j < nv; ++j) {
+      const Vec3 a = at(i, j), b = at(i + 1, j);
+      const Vec3 c = at(i + 1, j + 1), d = at(i, j + 1);
+      if (poles && j == 0)
+        t.push_back({a, c, d});
+      else if (poles && j == nv - 1)
+        t.push_back({a, b, c});
+      else
+        addQuad(t, a, b, c, d);
+    }
+  }
+  return t;
+}
+
+std::vector<Triangle> sphere(std::size_t triangles)
+{
+  const int nv = std::max(4, static_cast<int>(std::sqrt(triangles / 4.0)));
+  const int nu = 2 * nv;
+  const double r = 10.0;
+  return gridSurface(nu, nv, true, [&](int i, int j)
+  {
+    if (j == 0)
+      return Vec3 {0, 0, 2 * r};
+    if (j == nv)
+      return Vec3 {0, 0, 0};
+    // u runs clockwise so the faces point outwards.
+    const double u = -2 * kPi * (i % nu) / nu, v = kPi * j / nv;
+    return Vec3 {r * std::sin(v) * std::cos(u),
+                 r * std::sin(v) * std::sin(u),
+                 r + r * std::cos(v)};
+  });
+}
+
+std::vector<Triangle> torus(std::size_t triangles)
+{
+  const int nv = std::max(4, static_cast<int>(std::sqrt(triangles / 4.0)));
+  const int nu = 2 * nv;
+  const double big = 7.0, small = 3.0;
+  return gridSurface(nu, nv, false, [&](int i, int j)
+  {
+    const double u = 2 * kPi * (i % nu) / nu, v = 2 * kPi * (j % nv) / nv;
+    const double rho = big + small * std::cos(v);
+    return Vec3 {rho * std::cos(u), rho * std::sin(u), small + small * std::sin(v)};
+  });
+}
+
+// k x k separate pins, each a 16-sided prism.
+std::vector<Triangle> islands(std::size_t triangles)
+{
+  const int sides = 16;
+  const int k = std::max(1, static_cast<int>(std::sqrt(triangles / (4.0 * sides))));
+  const double spacing = 20.0 / k, r = 0.35 * spacing, h = 5.0;
+  std::vector<Triangle> t;
+  for (int a = 0; a < k; ++a) {
+    for (int b = 0; b < k; ++b) {
+      const double cx = (a + 0.5) * spacing, cy = (b + 0.5) * spacing;
+      for (int s = 0; s < sides; ++s) {
+        const double u0 = 2 * kPi * s / sides;
+        const double u1 = 2 * kPi * ((s + 1) % sides) / sides;
+        const Vec3 p0 {cx + r * std::cos(u0), cy + r * std::sin(u0), 0};
+        const Vec3 p1 {cx + r * std::cos(u1), cy + r * std::sin(u1), 0};
+        const Vec3 q0 {p0.x, p0.y, h}, q1 {p1.x, p1.y, h};
+        addQuad(t, p0, p1, q1, q0);
+        t.push_back({{cx, cy, h}, q0, q1});
+        t.push_back({{cx, cy, 0}, p1, p0});
+      }
+    }
+  }
+  return t;
+}
+
+// Sheet gyroid (|gyroid| < thickness) clipped to the cube, meshed with
+// marching tetrahedra on an n^3 grid.
+std::vector<Triangle> gyroidGrid(int n)
+{
+  const double size = 20.0, period = 5.0, thickness = 0.5;
+  const double step = size / n;
+  const int m = n + 1;
+  // Samples are negative inside; the outermost ones are forced outside so
+  // the surface closes at the faces of the cube.
+  std::vector<double> f(static_cast<std::size_t>(m) * m * m);
+  const auto idx = [m](int x, int y, int z)
+  { return (static_cast<std::size_t>(z) * m + y) * m + x; };
+  for (int z = 0; z < m; ++z)
+    for (int y = 0; y < m; ++y)
+      for (int x = 0; x < m; ++x) {
+        if (x == 0 || y == 0 || z == 0 || x == n || y == n || z == n) {
+          f[idx(x, y, z)] = 1.0;
+          continue;
+        }
+        const double s = 2 * kPi / period;
+        const double px = x * step * s, py = y * step * s, pz = z * step * s;
+        const double g = std::sin(px) * std::cos(py) + std::sin(py) * std::cos(pz)
+            + std::sin(pz) * std::cos(px);
+        f[idx(x, y, z)] = std::abs(g) - thickness;
+      }
+
+  // Edge crossings are interpolated from the lower-indexed end so both
+  // tetrahedra sharing an edge compute bit-identical vertices.
+  const auto crossing = [&](std::array<int, 3> a, std::array<int, 3> b)
+  {
+    if (idx(b[0], b[1], b[2]) < idx(a[0], a[1], a[2]))
+      std::swap(a, b);
+    const double fa = f[idx(a[0], a[1], a[2])], fb = f[idx(b[0], b[1], b[2])];
+    const double t = fa / (fa - fb);
+    return Vec3 {(a[0] + t * (b[0] - a[0])) * step,
+                 (a[1] + t * (b[1] - a[1])) * step,
+                 (a[2] + t * (b[2] - a[2])) * step};
+  };
+  const auto sub = [](const Vec3& a, const Vec3& b)
+  { return Vec3 {a.x - b.x, a.y - b.y, a.z - b.z}; };
+  const auto dot = [](const Vec3& a, const Vec3& b)
+  { return a.x * b.x + a.y * b.y + a.z * b.z; };
+  const auto cross = [](const Vec3& a, const Vec3& b)
+  { return Vec3 {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; };
+
+  std::vector<Triangle> t;
+  // Emits a triangle facing away from the inside corners.
+  const auto emit = [&](Vec3 a, Vec3 b, Vec3 c, const Vec3& outward)
+  {
+    if (dot(cross(sub(b, a), sub(c, a)), outward) < 0)
+      std::swap(b, c);
+    t.push_back({a, b, c});
+  };
+
+  // Kuhn triangulation: six tetrahedra along the 0-7 diagonal, which
+  // matches between neighbouring cubes.
+  static constexpr int kPerm[6][3] = {
+      {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+  for (int z = 0; z < n; ++z)
+    for (int y = 0; y < n; ++y)
+      for (int x = 0; x < n; ++x)
+        for (const auto& perm : kPerm) {
+          std::array<std::array<int, 3>, 4> v;
+          v[0] = {x, y, z};
+          for (int k = 1; k < 4; ++k) {
+            v[k] = v[k - 1];
+            ++v[k][perm[k - 1]];
+          }
+          std::array<int, 4> in, out;
+          int n_in = 0, n_out = 0;
+          for (int k = 0; k < 4; ++k)
+            (f[idx(v[k][0], v[k][1], v[k][2])] < 0 ? in[n_in++] : out[n_out++]) = k;
+          if (n_in == 0 || n_in == 4)
+            continue;
+
+          Vec3 c_in {0, 0, 0}, c_out {0, 0, 0};
+          for (int k = 0; k < 4; ++k) {
+            Vec3& c = f[idx(v[k][0], v[k][1], v[k][2])] < 0 ? c_in : c_out;
+            c.x += v[k][0];
+            c.y += v[k][1];
+            c.z += v[k][2];
+          }
+          const Vec3 outward = sub(
+              Vec3 {c_out.x / n_out, c_out.y / n_out, c_out.z / n_out},
+              Vec3 {c_in.x / n_in, c_in.y / n_in, c_in.z / n_in});
+
+          if (n_in == 1 || n_in == 3) {
+            const int lone = n_in == 1 ? in[0] : out[0];
+            Vec3 p[3];
+            int q = 0;
+            for (int k = 0; k < 4; ++k)
+              if (k != lone)
+                p[q++] = crossing(v[lone], v[k]);
+            emit(p[0], p[1], p[2], outward);
+          } else {
+            const Vec3 ac = crossing(v[in[0]], v[out[0]]);
+            const Vec3 ad = crossing(v[in[0]], v[out[1]]);
+            const Vec3 bd = crossing(v[in[1]], v[out[1]]);
+            const Vec3 bc = crossing(v[in[1]], v[out[0]]);
+            emit(ac, ad, bd, outward);
+            emit(ac, bd, bc, outward);
+          }
+        }
+  return t;
+}
+
+std::vector<Triangle> gyroid(std::size_t triangles)
+{
+  // The triangle count grows with the square of the grid size.
+  const int probe = 16;
+  const std::size_t at_probe = gyroidGrid(probe).size();
+  const int n = std::max(
+      4, static_cast<int>(probe * std::sqrt(double(triangles) / at_probe)));
+  return gyroidGrid(n);
+}
+
+void writeBinaryStl(const std::filesystem::path& path,
+                    const std::vector<Triangle>& tris)
+{
+  std::vector<char> out(84 + tris.size() * 50, 0);
+  const auto put32 = [&](std::size_t at, std::uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i)
+      out[at + i] = static_cast<char>(v >> (8 * i));
+  };
+  put32(80, static_cast<std::uint32_t>(tris.size()));
+  std::size_t at = 84;
+  for (const auto& t : tris) {
+    at += 12;  // zero normal
+    for (const Vec3* v : {&t.v1, &t.v2, &t.v3})
+      for (double c : {v->x, v->y, v->z}) {
+        put32(at, std::bit_cast<std::uint32_t>(static_cast<float>(c)));
+        at += 4;
+      }
+    at += 2;  // attribute bytes
+  }
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  f.write(out.data(), static_cast<std::streamsize>(out.size()));
+  if (!f)
+    throw std::runtime_error("cannot write " + path.string());
+}
+
+/*
+ * Timing and reporting
+ */
+
+struct Result
+{
+  std::string mesh;
+  std::size_t triangles;
+  std::string stage;
+  int iterations;
+  double mean_ms, min_ms;
+};
+
+std::vector<Result> results;
+
+// Keeps results alive so the optimizer cannot drop the measured work.
+std::size_t sink = 0;
+
+void run(const std::string& mesh,
+         std::size_t triangles,
+         const std::string& stage,
+         int iterations,
+         const std::function<void()>& f)
+{
+  double sum = 0.0, best = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto t0 = Clock::now();
+    f();
+    const std::chrono::duration<double, std::milli> dt = Clock::now() - t0;
+    sum += dt.count();
+    best = i == 0 ? dt.count() : std::min(best, dt.count());
+  }
+  results.push_back({mesh, triangles, stage, iterations, sum / iterations, best});
+  std::fprintf(stderr,
+               "%-8s %-26s %10.3f ms (min %10.3f)\n",
+               mesh.c_str(),
+               stage.c_str(),
+               sum / iterations,
+               best);
+}
+
+void writeJson(std::FILE* out, std::size_t target, int iterations, double layer_height)
+{
+  std::fprintf(out, "{\n  \"suite\": \"stratum_bench\",\n  \"version\": 1,\n");
+#ifdef NDEBUG
+  std::fprintf(out, "  \"assertions\": false,\n");
+#else
+  std::fprintf(out, "  \"assertions\": true,\n");
+#endif
+  std::fprintf(out,
+               "  \"hardware_threads\": %u,\n  \"target_triangles\": %zu,\n"
+               "  \"iterations\": %d,\n  \"layer_height_mm\": %g,\n"
+               "  \"checksum\": %zu,\n  \"results\": [\n",
+               std::thread::hardware_concurrency(),
+               target,
+               iterations,
+               layer_height,
+               sink);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::fprintf(out,
+                 "    {\"mesh\": \"%s\", \"triangles\": %zu, \"stage\": \"%s\", "
+                 "\"iterations\": %d, \"mean_ms\": %.4f, \"min_ms\": %.4f}%s\n",
+                 r.mesh.c_str(),
+                 r.triangles,
+                 r.stage.c_str(),
+                 r.iterations,
+                 r.mean_ms,
+                 r.min_ms,
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "  ]\n}\n");
+}
+
+void benchMesh(const std::string& name,
+               const std::vector<Triangle>& mesh,
+               const std::filesystem::path& work,
+               int iterations,
+               double layer_height,
+               int workers)
+{
+  namespace Slicer = Stratum::Slicer;
+  namespace Toolpath = Stratum::Toolpath;
+  const std::size_t n = mesh.size();
+  const auto stl = work / (name + ".stl");
+  writeBinaryStl(stl, mesh);
+
+  Stratum::Bounds3D bb;
+  std::vector<Triangle> tris;
+  run(name, n, "readStl", iterations, [&] { tris = Slicer::readStl(stl, bb); });
+
+  const double mid = 0.5 * (bb.min_z + bb.max_z) + 1e-4;
+  std::vector<Slicer::Segment2D> segs;
+  run(name, n, "sliceTriangles", iterations,
+      [&] { segs = Slicer::sliceTriangles(tris, mid); });
+
+  run(name, n, "stitchContours", iterations,
+      [&] { sink += Slicer::stitchContours(segs).size(); });
+
+  // A 4K mask at 10 um pixels covers the 20 mm models.
+  const double pitch = 0.01;
+  Stratum::BitMask mask(3840, 2160);
+  const double ox = 0.5 * (3840 * pitch - (bb.max_x - bb.min_x)) - bb.min_x;
+  const double oy = 0.5 * (2160 * pitch - (bb.max_y - bb.min_y)) - bb.min_y;
+  run(name, n, "rasterizeCenteredSegments", iterations, [&]
+  {
+    mask.clear();
+    Slicer::rasterizeCenteredSegments(mask, pitch, segs, ox, oy);
+  });
+
+  const auto png = work / (name + ".png");
+  run(name, n, "writeMonoPNG", iterations, [&] { Stratum::writeMonoPNG(png, mask); });
+
+  run(name, n, "hatchRows+hatchBlocks", iterations, [&]
+  {
+    const auto rows = Toolpath::hatchRows(segs, 0.05);
+    sink += Toolpath::hatchBlocks(rows).size();
+  });
+
+  // End to end, with the native model size and one worker unless asked.
+  Stratum::LCDConfig lcd;
+  lcd.cols = 3840;
+  lcd.rows = 2160;
+  lcd.led_radius = pitch / 2;
+  lcd.autoscale = false;
+  lcd.layer_height = layer_height;
+  lcd.workers = workers;
+  lcd.png_dir = work / "lcd_layers";
+  run(name, n, "generateGCode LCD", iterations, [&]
+  { Stratum::writeGCodeFile(stl, lcd, work / "lcd.gcode"); });
+
+  Stratum::DLPConfig dlp;
+  dlp.cols = 3840;
+  dlp.rows = 2160;
+  dlp.pixel_pitch_mm = pitch;
+  dlp.autoscale = false;
+  dlp.layer_height = layer_height;
+  dlp.workers = workers;
+  dlp.archive_path = work / "dlp.stratlyr";
+  run(name, n, "generateGCode DLP", iterations, [&]
+  { Stratum::writeGCodeFile(stl, dlp, work / "dlp.gcode"); });
+
+  Stratum::SLAConfig sla;
+  sla.spot_radius = 0.05;
+  sla.layer_height = layer_height;
+  const auto sla_gcode = work / "sla.gcode";
+  run(name, n, "generateGCode SLA", iterations,
+      [&] { Stratum::writeGCodeFile(stl, sla, sla_gcode); });
+
+  run(name, n, "parseFile SLA", iterations, [&]
+  {
+    std::vector<Stratum::GCodeCommand> cmds;
+    Stratum::parseFile(sla_gcode, std::back_inserter(cmds));
+    sink += cmds.size();
+  });
+
+  std::filesystem::remove_all(lcd.png_dir);
+}
+
+int usage()
+{
+  std::fprintf(stderr,
+               "usage: stratum_bench [--triangles N] [--iterations K] "
+               "[--mesh sphere|torus|gyroid|islands]... [--layer-height MM] "
+               "[--workers N] [--json FILE]\n");
+  return 2;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  std::size_t triangles = 200000;
+  int iterations = 3;
+  double layer_height = 0.1;
+  int workers = 1;
+  std::vector<std::string> meshes;
+  std::string json;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+      return usage();
+    const char* value = argv[++i];
+    if (arg == "--triangles")
+      triangles = static_cast<std::size_t>(std::max(100L, std::atol(value)));
+    else if (arg == "--iterations")
+      iterations = std::max(1, std::atoi(value));
+    else if (arg == "--mesh")
+      meshes.push_back(value);
+    else if (arg == "--layer-height")
+      layer_height = std::max(0.01, std::atof(value));
+    else if (arg == "--workers")
+      workers = std::max(0, std::atoi(value));
+    else if (arg == "--json")
+      json = value;
+    else
+      return usage();
+  }
+  if (meshes.empty())
+    meshes = {"sphere", "torus", "gyroid", "islands"};
+
+  const auto work = std::filesystem::temp_directory_path() / "stratum_bench";
+  std::filesystem::create_directories(work);
+  for (const auto& name : meshes) {
+    std::vector<Triangle> mesh;
+    if (name == "sphere")
+      mesh = sphere(triangles);
+    else if (name == "torus")
+      mesh = torus(triangles);
+    else if (name == "gyroid")
+      mesh = gyroid(triangles);
+    else if (name == "islands")
+      mesh = islands(triangles);
+    else
+      return usage();
+    benchMesh(name, mesh, work, iterations, layer_height, workers);
+  }
+  std::filesystem::remove_all(work);
+
+  std::FILE* out = json.empty() ? stdout : std::fopen(json.c_str(), "w");
+  if (out == nullptr) {
+    std::fprintf(stderr, "cannot write %s\n", json.c_str());
+    return 1;
+  }
+  writeJson(out, triangles, iterations, layer_height);
+  if (out != stdout)
+    std::fclose(out);
+  return 0;
+}
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "gcode_emitter.h"
+#include "gcode_parser.h"
+#include "mapped_file.h"
+
+namespace Stratum
+{
+
+/*
+ * Binary G-code
+ *
+ * A parsed command sequence laid out so that a mapped file is read in place.
+ * All integers are little-endian; numbers are IEEE-754 doubles stored as
+ * their 64-bit pattern.
+ *
+ *   header (40 bytes)
+ *     char[8]  magic "STRATGCB"
+ *     uint32   version (1)
+ *     uint32   opcode count
+ *     uint64   command count
+ *     uint64   argument count
+ *     uint64   string pool size
+ *   arguments: one 16-byte record per argument, in command order
+ *     uint8    letter
+ *     uint8    kind (GCodeBinary::kNumber or kText)
+ *     uint16   reserved (0)
+ *     uint32   text length
+ *     uint64   number bits, or pool offset of the text
+ *   commands: one 16-byte entry per command
+ *     uint32   opcode
+ *     uint32   argument count
+ *     uint64   index of the first argument
+ *   opcodes: one 16-byte entry per distinct command name ("G1", "M701", ...)
+ *     uint64   pool offset
+ *     uint32   length
+ *     uint32   reserved (0)
+ *   string pool: command names and quoted values, back to back
+ *
+ * Every section is a whole number of 8-byte records, so each starts aligned.
+ * Arguments come first so the writer can stream them to the file.
+ */
+namespace GCodeBinary
+{
+
+inline constexpr char kMagic[8] = {'S', 'T', 'R', 'A', 'T', 'G', 'C', 'B'};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::size_t kHeaderSize = 40;
+inline constexpr std::size_t kArgSize = 16;
+inline constexpr std::size_t kCommandSize = 16;
+inline constexpr std::size_t kOpcodeSize = 16;
+
+inline constexpr std::uint8_t kNumber = 0;
+inline constexpr std::uint8_t kText = 1;
+
+inline void storeLE(char* p, std::uint64_t v, int bytes)
+{
+  for (int i = 0; i < bytes; ++i)
+    p[i] = static_cast<char>(v >> (8 * i));
+}
+
+// On little-endian hosts this is a plain unaligned load.
+inline std::uint64_t loadLE(const char* p, int bytes)
+{
+  std::uint64_t v = 0;
+  if constexpr (std::endian::native == std::endian::little) {
+    std::memcpy(&v, p, static_cast<std::size_t>(bytes));
+    return v;
+  }
+  for (int i = 0; i < bytes; ++i)
+    v |= std::uint64_t {static_cast<unsigned char>(p[i])} << (8 * i);
+  return v;
+}
+
+// Streams commands into a binary G-code file. Argument records go to the
+// file as they are added; the command table, opcodes and string pool are
+// kept until close().
+class Writer
+{
+public:
+  explicit Writer(const std::filesystem::path& file)
+      : file_(file)
+      , f_(file, std::ios::binary | std::ios::trunc)
+  {
+    if (!f_)
+      throw std::runtime_error("cannot open " + file.string());
+    writeHeader();
+  }
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  ~Writer()
+  {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  std::uint64_t size() const { return commands_.size() / kCommandSize; }
+
+  void add(const CommandView& cmd)
+  {
+    startCommand(cmd.command, cmd.arguments.size());
+    for (const ArgView& a : cmd.arguments) {
+      if (a.is_text)
+        addText(a.letter, a.text);
+      else
+        addNumber(a.letter, a.number);
+    }
+  }
+
+  void add(const GCodeCommand& cmd)
+  {
+    startCommand(cmd.command, cmd.arguments.size());
+    for (const Arg& a : cmd.arguments) {
+      if (const auto* text = std::get_if<std::string>(&a.value))
+        addText(a.letter, *text);
+      else
+        addNumber(a.letter, std::get<double>(a.value));
+    }
+  }
+
+  // Writes the remaining sections and the final header. Called by the
+  // destructor if needed.
+  void close()
+  {
+    if (closed_)
+      return;
+    closed_ = true;
+    flushArgs();
+    write(commands_.data(), commands_.size());
+    std::vector<char> entry(kOpcodeSize, 0);
+    for (const auto& [offset, length] : opcodes_) {
+      storeLE(entry.data(), offset, 8);
+      storeLE(entry.data() + 8, length, 4);
+      write(entry.data(), entry.size());
+    }
+    write(pool_.data(), pool_.size());
+    f_.seekp(0);
+    writeHeader();
+    f_.close();
+    if (!f_)
+      throw std::runtime_error("cannot write " + file_.string());
+  }
+
+private:
+  static constexpr std::size_t kArgBlock = std::size_t {64} << 10;
+
+  void startCommand(std::string_view name, std::size_t n_args)
+  {
+    if (closed_)
+      throw std::logic_error("binary G-code writer is closed");
+    char entry[kCommandSize] = {};
+    storeLE(entry, opcode(name), 4);
+    storeLE(entry + 4, n_args, 4);
+    storeLE(entry + 8, arg_count_, 8);
+    commands_.insert(commands_.end(), entry, entry + kCommandSize);
+  }
+
+  // Command names are interned; consecutive repeats skip the lookup.
+  std::uint32_t opcode(std::string_view name)
+  {
+    if (last_name_ == name && !opcodes_.empty())
+      return last_opcode_;
+    auto it = opcode_ids_.find(std::string(name));
+    if (it == opcode_ids_.end()) {
+      const auto id = static_cast<std::uint32_t>(opcodes_.size());
+      opcodes_.push_back({intern(name), name.size()});
+      it = opcode_ids_.emplace(std::string(name), id).first;
+    }
+    last_name_ = it->first;
+    last_opcode_ = it->second;
+    return last_opcode_;
+  }
+
+  std::uint64_t intern(std::string_view s)
+  {
+    const std::uint64_t offset = pool_.size();
+    pool_.insert(pool_.end(), s.begin(), s.end());
+    return offset;
+  }
+
+  void addNumber(char letter, double v)
+  {
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    addArg(letter, kNumber, 0, bits);
+  }
+
+  void addText(char letter, std::string_view text)
+  {
+    addArg(letter, kText, text.size(), intern(text));
+  }
+
+  void addArg(char letter, std::uint8_t kind, std::size_t length, std::uint64_t value)
+  {
+    if (length > UINT32_MAX)
+      throw std::invalid_argument("G-code text argument too long");
+    char* r = args_.data() + args_len_;
+    storeLE(r, static_cast<unsigned char>(letter), 1);
+    storeLE(r + 1, kind, 1);
+    storeLE(r + 2, 0, 2);
+    storeLE(r + 4, length, 4);
+    storeLE(r + 8, value, 8);
+    args_len_ += kArgSize;
+    ++arg_count_;
+    if (args_len_ == args_.size())
+      flushArgs();
+  }
+
+  void flushArgs()
+  {
+    write(args_.data(), args_len_);
+    args_len_ = 0;
+  }
+
+  void write(const char* p, std::size_t n)
+  {
+    f_.write(p, static_cast<std::streamsize>(n));
+  }
+
+  void writeHeader()
+  {
+    char h[kHeaderSize];
+    std::memcpy(h, kMagic, 8);
+    storeLE(h + 8, kVersion, 4);
+    storeLE(h + 12, opcodes_.size(), 4);
+    storeLE(h + 16, size(), 8);
+    storeLE(h + 24, arg_count_, 8);
+    storeLE(h + 32, pool_.size(), 8);
+    write(h, kHeaderSize);
+  }
+
+  struct Opcode
+  {
+    std::uint64_t offset;
+    std::size_t length;
+  };
+
+  std::filesystem::path file_;
+  std::ofstream f_;
+  std::vector<char> args_ = std::vector<char>(kArgBlock);
+  std::size_t args_len_ = 0;
+  std::uint64_t arg_count_ = 0;
+  std::vector<char> commands_;
+  std::vector<Opcode> opcodes_;
+  std::unordered_map<std::string, std::uint32_t> opcode_ids_;
+  std::string_view last_name_;
+  std::uint32_t last_opcode_ = 0;
+  std::vector<char> pool_;
+  bool closed_ = false;
+};
+
+// Memory-maps a binary G-code file. Opening only checks the header, so it
+// costs the same for any file size; any command is then decoded in O(1),
+// with its name and text arguments pointing into the mapping.
+class Reader
+{
+public:
+  explicit Reader(const std::filesystem::path& file)
+      : map_(file)
+  {
+    const char* p = map_.data();
+    if (map_.size() < kHeaderSize || std::memcmp(p, kMagic, 8) != 0)
+      throw std::runtime_error("not a binary G-code file: " + file.string());
+    if (loadLE(p + 8, 4) != kVersion)
+      throw std::runtime_error("unsupported binary G-code version");
+    opcode_count_ = loadLE(p + 12, 4);
+    count_ = loadLE(p + 16, 8);
+    arg_count_ = loadLE(p + 24, 8);
+    const std::uint64_t pool_size = loadLE(p + 32, 8);
+
+    // Section sizes are checked one at a time so a corrupt count cannot
+    // overflow the sum.
+    std::uint64_t left = map_.size() - kHeaderSize;
+    const auto take = [&](std::uint64_t n, std::uint64_t record)
+    {
+      if (n > left / record)
+        throw std::runtime_error("truncated binary G-code: " + file.string());
+      left -= n * record;
+    };
+    take(arg_count_, kArgSize);
+    take(count_, kCommandSize);
+    take(opcode_count_, kOpcodeSize);
+    take(pool_size, 1);
+
+    args_ = p + kHeaderSize;
+    commands_ = args_ + arg_count_ * kArgSize;
+    pool_ = std::string_view(commands_ + count_ * kCommandSize
+                                 + opcode_count_ * kOpcodeSize,
+                             static_cast<std::size_t>(pool_size));
+
+    opcodes_.reserve(static_cast<std::size_t>(opcode_count_));
+    const char* e = commands_ + count_ * kCommandSize;
+    for (std::uint64_t i = 0; i < opcode_count_; ++i, e += kOpcodeSize)
+      opcodes_.push_back(text(loadLE(e, 8), loadLE(e + 8, 4)));
+  }
+
+  std::uint64_t size() const { return count_; }
+
+  // Decodes command i into `cmd`, replacing its contents.
+  void command(std::uint64_t i, CommandView& cmd) const
+  {
+    if (i >= count_)
+      throw std::out_of_range("command index out of range");
+    const char* e = commands_ + i * kCommandSize;
+    const std::uint64_t op = loadLE(e, 4);
+    const std::uint64_t n = loadLE(e + 4, 4);
+    const std::uint64_t first = loadLE(e + 8, 8);
+    if (op >= opcode_count_ || first > arg_count_ || n > arg_count_ - first)
+      throw std::runtime_error("corrupt binary G-code command table");
+
+    cmd.command = opcodes_[static_cast<std::size_t>(op)];
+    cmd.arguments.clear();
+    const char* r = args_ + first * kArgSize;
+    for (std::uint64_t k = 0; k < n; ++k, r += kArgSize) {
+      ArgView arg;
+      arg.letter = static_cast<char>(r[0]);
+      const std::uint64_t value = loadLE(r + 8, 8);
+      if (static_cast<std::uint8_t>(r[1]) == kText) {
+        arg.is_text = true;
+        arg.text = text(value, loadLE(r + 4, 4));
+      } else {
+        std::memcpy(&arg.number, &value, sizeof(value));
+      }
+      cmd.arguments.push_back(arg);
+    }
+  }
+
+  GCodeCommand command(std::uint64_t i) const
+  {
+    CommandView cmd;
+    command(i, cmd);
+    return toCommand(cmd);
+  }
+
+  // Calls fn(const CommandView&) for every command, in order.
+  template<typename Fn>
+  void forEach(Fn&& fn) const
+  {
+    CommandView cmd;
+    for (std::uint64_t i = 0; i < count_; ++i) {
+      command(i, cmd);
+      fn(static_cast<const CommandView&>(cmd));
+    }
+  }
+
+private:
+  std::string_view text(std::uint64_t offset, std::uint64_t length) const
+  {
+    if (offset > pool_.size() || length > pool_.size() - offset)
+      throw std::runtime_error("corrupt binary G-code string");
+    return pool_.substr(static_cast<std::size_t>(offset),
+                        static_cast<std::size_t>(length));
+  }
+
+  MappedFile map_;
+  std::uint64_t opcode_count_ = 0;
+  std::uint64_t count_ = 0;
+  std::uint64_t arg_count_ = 0;
+  const char* args_ = nullptr;
+  const char* commands_ = nullptr;
+  std::string_view pool_;
+  std::vector<std::string_view> opcodes_;
+};
+
+// Writes one command as a G-code line that parses back to the same command:
+// numbers use their shortest exact digits, text is quoted. Throws
+// std::invalid_argument for values the text form cannot carry (non-finite
+// numbers, or text containing '"', ';' or a line break).
+template<GCodeSink Sink>
+void emitCommand(GCodeEmitter<Sink>& gcode, const CommandView& cmd)
+{
+  gcode.text(cmd.command);
+  for (const ArgView& a : cmd.arguments) {
+    if (a.is_text) {
+      if (a.text.find_first_of("\";\r\n") != std::string_view::npos)
+        throw std::invalid_argument("G-code text argument cannot be written as text");
+      const char quote[] = {' ', a.letter, '"'};
+      gcode.text(std::string_view(quote, 3)).text(a.text).text("\"");
+    } else {
+      if (!(a.number - a.number == 0.0))
+        throw std::invalid_argument("non-finite G-code number");
+      gcode.exact(a.letter, a.number);
+    }
+  }
+  gcode.end();
+}
+
+// Converts a G-code text file to binary G-code. Comments and blank lines are
+// dropped; the commands themselves round-trip exactly.
+inline void encode(const std::filesystem::path& gcode,
+                   const std::filesystem::path& binary)
+{
+  Writer writer(binary);
+  CommandStream stream(gcode);
+  while (const CommandView* cmd = stream.next())
+    writer.add(*cmd);
+  writer.close();
+}
+
+// Converts binary G-code back to a G-code text file.
+inline void decode(const std::filesystem::path& binary,
+                   const std::filesystem::path& gcode)
+{
+  const Reader reader(binary);
+  std::ofstream out(gcode, std::ios::binary | std::ios::trunc);
+  if (!out)
+    throw std::runtime_error("cannot open " + gcode.string());
+  GCodeEmitter emitter {StreamSink(out)};
+  reader.forEach([&](const CommandView& cmd) { emitCommand(emitter, cmd); });
+  emitter.flush();
+}
+
+}  // namespace GCodeBinary
+}  // namespace Stratum
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define STRATUM_HAS_FD 1
+#  include <cerrno>
+#  include <unistd.h>
+#else
+#  define STRATUM_HAS_FD 0
+#endif
+
+namespace Stratum
+{
+
+// A sink receives emitted G-code in blocks of whole, newline-terminated lines.
+template<typename S>
+concept GCodeSink = requires(S& s, std::string_view block) { s(block); };
+
+#if STRATUM_HAS_FD
+// Writes blocks to a POSIX file descriptor, which stays owned by the caller.
+class FdSink
+{
+public:
+  explicit FdSink(int fd)
+      : fd_(fd)
+  {
+  }
+
+  void operator()(std::string_view block) const
+  {
+    while (!block.empty()) {
+      const ssize_t n = ::write(fd_, block.data(), block.size());
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::runtime_error("cannot write G-code");
+      }
+      block.remove_prefix(static_cast<std::size_t>(n));
+    }
+  }
+
+private:
+  int fd_;
+};
+#endif
+
+// Writes blocks to a std::ostream.
+class StreamSink
+{
+public:
+  explicit StreamSink(std::ostream& os)
+      : os_(&os)
+  {
+  }
+
+  void operator()(std::string_view block) const
+  {
+    os_->write(block.data(), static_cast<std::streamsize>(block.size()));
+    if (!*os_)
+      throw std::runtime_error("cannot write G-code");
+  }
+
+private:
+  std::ostream* os_;
+};
+
+// Output-iterator adapter: each line is assigned to *out++ as a std::string
+// without its newline. The string is reused, so only `out` may allocate.
+// Lines arrive when the emitter flushes; give the emitter a block size of 0
+// to deliver each one as it ends.
+template<typename Out>
+class LineSink
+{
+public:
+  explicit LineSink(Out out)
+      : out_(std::move(out))
+  {
+  }
+
+  void operator()(std::string_view block)
+  {
+    while (!block.empty()) {
+      const std::size_t nl = block.find('\n');
+      line_.assign(block.substr(0, nl));
+      *out_++ = line_;
+      if (nl == std::string_view::npos)
+        break;
+      block.remove_prefix(nl + 1);
+    }
+  }
+
+private:
+  Out out_;
+  std::string line_;
+};
+
+// Buffered G-code writer. Lines are assembled in one reusable buffer with
+// std::to_chars and handed to the sink once `block` bytes have accumulated
+// (after every line when `block` is 0), and on flush() or destruction.
+//
+//   gcode.text("G1").fixed('X', x).fixed('Y', y).fixed('F', feed).end();
+//
+// Numbers match the stream formatting they replace: fixed() is "%.<p>f",
+// general() is "%g" (an ostream's default) and digits() is "%0<width>d";
+// exact() writes the shortest digits that parse back to the same double.
+template<GCodeSink Sink>
+class GCodeEmitter
+{
+public:
+  static constexpr std::size_t kDefaultBlock = std::size_t {1} << 16;
+
+  explicit GCodeEmitter(Sink sink, std::size_t block = kDefaultBlock)
+      : sink_(std::move(sink))
+      , block_(block)
+      , cap_(block + kSlack)
+      , buf_(new char[cap_])
+  {
+  }
+
+  GCodeEmitter(const GCodeEmitter&) = delete;
+  GCodeEmitter& operator=(const GCodeEmitter&) = delete;
+
+  ~GCodeEmitter()
+  {
+    try {
+      flush();
+    } catch (...) {
+    }
+  }
+
+  // Appends raw text to the current line.
+  GCodeEmitter& text(std::string_view s)
+  {
+    reserve(s.size());
+    std::memcpy(buf_.get() + len_, s.data(), s.size());
+    len_ += s.size();
+    return *this;
+  }
+
+  // " <letter><value>" with `precision` decimals.
+  GCodeEmitter& fixed(char letter, double v, int precision = 4)
+  {
+    put(' ');
+    put(letter);
+    return number(v, precision);
+  }
+
+  // " <letter><value>" in the shortest "%g" form with 6 significant digits.
+  GCodeEmitter& general(char letter, double v)
+  {
+    put(' ');
+    put(letter);
+    reserve(kNumber);
+    const auto r = std::to_chars(buf_.get() + len_,
+                                 buf_.get() + cap_,
+                                 v,
+                                 std::chars_format::general,
+                                 6);
+    len_ = static_cast<std::size_t>(r.ptr - buf_.get());
+    return *this;
+  }
+
+  // " <letter><value>" in the shortest fixed-point form (no exponent, which
+  // the parser does not read) that reads back as exactly `v`.
+  GCodeEmitter& exact(char letter, double v)
+  {
+    put(' ');
+    put(letter);
+    reserve(kNumber);
+    const auto r = std::to_chars(
+        buf_.get() + len_, buf_.get() + cap_, v, std::chars_format::fixed);
+    if (r.ec != std::errc())
+      throw std::runtime_error("cannot format G-code number");
+    len_ = static_cast<std::size_t>(r.ptr - buf_.get());
+    return *this;
+  }
+
+  // " <letter><value>" for an integer.
+  GCodeEmitter& integer(char letter, long long v)
+  {
+    put(' ');
+    put(letter);
+    return digits(v);
+  }
+
+  // A bare number with `precision` decimals.
+  GCodeEmitter& number(double v, int precision)
+  {
+    reserve(kNumber + static_cast<std::size_t>(precision > 0 ? precision : 0));
+    const auto r = std::to_chars(buf_.get() + len_,
+                                 buf_.get() + cap_,
+                                 v,
+                                 std::chars_format::fixed,
+                                 precision);
+    if (r.ec != std::errc())
+      throw std::runtime_error("cannot format G-code number");
+    len_ = static_cast<std::size_t>(r.ptr - buf_.get());
+    return *this;
+  }
+
+  // A bare non-negative integer, zero-padded to `width` digits.
+  GCodeEmitter& digits(long long v, int width = 0)
+  {
+    char tmp[24];
+    const auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    const auto n = static_cast<std::size_t>(r.ptr - tmp);
+    const std::size_t pad =
+        width > 0 && static_cast<std::size_t>(width) > n
+        ? static_cast<std::size_t>(width) - n
+        : 0;
+    reserve(pad + n);
+    std::memset(buf_.get() + len_, '0', pad);
+    std::memcpy(buf_.get() + len_ + pad, tmp, n);
+    len_ += pad + n;
+    return *this;
+  }
+
+  // Terminates the current line.
+  void end()
+  {
+    put('\n');
+    if (len_ >= block_)
+      flush();
+  }
+
+  // A complete line.
+  void line(std::string_view s) { text(s).end(); }
+
+  // A complete "; <text>" comment line.
+  void comment(std::string_view s) { text("; ").text(s).end(); }
+
+  // Hands everything up to the last complete line to the sink.
+  void flush()
+  {
+    std::size_t n = len_;
+    while (n > 0 && buf_[n - 1] != '\n')
+      --n;
+    if (n == 0)
+      return;
+    sink_(std::string_view(buf_.get(), n));
+    std::memmove(buf_.get(), buf_.get() + n, len_ - n);
+    len_ -= n;
+  }
+
+  Sink& sink() { return sink_; }
+
+private:
+  static constexpr std::size_t kSlack = 4096;  // room for the line in progress
+  static constexpr std::size_t kNumber = 350;  // longest fixed double
+
+  void put(char c)
+  {
+    reserve(1);
+    buf_[len_++] = c;
+  }
+
+  // Only lines longer than the slack make the buffer grow.
+  void reserve(std::size_t n)
+  {
+    if (len_ + n <= cap_)
+      return;
+    std::size_t cap = cap_ * 2;
+    while (cap < len_ + n)
+      cap *= 2;
+    std::unique_ptr<char[]> grown(new char[cap]);
+    std::memcpy(grown.get(), buf_.get(), len_);
+    buf_ = std::move(grown);
+    cap_ = cap;
+  }
+
+  Sink sink_;
+  std::size_t block_;
+  std::size_t cap_;
+  std::unique_ptr<char[]> buf_;
+  std::size_t len_ = 0;
+};
+
+// Very small helpers to emit G-code or comments through an output iterator.
+template<typename Out>
+inline void comment(Out& o, const std::string& t)
+{
+  *o++ = "; " + t;
+}
+
+template<typename Out>
+inline void cmd(Out& o, const std::string& g)
+{
+  *o++ = g;
+}
+
+}  // namespace Stratum
@@ -9,25 +9,44 @@
  */
 
 #include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <concepts>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iomanip>
 #include <iterator>
 #include <limits>
-#include <list>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <numeric>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "gcode_emitter.h"
+#include "instrumentation.h"
+#include "layer_archive.h"
+#include "layer_cache.h"
+#include "layer_mask.h"
 #include "lodepng.h"  // PNG encoder (header-only)
+#include "mapped_file.h"
+#include "png_encoder.h"
+#include "thread_pool.h"
 
 namespace Stratum
 {
@@ -43,10 +62,22 @@ struct LCDConfig
   double layer_height = 0.05;  // mm
   double exposure_s = 8.0;  // s
   double padding_percentage = 10.0;  // %, border around auto-scaled model
+  bool autoscale = true;  // if false, keep STL native scale and center
   int intensity_pct = 100;  // 0-100 for M701... Ixxx
   std::filesystem::path png_dir = "layers";
+  int png_level = 1;  // -1 = lodepng, 0 = stored, 1 = fast RLE, 2 = deflate
+  std::filesystem::path archive_path;  // if set, one layer archive, no PNGs
+  int archive_encoding = 1;  // 0 = raw, 1 = RLE, 2 = deflate
   double final_lift_mm =
       5.0;  // mm, final lift height post-print. Set to 0 to disable.
+  double layer_feed = 50.0;  // mm/min, Z move to each layer
+  double lift_feed = 100.0;  // mm/min, final lift
+  int workers = 1;  // layer pipeline threads, 0 = hardware concurrency
+  int max_inflight_layers = 0;  // layers held at once, 0 = 2 x workers
+  bool dedup_layers = true;  // reuse stored masks for repeated layers
+  bool dedup_summary = false;  // note the dedup ratio in a G-code comment
+  int antialias = 1;  // N x N coverage samples, 1 = binary 1-bit masks, <= 16
+  std::filesystem::path layer_cache_dir;  // if set, reuse sliced layers
 };
 
 // DLP projector configuration (pixel-based, projected layers)
@@ -62,8 +93,19 @@ struct DLPConfig
   double padding_percentage = 10.0;  // %, border around auto-scaled model
   int intensity_pct = 100;  // 0-100 for M701... Ixxx
   std::filesystem::path png_dir = "layers";
+  int png_level = 1;  // -1 = lodepng, 0 = stored, 1 = fast RLE, 2 = deflate
+  std::filesystem::path archive_path;  // if set, one layer archive, no PNGs
+  int archive_encoding = 1;  // 0 = raw, 1 = RLE, 2 = deflate
   double final_lift_mm =
       5.0;  // mm, final lift height post-print. Set to 0 to disable.
+  double layer_feed = 50.0;  // mm/min, Z move to each layer
+  double lift_feed = 100.0;  // mm/min, final lift
+  int workers = 1;  // layer pipeline threads, 0 = hardware concurrency
+  int max_inflight_layers = 0;  // layers held at once, 0 = 2 x workers
+  bool dedup_layers = true;  // reuse stored masks for repeated layers
+  bool dedup_summary = false;  // note the dedup ratio in a G-code comment
+  int antialias = 1;  // N x N coverage samples, 1 = binary 1-bit masks, <= 16
+  std::filesystem::path layer_cache_dir;  // if set, reuse sliced layers
 };
 
 struct SLAConfig
@@ -75,6 +117,9 @@ struct SLAConfig
   double laser_power_pct = 100.0;  // 0-100 -> M3 Sxxx
   double final_lift_mm =
       5.0;  // mm, final lift height post-print. Set to 0 to disable.
+  bool optimize_travel = true;  // order contours and hatch blocks by rapids
+  double simplify_pct = 25.0;  // contour deviation limit, % of spot_radius
+  bool fit_arcs = false;  // emit circular contour runs as G2 / G3 arcs
 };
 
 template<class T>
@@ -130,50 +175,264 @@ struct Segment2D
   Vec2 p1, p2;
 };
 
-// Reads all triangles from an ASCII STL file and computes the 3D bounds.
-inline std::vector<Triangle> readStl(const std::filesystem::path& p,
-                                     Bounds3D& out_bounds)
+// Vertices and bounds parsed from one newline-aligned slice of an ASCII STL.
+struct AsciiStlChunk
 {
-  std::ifstream f(p);
-  if (!f) {
-    throw std::runtime_error("cannot open " + p.string());
+  std::vector<Vec3> vertices;
+  Bounds3D bounds {std::numeric_limits<double>::max(),
+                   std::numeric_limits<double>::max(),
+                   std::numeric_limits<double>::max(),
+                   std::numeric_limits<double>::lowest(),
+                   std::numeric_limits<double>::lowest(),
+                   std::numeric_limits<double>::lowest()};
+};
+
+// Whitespace as skipped by formatted stream extraction, minus the newline
+// that terminates each line.
+inline bool isStlBlank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parses one coordinate with std::from_chars. Malformed values read as 0.
+inline double parseStlNumber(const char*& p, const char* end)
+{
+  while (p < end && isStlBlank(*p))
+    ++p;
+  if (p < end && *p == '+')
+    ++p;
+  double v = 0.0;
+  const auto res = std::from_chars(p, end, v);
+  if (res.ec != std::errc {})
+    v = 0.0;
+  p = res.ptr;
+  return v;
+}
+
+// Parses every "vertex x y z" line in [begin, end). `begin` must be the start
+// of a line.
+inline void parseAsciiStlChunk(const char* begin,
+                               const char* end,
+                               AsciiStlChunk& chunk)
+{
+  Bounds3D& bb = chunk.bounds;
+  const char* p = begin;
+  while (p < end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr)
+      eol = end;
+
+    while (p < eol && isStlBlank(*p))
+      ++p;
+    if (eol - p > 6 && std::memcmp(p, "vertex", 6) == 0 && isStlBlank(p[6])) {
+      p += 6;
+      Vec3 v;
+      v.x = parseStlNumber(p, eol);
+      v.y = parseStlNumber(p, eol);
+      v.z = parseStlNumber(p, eol);
+      chunk.vertices.push_back(v);
+
+      bb.min_x = std::min(bb.min_x, v.x);
+      bb.min_y = std::min(bb.min_y, v.y);
+      bb.min_z = std::min(bb.min_z, v.z);
+      bb.max_x = std::max(bb.max_x, v.x);
+      bb.max_y = std::max(bb.max_y, v.y);
+      bb.max_z = std::max(bb.max_z, v.z);
+    }
+    p = eol + 1;
+  }
+}
+
+// Below this size an ASCII STL is parsed on the calling thread only.
+inline constexpr std::size_t kAsciiStlMinChunk = std::size_t {4} << 20;
+
+// Reads all triangles from an in-memory ASCII STL image and computes the 3D
+// bounds. Large inputs are split into newline-aligned chunks that are parsed
+// concurrently; `threads == 0` uses the hardware concurrency. Every three
+// consecutive vertices form one triangle, as in the stream-based reader.
+inline std::vector<Triangle> readAsciiStl(
+    std::string_view data,
+    Bounds3D& out_bounds,
+    unsigned threads = 0,
+    std::size_t min_chunk = kAsciiStlMinChunk)
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t by_size = data.size() / std::max<std::size_t>(1, min_chunk);
+  const std::size_t n_chunks =
+      std::clamp<std::size_t>(by_size, 1, threads);
+
+  // Chunk boundaries are moved forward to the next line start.
+  std::vector<const char*> cuts(n_chunks + 1);
+  const char* const first = data.data();
+  const char* const last = data.data() + data.size();
+  cuts.front() = first;
+  cuts.back() = last;
+  for (std::size_t i = 1; i < n_chunks; ++i) {
+    const char* c = std::max(first + data.size() * i / n_chunks, cuts[i - 1]);
+    const char* nl = static_cast<const char*>(std::memchr(c, '\n', last - c));
+    cuts[i] = nl ? nl + 1 : last;
+  }
+
+  std::vector<AsciiStlChunk> chunks(n_chunks);
+  if (n_chunks == 1) {
+    parseAsciiStlChunk(first, last, chunks[0]);
+  } else {
+    std::vector<std::thread> workers;
+    workers.reserve(n_chunks - 1);
+    for (std::size_t i = 1; i < n_chunks; ++i)
+      workers.emplace_back([&, i]
+                           { parseAsciiStlChunk(cuts[i], cuts[i + 1], chunks[i]); });
+    parseAsciiStlChunk(cuts[0], cuts[1], chunks[0]);
+    for (auto& w : workers)
+      w.join();
   }
 
   const double maxD = std::numeric_limits<double>::max();
   const double minD = std::numeric_limits<double>::lowest();
   out_bounds = {maxD, maxD, maxD, minD, minD, minD};
 
-  std::vector<Triangle> triangles;
-  std::string line;
-  Vec3 vertices[3];
-  int vertex_count = 0;
-
-  while (std::getline(f, line)) {
-    std::istringstream iss(line);
-    std::string token;
-    iss >> token;
-    if (token == "vertex") {
-      iss >> vertices[vertex_count].x >> vertices[vertex_count].y
-          >> vertices[vertex_count].z;
-
-      out_bounds.min_x = std::min(out_bounds.min_x, vertices[vertex_count].x);
-      out_bounds.min_y = std::min(out_bounds.min_y, vertices[vertex_count].y);
-      out_bounds.min_z = std::min(out_bounds.min_z, vertices[vertex_count].z);
-      out_bounds.max_x = std::max(out_bounds.max_x, vertices[vertex_count].x);
-      out_bounds.max_y = std::max(out_bounds.max_y, vertices[vertex_count].y);
-      out_bounds.max_z = std::max(out_bounds.max_z, vertices[vertex_count].z);
-
-      if (++vertex_count == 3) {
-        triangles.push_back({vertices[0], vertices[1], vertices[2]});
-        vertex_count = 0;
-      }
-    }
+  std::size_t n_vertices = 0;
+  for (const auto& c : chunks) {
+    n_vertices += c.vertices.size();
+    out_bounds.min_x = std::min(out_bounds.min_x, c.bounds.min_x);
+    out_bounds.min_y = std::min(out_bounds.min_y, c.bounds.min_y);
+    out_bounds.min_z = std::min(out_bounds.min_z, c.bounds.min_z);
+    out_bounds.max_x = std::max(out_bounds.max_x, c.bounds.max_x);
+    out_bounds.max_y = std::max(out_bounds.max_y, c.bounds.max_y);
+    out_bounds.max_z = std::max(out_bounds.max_z, c.bounds.max_z);
   }
   if (out_bounds.min_x == maxD)
     out_bounds = {0, 0, 0, 0, 0, 0};
+
+  // Chunks may end mid-triangle, so vertices are regrouped across them.
+  std::vector<Triangle> triangles(n_vertices / 3);
+  std::size_t k = 0;
+  for (auto& c : chunks) {
+    for (const Vec3& v : c.vertices) {
+      if (k == triangles.size() * 3)
+        break;
+      Triangle& tri = triangles[k / 3];
+      (k % 3 == 0 ? tri.v1 : k % 3 == 1 ? tri.v2 : tri.v3) = v;
+      ++k;
+    }
+    std::vector<Vec3>().swap(c.vertices);
+  }
+  return triangles;
+}
+
+// Returns the bytes of an STL file. Regular files are memory-mapped into
+// `file`; pipes, FIFOs and devices such as /dev/stdin report no size, so
+// they are read into `buffer` instead.
+inline std::string_view loadStl(const std::filesystem::path& p,
+                                MappedFile& file,
+                                std::string& buffer)
+{
+  std::error_code ec;
+  if (std::filesystem::is_regular_file(p, ec)) {
+    file = MappedFile(p);
+    return file.view();
+  }
+  std::ifstream in(p, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("cannot open " + p.string());
+  buffer.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  return buffer;
+}
+
+// Reads all triangles from an ASCII STL file and computes the 3D bounds.
+inline std::vector<Triangle> readAsciiStl(const std::filesystem::path& p,
+                                          Bounds3D& out_bounds)
+{
+  MappedFile file;
+  std::string buffer;
+  return readAsciiStl(loadStl(p, file, buffer), out_bounds);
+}
+
+// Binary STL layout: 80-byte header, uint32 facet count, then one 50-byte
+// record per facet (normal, three vertices, attribute byte count).
+inline constexpr std::size_t kStlHeaderSize = 84;
+inline constexpr std::size_t kStlFacetSize = 50;
+
+// Reads a little-endian 32-bit word; compiles to a plain load on x86/ARM.
+inline std::uint32_t loadLE32(const char* p)
+{
+  const auto* b = reinterpret_cast<const unsigned char*>(p);
+  return std::uint32_t {b[0]} | (std::uint32_t {b[1]} << 8)
+      | (std::uint32_t {b[2]} << 16) | (std::uint32_t {b[3]} << 24);
+}
+
+// A file is treated as binary when its size matches the facet count stored in
+// the header exactly. The "solid" prefix is not used because many CAD tools
+// write it into binary headers as well.
+inline bool isBinaryStl(std::string_view data)
+{
+  if (data.size() < kStlHeaderSize)
+    return false;
+  const std::uint32_t count = loadLE32(data.data() + 80);
+  return data.size() == kStlHeaderSize + kStlFacetSize * std::size_t {count};
+}
+
+// Decodes a little-endian float stored at `p`.
+inline double loadStlFloat(const char* p)
+{
+  return static_cast<double>(std::bit_cast<float>(loadLE32(p)));
+}
+
+// Decodes the facet records of a binary STL image straight into the triangle
+// buffer and computes the 3D bounds in the same pass.
+inline std::vector<Triangle> readBinaryStl(std::string_view data,
+                                           Bounds3D& out_bounds)
+{
+  if (!isBinaryStl(data))
+    throw std::runtime_error("malformed binary STL");
+
+  const std::size_t count = (data.size() - kStlHeaderSize) / kStlFacetSize;
+  std::vector<Triangle> triangles(count);
+
+  const double maxD = std::numeric_limits<double>::max();
+  const double minD = std::numeric_limits<double>::lowest();
+  Bounds3D bb = {maxD, maxD, maxD, minD, minD, minD};
+
+  const char* rec = data.data() + kStlHeaderSize;
+  for (std::size_t i = 0; i < count; ++i, rec += kStlFacetSize) {
+    Triangle& tri = triangles[i];
+    const char* v = rec + 12;  // skip the facet normal
+    for (Vec3* dst : {&tri.v1, &tri.v2, &tri.v3}) {
+      dst->x = loadStlFloat(v);
+      dst->y = loadStlFloat(v + 4);
+      dst->z = loadStlFloat(v + 8);
+      v += 12;
+
+      bb.min_x = std::min(bb.min_x, dst->x);
+      bb.min_y = std::min(bb.min_y, dst->y);
+      bb.min_z = std::min(bb.min_z, dst->z);
+      bb.max_x = std::max(bb.max_x, dst->x);
+      bb.max_y = std::max(bb.max_y, dst->y);
+      bb.max_z = std::max(bb.max_z, dst->z);
+    }
+  }
+  if (bb.min_x == maxD)
+    bb = {0, 0, 0, 0, 0, 0};
+  out_bounds = bb;
   return triangles;
 }
 
+// Reads all triangles from an ASCII or binary STL file and computes the 3D
+// bounds. The format is detected from the header and facet count.
+inline std::vector<Triangle> readStl(const std::filesystem::path& p,
+                                     Bounds3D& out_bounds)
+{
+  STRATUM_SPAN(span, "read_stl");
+  MappedFile file;
+  std::string buffer;
+  const std::string_view data = loadStl(p, file, buffer);
+  if (isBinaryStl(data))
+    return readBinaryStl(data, out_bounds);
+  return readAsciiStl(data, out_bounds);
+}
+
 // Calculates the intersection of a line segment (p1-p2) with a Z-plane.
 inline Vec3 intersectionPoint(const Vec3& p1, const Vec3& p2, double z)
 {
@@ -183,93 +442,1055 @@ inline Vec3 intersectionPoint(const Vec3& p1, const Vec3& p2, double z)
   return {p1.x + t * (p2.x - p1.x), p1.y + t * (p2.y - p1.y), z};
 }
 
+// Intersects one triangle with a Z-plane. Returns false when the triangle
+// does not cross the plane.
+inline bool sliceTriangle(const Triangle& tri, double z, Segment2D& seg)
+{
+  const Vec3* V[] = {&tri.v1, &tri.v2, &tri.v3};
+  double z_coords[] = {V[0]->z, V[1]->z, V[2]->z};
+
+  int below_count = 0;
+  for (double v_z : z_coords) {
+    if (v_z < z)
+      below_count++;
+  }
+
+  if (below_count == 0 || below_count == 3)
+    return false;
+
+  Vec3 intersection_points[2];
+  int intersection_count = 0;
+
+  for (int i = 0; i < 3; ++i) {
+    int j = (i + 1) % 3;
+    bool v1_below = z_coords[i] < z;
+    bool v2_below = z_coords[j] < z;
+
+    if (v1_below != v2_below) {
+      if (intersection_count < 2) {
+        intersection_points[intersection_count++] =
+            intersectionPoint(*V[i], *V[j], z);
+      }
+    }
+  }
+
+  if (intersection_count != 2)
+    return false;
+  seg = {{intersection_points[0].x, intersection_points[0].y},
+         {intersection_points[1].x, intersection_points[1].y}};
+  return true;
+}
+
 // Slices a mesh of triangles at a given Z height, returning 2D line segments.
 inline std::vector<Segment2D> sliceTriangles(
     const std::vector<Triangle>& triangles, double z)
 {
   std::vector<Segment2D> segments;
+  Segment2D seg;
   for (const auto& tri : triangles) {
-    const Vec3* V[] = {&tri.v1, &tri.v2, &tri.v3};
-    double z_coords[] = {V[0]->z, V[1]->z, V[2]->z};
+    if (sliceTriangle(tri, z, seg))
+      segments.push_back(seg);
+  }
+  return segments;
+}
+
+// Marks a missing neighbour across an open or non-manifold edge.
+inline constexpr std::uint32_t kNoFace =
+    std::numeric_limits<std::uint32_t>::max();
+
+// Indexed triangle mesh with welded vertices stored as SoA arrays. `Real` may
+// be float to halve vertex memory on very large meshes. `adjacent[3 * f + e]`
+// is the face sharing edge (v_e, v_e+1) of face f, or kNoFace when the edge
+// is open or shared by more than two faces.
+template<std::floating_point Real = double>
+struct IndexedMesh
+{
+  std::vector<Real> x, y, z;
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint32_t> adjacent;
+
+  std::size_t vertexCount() const { return x.size(); }
+  std::size_t faceCount() const { return indices.size() / 3; }
+
+  Vec3 vertex(std::uint32_t i) const
+  {
+    return {static_cast<double>(x[i]),
+            static_cast<double>(y[i]),
+            static_cast<double>(z[i])};
+  }
+};
+
+// Hash of a vertex position; -0.0 and 0.0 hash alike since they compare equal.
+template<std::floating_point Real>
+inline std::uint64_t hashVertex(Real x, Real y, Real z)
+{
+  std::uint64_t h = 0x9E3779B97F4A7C15ull;
+  for (Real c : {x, y, z}) {
+    const double d = static_cast<double>(c) + 0.0;
+    h ^= std::bit_cast<std::uint64_t>(d) + 0x9E3779B97F4A7C15ull + (h << 6)
+        + (h >> 2);
+  }
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Fills mesh.adjacent from mesh.indices using a vertex-to-face incidence
+// table, so memory stays proportional to the face count.
+template<std::floating_point Real>
+inline void buildEdgeAdjacency(IndexedMesh<Real>& mesh)
+{
+  const std::size_t n_faces = mesh.faceCount();
+  const std::size_t n_verts = mesh.vertexCount();
+  const auto& idx = mesh.indices;
 
-    int below_count = 0;
-    for (double v_z : z_coords) {
-      if (v_z < z)
-        below_count++;
+  std::vector<std::uint32_t> offsets(n_verts + 1, 0);
+  for (std::uint32_t v : idx)
+    ++offsets[v + 1];
+  for (std::size_t i = 0; i < n_verts; ++i)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<std::uint32_t> incident(idx.size());
+  {
+    std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t f = 0; f < n_faces; ++f)
+      for (int c = 0; c < 3; ++c)
+        incident[fill[idx[3 * f + c]]++] = static_cast<std::uint32_t>(f);
+  }
+
+  mesh.adjacent.assign(idx.size(), kNoFace);
+  for (std::size_t f = 0; f < n_faces; ++f) {
+    for (int e = 0; e < 3; ++e) {
+      const std::uint32_t a = idx[3 * f + e];
+      const std::uint32_t b = idx[3 * f + (e + 1) % 3];
+      if (a == b)
+        continue;
+
+      std::uint32_t match = kNoFace;
+      int matches = 0;
+      for (std::uint32_t k = offsets[a]; k < offsets[a + 1]; ++k) {
+        const std::uint32_t g = incident[k];
+        if (g == f || (k > offsets[a] && incident[k - 1] == g))
+          continue;
+        const std::uint32_t* gi = &idx[3 * std::size_t {g}];
+        if (gi[0] == b || gi[1] == b || gi[2] == b) {
+          match = g;
+          ++matches;
+        }
+      }
+      if (matches == 1)
+        mesh.adjacent[3 * f + e] = match;
     }
+  }
+}
 
-    if (below_count == 0 || below_count == 3)
-      continue;
+// Welds bitwise-identical vertices through an open-addressing hash table and
+// builds the edge adjacency table.
+template<std::floating_point Real = double>
+inline IndexedMesh<Real> buildIndexedMesh(
+    const std::vector<Triangle>& triangles)
+{
+  if (triangles.size() * 3 >= kNoFace)
+    throw std::runtime_error("mesh too large for 32-bit indices");
 
-    Vec3 intersection_points[2];
-    int intersection_count = 0;
+  IndexedMesh<Real> mesh;
+  mesh.indices.resize(triangles.size() * 3);
 
-    for (int i = 0; i < 3; ++i) {
-      int j = (i + 1) % 3;
-      bool v1_below = z_coords[i] < z;
-      bool v2_below = z_coords[j] < z;
+  std::size_t capacity = 1024;
+  while (capacity < triangles.size())
+    capacity <<= 1;
+  std::vector<std::uint32_t> slots(capacity, kNoFace);
 
-      if (v1_below != v2_below) {
-        if (intersection_count < 2) {
-          intersection_points[intersection_count++] =
-              intersectionPoint(*V[i], *V[j], z);
+  const auto insert_slot = [&](std::uint32_t v)
+  {
+    const std::size_t mask = slots.size() - 1;
+    std::size_t s = hashVertex(mesh.x[v], mesh.y[v], mesh.z[v]) & mask;
+    while (slots[s] != kNoFace)
+      s = (s + 1) & mask;
+    slots[s] = v;
+  };
+
+  std::size_t k = 0;
+  for (const auto& tri : triangles) {
+    for (const Vec3* p : {&tri.v1, &tri.v2, &tri.v3}) {
+      const Real px = static_cast<Real>(p->x);
+      const Real py = static_cast<Real>(p->y);
+      const Real pz = static_cast<Real>(p->z);
+
+      const std::size_t mask = slots.size() - 1;
+      std::size_t s = hashVertex(px, py, pz) & mask;
+      std::uint32_t found = kNoFace;
+      while (slots[s] != kNoFace) {
+        const std::uint32_t v = slots[s];
+        if (mesh.x[v] == px && mesh.y[v] == py && mesh.z[v] == pz) {
+          found = v;
+          break;
+        }
+        s = (s + 1) & mask;
+      }
+
+      if (found == kNoFace) {
+        found = static_cast<std::uint32_t>(mesh.x.size());
+        mesh.x.push_back(px);
+        mesh.y.push_back(py);
+        mesh.z.push_back(pz);
+        slots[s] = found;
+
+        if (mesh.x.size() * 2 > slots.size()) {
+          slots.assign(slots.size() * 2, kNoFace);
+          for (std::uint32_t v = 0; v < mesh.x.size(); ++v)
+            insert_slot(v);
         }
       }
+      mesh.indices[k++] = found;
+    }
+  }
+
+  mesh.x.shrink_to_fit();
+  mesh.y.shrink_to_fit();
+  mesh.z.shrink_to_fit();
+  buildEdgeAdjacency(mesh);
+  return mesh;
+}
+
+// A polyline produced by slicing; closed contours do not repeat the start.
+// `area` is the signed (shoelace) area of the polyline closed back to its
+// start: positive for counter-clockwise contours, negative for clockwise.
+struct Contour
+{
+  std::vector<Vec2> points;
+  bool closed = false;
+  double area = 0.0;
+};
+
+inline double signedArea(const Contour& c)
+{
+  const auto& p = c.points;
+  if (p.size() < 3)
+    return 0.0;
+  double a = 0.0;
+  for (std::size_t i = 0, j = p.size() - 1; i < p.size(); j = i++)
+    a += p[j].x * p[i].y - p[i].x * p[j].y;
+  return a / 2.0;
+}
+
+// Walks the faces of an IndexedMesh crossing a Z-plane from neighbour to
+// neighbour, emitting one point per face, so contours come out already
+// connected. Shared edges are interpolated from their lower vertex index so
+// adjacent faces produce bitwise-identical points.
+template<std::floating_point Real = double>
+class ContourSlicer
+{
+public:
+  explicit ContourSlicer(const IndexedMesh<Real>& mesh)
+      : mesh_(mesh)
+      , mark_(mesh.faceCount(), 0)
+  {
+  }
+
+  // Slices every face of the mesh.
+  std::vector<Contour> slice(double z)
+  {
+    std::vector<Contour> contours;
+    beginLayer();
+    for (std::uint32_t f = 0; f < mesh_.faceCount(); ++f)
+      walkFrom(f, z, contours);
+    return contours;
+  }
+
+  // Slices only the given candidate faces and the faces reached from them.
+  template<typename FaceRange>
+  std::vector<Contour> slice(double z, const FaceRange& faces)
+  {
+    std::vector<Contour> contours;
+    beginLayer();
+    for (std::uint32_t f : faces)
+      walkFrom(f, z, contours);
+    return contours;
+  }
+
+private:
+  void beginLayer()
+  {
+    if (++stamp_ == 0) {
+      std::fill(mark_.begin(), mark_.end(), 0);
+      stamp_ = 1;
+    }
+  }
+
+  bool below(std::uint32_t v, double z) const
+  {
+    return static_cast<double>(mesh_.z[v]) < z;
+  }
+
+  std::uint32_t corner(std::uint32_t f, int c) const
+  {
+    return mesh_.indices[3 * std::size_t {f} + c];
+  }
+
+  bool crosses(std::uint32_t f, int e, double z) const
+  {
+    return below(corner(f, e), z) != below(corner(f, (e + 1) % 3), z);
+  }
+
+  Vec2 edgePoint(std::uint32_t f, int e, double z) const
+  {
+    std::uint32_t a = corner(f, e);
+    std::uint32_t b = corner(f, (e + 1) % 3);
+    if (b < a)
+      std::swap(a, b);
+    const Vec3 p = intersectionPoint(mesh_.vertex(a), mesh_.vertex(b), z);
+    return {p.x, p.y};
+  }
+
+  // Returns the crossing edge of face f other than `skip` (-1 for none).
+  // Without a skip the edge running from below to above is preferred, which
+  // keeps contour orientation consistent on an outward-oriented mesh.
+  int exitEdge(std::uint32_t f, int skip, double z) const
+  {
+    int found = -1;
+    for (int e = 0; e < 3; ++e) {
+      if (e == skip || !crosses(f, e, z))
+        continue;
+      if (skip >= 0 || below(corner(f, e), z))
+        return e;
+      found = e;
+    }
+    return found;
+  }
+
+  int sharedEdge(std::uint32_t f, std::uint32_t from) const
+  {
+    for (int e = 0; e < 3; ++e)
+      if (mesh_.adjacent[3 * std::size_t {f} + e] == from)
+        return e;
+    return -1;
+  }
+
+  // Follows neighbours from face f leaving through `edge`, appending points.
+  // Returns true when the walk arrives back at `start`.
+  bool follow(std::uint32_t start,
+              std::uint32_t f,
+              int edge,
+              double z,
+              std::vector<Vec2>& pts)
+  {
+    while (true) {
+      pts.push_back(edgePoint(f, edge, z));
+      const std::uint32_t g = mesh_.adjacent[3 * std::size_t {f} + edge];
+      if (g == kNoFace)
+        return false;
+      if (g == start)
+        return true;
+      if (mark_[g] == stamp_)
+        return false;
+      const int in = sharedEdge(g, f);
+      const int out = in < 0 ? -1 : exitEdge(g, in, z);
+      if (out < 0)
+        return false;
+      mark_[g] = stamp_;
+      f = g;
+      edge = out;
     }
+  }
 
-    if (intersection_count == 2) {
-      segments.push_back(
-          {{intersection_points[0].x, intersection_points[0].y},
-           {intersection_points[1].x, intersection_points[1].y}});
+  void walkFrom(std::uint32_t f, double z, std::vector<Contour>& contours)
+  {
+    if (mark_[f] == stamp_)
+      return;
+    const int out = exitEdge(f, -1, z);
+    if (out < 0)
+      return;
+    const int in = exitEdge(f, out, z);
+    mark_[f] = stamp_;
+
+    Contour c;
+    c.points.push_back(edgePoint(f, in, z));
+    c.closed = follow(f, f, out, z, c.points);
+    if (c.closed) {
+      // The walk ends on the start face's entry point, already at the front.
+      c.points.pop_back();
+    } else {
+      // Extend backwards from the entry edge and prepend that part.
+      std::vector<Vec2> back;
+      follow(f, f, in, z, back);
+      back.erase(back.begin());
+      c.points.insert(c.points.begin(), back.rbegin(), back.rend());
     }
+    c.area = signedArea(c);
+    contours.push_back(std::move(c));
+  }
+
+  const IndexedMesh<Real>& mesh_;
+  std::vector<std::uint32_t> mark_;
+  std::uint32_t stamp_ = 0;
+};
+
+// Flattens contours back into the segment list used by scanline fills.
+inline std::vector<Segment2D> contourSegments(
+    const std::vector<Contour>& contours)
+{
+  std::vector<Segment2D> segments;
+  for (const auto& c : contours) {
+    const auto& p = c.points;
+    for (std::size_t i = 1; i < p.size(); ++i)
+      segments.push_back({p[i - 1], p[i]});
+    if (c.closed && p.size() > 1)
+      segments.push_back({p.back(), p.front()});
   }
   return segments;
 }
 
-// Fills a pixel mask by rasterizing 2D line segments, applying an offset to
-// center the model.
-inline void rasterizeCenteredSegments(std::vector<uint8_t>& mask,
-                                      int w,
-                                      int h,
-                                      double pitch,
-                                      const std::vector<Segment2D>& segments,
-                                      double offset_x,
-                                      double offset_y)
+// Joins unordered segments into polylines by matching endpoints that lie
+// within `tolerance` of each other in x and y. Endpoints are quantized into a
+// flat hash grid with cells twice the tolerance wide, so each endpoint is
+// matched by probing the 2 x 2 cells nearest to it, and the segments meeting
+// at each point are kept in one contiguous adjacency array. Chains are walked
+// from their open ends first, then the remaining loops, which makes the whole
+// stitch linear in the number of segments (expected).
+//
+// Every segment is used once. Closed loops do not repeat their start point;
+// where more than two segments meet, the walk continues along the first
+// unused one. Zero-length segments are dropped.
+inline std::vector<Contour> stitchContours(const std::vector<Segment2D>& segments,
+                                           double tolerance = 1e-6)
 {
+  std::vector<Contour> contours;
   if (segments.empty())
-    return;
+    return contours;
+  if (!(tolerance > 0.0))
+    throw std::invalid_argument("stitch tolerance must be positive");
 
-  for (int py = 0; py < h; ++py) {
-    double y_coord = (py + 0.5) * pitch;
-    std::vector<double> intersections;
+  // Hash grid: open-addressing table of occupied cells, each heading a chain
+  // of the points that fell into it.
+  struct Cell
+  {
+    std::int64_t x, y;
+    std::uint32_t head;
+  };
+  constexpr std::uint32_t kEmpty = std::numeric_limits<std::uint32_t>::max();
+  std::size_t slots = 16;
+  while (slots < 2 * segments.size())
+    slots *= 2;
+  std::vector<Cell> cells(slots, Cell {0, 0, kEmpty});
+  const std::size_t slot_mask = slots - 1;
+  const auto probe = [&](std::int64_t cx, std::int64_t cy)
+  {
+    const std::uint64_t h =
+        (static_cast<std::uint64_t>(cx) * 0x9E3779B97F4A7C15ull
+         ^ static_cast<std::uint64_t>(cy))
+        * 0xC2B2AE3D27D4EB4Full;
+    std::size_t i = static_cast<std::size_t>(h >> 32) & slot_mask;
+    while (cells[i].head != kEmpty && (cells[i].x != cx || cells[i].y != cy))
+      i = (i + 1) & slot_mask;
+    return i;
+  };
 
-    for (const auto& seg : segments) {
-      const Vec2 p1 = {seg.p1.x + offset_x, seg.p1.y + offset_y};
-      const Vec2 p2 = {seg.p2.x + offset_x, seg.p2.y + offset_y};
+  std::vector<Vec2> nodes;
+  std::vector<std::uint32_t> next_in_cell;
+  nodes.reserve(2 * segments.size());
+  next_in_cell.reserve(2 * segments.size());
+  const double inv = 0.5 / tolerance;
 
-      if ((p1.y <= y_coord && p2.y > y_coord)
-          || (p2.y <= y_coord && p1.y > y_coord))
-      {
-        if (std::abs(p2.y - p1.y) > 1e-9) {
-          double x_intersect =
-              p1.x + (p2.x - p1.x) * (y_coord - p1.y) / (p2.y - p1.y);
-          intersections.push_back(x_intersect);
+  // Returns the node within tolerance of p, adding p as a new one if none.
+  // Matches lie in p's cell or in the neighbour on the side p is closer to.
+  const auto node = [&](const Vec2& p)
+  {
+    const double fx = std::floor(p.x * inv);
+    const double fy = std::floor(p.y * inv);
+    const auto cx = static_cast<std::int64_t>(fx);
+    const auto cy = static_cast<std::int64_t>(fy);
+    const std::int64_t sx = p.x * inv - fx < 0.5 ? -1 : 1;
+    const std::int64_t sy = p.y * inv - fy < 0.5 ? -1 : 1;
+    for (const std::int64_t dy : {std::int64_t {0}, sy}) {
+      for (const std::int64_t dx : {std::int64_t {0}, sx}) {
+        for (std::uint32_t n = cells[probe(cx + dx, cy + dy)].head; n != kEmpty;
+             n = next_in_cell[n])
+        {
+          if (std::abs(nodes[n].x - p.x) <= tolerance
+              && std::abs(nodes[n].y - p.y) <= tolerance)
+            return n;
         }
       }
     }
+    const auto id = static_cast<std::uint32_t>(nodes.size());
+    Cell& cell = cells[probe(cx, cy)];
+    nodes.push_back(p);
+    next_in_cell.push_back(cell.head);
+    cell = {cx, cy, id};
+    return id;
+  };
+
+  std::vector<std::uint32_t> ends;  // node pairs of the kept segments
+  ends.reserve(2 * segments.size());
+  for (const auto& seg : segments) {
+    const std::uint32_t a = node(seg.p1);
+    const std::uint32_t b = node(seg.p2);
+    if (a == b)
+      continue;
+    ends.push_back(a);
+    ends.push_back(b);
+  }
+  const std::size_t edge_count = ends.size() / 2;
+  if (edge_count == 0)
+    return contours;
+
+  // Adjacency in compressed rows: the edges at node n are
+  // incident[first[n] .. first[n + 1]).
+  std::vector<std::uint32_t> first(nodes.size() + 1, 0);
+  for (std::uint32_t n : ends)
+    ++first[n + 1];
+  for (std::size_t n = 0; n < nodes.size(); ++n)
+    first[n + 1] += first[n];
+  std::vector<std::uint32_t> incident(ends.size());
+  std::vector<std::uint32_t> cursor(first.begin(), first.end() - 1);
+  for (std::size_t k = 0; k < ends.size(); ++k)
+    incident[cursor[ends[k]]++] = static_cast<std::uint32_t>(k / 2);
+  std::copy(first.begin(), first.end() - 1, cursor.begin());
+
+  std::vector<uint8_t> used(edge_count, 0);
+  const auto next_edge = [&](std::uint32_t n)
+  {
+    while (cursor[n] < first[n + 1] && used[incident[cursor[n]]])
+      ++cursor[n];
+    return cursor[n] < first[n + 1] ? incident[cursor[n]] : kEmpty;
+  };
+
+  const auto walk = [&](std::uint32_t start)
+  {
+    Contour c;
+    c.points.push_back(nodes[start]);
+    std::uint32_t at = start;
+    for (std::uint32_t e; (e = next_edge(at)) != kEmpty;) {
+      used[e] = 1;
+      at = ends[2 * e] == at ? ends[2 * e + 1] : ends[2 * e];
+      if (at == start) {
+        c.closed = true;
+        break;
+      }
+      c.points.push_back(nodes[at]);
+    }
+    c.area = signedArea(c);
+    contours.push_back(std::move(c));
+  };
+
+  // Open chains end at nodes of odd degree; start there so each comes out
+  // whole instead of split where a loop walk happened to enter it.
+  for (std::uint32_t n = 0; n < nodes.size(); ++n)
+    if ((first[n + 1] - first[n]) % 2 != 0 && next_edge(n) != kEmpty)
+      walk(n);
+  for (std::uint32_t n = 0; n < nodes.size(); ++n)
+    while (next_edge(n) != kEmpty)
+      walk(n);
+  return contours;
+}
+
+// Face Z-extents with the faces ordered by their lower end. Built once per
+// mesh and shared by any number of ZSweep cursors.
+class ZSweepIndex
+{
+public:
+  ZSweepIndex(std::vector<double> zmin, std::vector<double> zmax)
+      : zmin_(std::move(zmin))
+      , zmax_(std::move(zmax))
+      , order_(zmin_.size())
+  {
+    if (zmin_.size() >= kNoFace)
+      throw std::runtime_error("mesh too large for 32-bit indices");
+    for (std::uint32_t f = 0; f < order_.size(); ++f)
+      order_[f] = f;
+    std::sort(order_.begin(),
+              order_.end(),
+              [&](std::uint32_t a, std::uint32_t b)
+              { return zmin_[a] < zmin_[b] || (zmin_[a] == zmin_[b] && a < b); });
+  }
+
+  static ZSweepIndex fromTriangles(const std::vector<Triangle>& triangles)
+  {
+    std::vector<double> lo(triangles.size()), hi(triangles.size());
+    for (std::size_t f = 0; f < triangles.size(); ++f) {
+      const auto& t = triangles[f];
+      lo[f] = std::min({t.v1.z, t.v2.z, t.v3.z});
+      hi[f] = std::max({t.v1.z, t.v2.z, t.v3.z});
+    }
+    return {std::move(lo), std::move(hi)};
+  }
+
+  template<std::floating_point Real>
+  static ZSweepIndex fromMesh(const IndexedMesh<Real>& mesh)
+  {
+    std::vector<double> lo(mesh.faceCount()), hi(mesh.faceCount());
+    for (std::size_t f = 0; f < mesh.faceCount(); ++f) {
+      const double a = mesh.z[mesh.indices[3 * f]];
+      const double b = mesh.z[mesh.indices[3 * f + 1]];
+      const double c = mesh.z[mesh.indices[3 * f + 2]];
+      lo[f] = std::min({a, b, c});
+      hi[f] = std::max({a, b, c});
+    }
+    return {std::move(lo), std::move(hi)};
+  }
+
+  std::size_t size() const { return order_.size(); }
+  double zmin(std::uint32_t f) const { return zmin_[f]; }
+  double zmax(std::uint32_t f) const { return zmax_[f]; }
+  std::uint32_t sorted(std::size_t i) const { return order_[i]; }
+
+private:
+  std::vector<double> zmin_, zmax_;
+  std::vector<std::uint32_t> order_;
+};
+
+// Active-face cursor for a plane moving upward through a ZSweepIndex. A face
+// is active at height z when some vertex lies below z and some vertex does
+// not, which is exactly the set of faces sliceTriangle would cut.
+class ZSweep
+{
+public:
+  explicit ZSweep(const ZSweepIndex& index)
+      : index_(index)
+  {
+    active_.reserve(index.size());  // advance() never allocates
+  }
+
+  // Moves the plane to z, which must not be lower than the previous call, and
+  // returns the faces spanning it in index order of their lower end.
+  const std::vector<std::uint32_t>& advance(double z)
+  {
+    if (z < z_)
+      throw std::logic_error("ZSweep::advance called with decreasing z");
+    z_ = z;
+    while (next_ < index_.size() && index_.zmin(index_.sorted(next_)) < z)
+      active_.push_back(index_.sorted(next_++));
+    std::erase_if(active_,
+                  [&](std::uint32_t f) { return index_.zmax(f) < z; });
+    return active_;
+  }
+
+  const std::vector<std::uint32_t>& active() const { return active_; }
+
+private:
+  const ZSweepIndex& index_;
+  std::vector<std::uint32_t> active_;
+  std::size_t next_ = 0;
+  double z_ = std::numeric_limits<double>::lowest();
+};
+
+// Slices a triangle soup one layer after another, testing only the triangles
+// that span each plane instead of the whole mesh. Output segments match
+// sliceTriangles as a set.
+class SweepSlicer
+{
+public:
+  explicit SweepSlicer(const std::vector<Triangle>& triangles)
+      : triangles_(triangles)
+      , index_(ZSweepIndex::fromTriangles(triangles))
+      , sweep_(index_)
+  {
+  }
+
+  SweepSlicer(const SweepSlicer&) = delete;
+  SweepSlicer& operator=(const SweepSlicer&) = delete;
+
+  // Slices at z; successive calls must use non-decreasing heights.
+  std::vector<Segment2D> slice(double z)
+  {
+    std::vector<Segment2D> segments;
+    slice(z, segments);
+    return segments;
+  }
+
+  // Same, writing into `segments` so its allocation is reused.
+  void slice(double z, std::vector<Segment2D>& segments)
+  {
+    segments.clear();
+    Segment2D seg;
+    bool extruded = !std::isnan(last_z_);
+    const auto& active = sweep_.advance(z);
+    STRATUM_COUNT(TrianglesTested, active.size());
+    for (std::uint32_t f : active) {
+      const Triangle& tri = triangles_[f];
+      if (!sliceTriangle(tri, z, seg))
+        continue;
+      segments.push_back(seg);
+      extruded = extruded && isVertical(tri) && !hasVertexIn(tri, last_z_, z);
+    }
+    STRATUM_COUNT(Segments, segments.size());
+    repeats_ = extruded && !segments.empty()
+        && segments.size() == last_count_;
+    last_z_ = z;
+    last_count_ = segments.size();
+  }
 
+  // True when the last slice() cut the same cross-section as the call before
+  // it: the same number of faces were crossed, every one of them is vertical
+  // and none has a vertex in between the two planes. The segments themselves
+  // may still differ where a plane crosses a wall diagonal, but they trace the
+  // same outline, so the previous layer's mask can be reused as is.
+  bool repeatsPrevious() const { return repeats_; }
+
+  // Slices every layer plane base + (l + 0.5) * height for l in [0, count)
+  // in a single sweep. The generators do not call this: the mask pipeline
+  // sweeps one layer at a time through slice(z, segments) and the SLA path
+  // drives a ZSweep into its ContourSlicer, so only the layers in flight
+  // hold segments rather than the whole job.
+  std::vector<std::vector<Segment2D>> sliceAll(double base,
+                                               double height,
+                                               int count)
+  {
+    std::vector<std::vector<Segment2D>> layers;
+    layers.reserve(static_cast<std::size_t>(std::max(count, 0)));
+    for (int l = 0; l < count; ++l)
+      layers.push_back(slice(base + (l + 0.5) * height));
+    return layers;
+  }
+
+private:
+  // Exactly zero projected area: the cut is the same line at every height.
+  static bool isVertical(const Triangle& t)
+  {
+    return (t.v2.x - t.v1.x) * (t.v3.y - t.v1.y)
+        - (t.v2.y - t.v1.y) * (t.v3.x - t.v1.x)
+        == 0.0;
+  }
+
+  static bool hasVertexIn(const Triangle& t, double z0, double z1)
+  {
+    for (const Vec3* v : {&t.v1, &t.v2, &t.v3}) {
+      if (v->z >= z0 && v->z <= z1)
+        return true;
+    }
+    return false;
+  }
+
+  const std::vector<Triangle>& triangles_;
+  ZSweepIndex index_;
+  ZSweep sweep_;
+  double last_z_ = std::numeric_limits<double>::quiet_NaN();
+  std::size_t last_count_ = 0;
+  bool repeats_ = false;
+};
+
+// Scan-converts 2D line segments, applying an offset to center the model, and
+// calls fill(py, px_start, px_end) for every covered span, with the span
+// already clipped to [0, w). Row y is sampled at pixel centres
+// (py + 0.5) * pitch and each span between sorted crossings covers pixels
+// [round(x0 / pitch), round(x1 / pitch)).
+//
+// Segments are bucketed by the first row they cross into an edge table, and
+// only the edges active on a row are visited. Crossings are evaluated from
+// per-edge coefficients with the same expression as a direct per-row test, so
+// masks are bit-identical to a brute-force scan.
+//
+// The tables live in a RasterScratch that callers may keep between layers so
+// that rasterizing does not allocate once it has seen the largest layer.
+struct RasterScratch
+{
+  struct Edge
+  {
+    double x1, y1;  // first endpoint, offset applied
+    double dx, dy;  // p2 - p1
+    double y_end;  // upper y, exclusive
+  };
+
+  std::vector<Edge> edges;
+  std::vector<int> first_row;
+  std::vector<std::uint32_t> row_start;
+  std::vector<std::uint32_t> bucket;
+  std::vector<std::uint32_t> fill;
+  std::vector<std::uint32_t> active;
+  std::vector<double> intersections;
+  std::vector<std::uint16_t> coverage;  // rasterizeCoverage accumulator
+};
+
+template<typename SpanFn>
+inline void rasterizeSpans(int w,
+                           int h,
+                           double pitch,
+                           const std::vector<Segment2D>& segments,
+                           double offset_x,
+                           double offset_y,
+                           SpanFn&& fill,
+                           RasterScratch& scratch)
+{
+  if (segments.empty() || w <= 0 || h <= 0)
+    return;
+
+  using Edge = RasterScratch::Edge;
+  const auto row_y = [pitch](int py) { return (py + 0.5) * pitch; };
+
+  // Edge table: edges grouped by the first row whose centre they cross.
+  auto& edges = scratch.edges;
+  auto& first_row = scratch.first_row;
+  auto& row_start = scratch.row_start;
+  edges.clear();
+  first_row.clear();
+  edges.reserve(segments.size());
+  first_row.reserve(segments.size());
+  row_start.assign(static_cast<std::size_t>(h) + 1, 0);
+
+  for (const auto& seg : segments) {
+    const Vec2 p1 = {seg.p1.x + offset_x, seg.p1.y + offset_y};
+    const Vec2 p2 = {seg.p2.x + offset_x, seg.p2.y + offset_y};
+    if (!(std::abs(p2.y - p1.y) > 1e-9))
+      continue;
+
+    const double y_lo = std::min(p1.y, p2.y);
+    const double y_hi = std::max(p1.y, p2.y);
+
+    // Smallest row with y_lo <= row centre, found with the same arithmetic as
+    // the per-row test to avoid off-by-one rows from rounding.
+    double guess = std::ceil(y_lo / pitch - 0.5);
+    if (!(guess < h))
+      continue;
+    int py = static_cast<int>(std::max(guess, 0.0));
+    while (py > 0 && row_y(py - 1) >= y_lo)
+      --py;
+    while (py < h && row_y(py) < y_lo)
+      ++py;
+    if (py >= h || !(row_y(py) < y_hi))
+      continue;
+
+    edges.push_back({p1.x, p1.y, p2.x - p1.x, p2.y - p1.y, y_hi});
+    first_row.push_back(py);
+    ++row_start[static_cast<std::size_t>(py) + 1];
+  }
+  if (edges.empty())
+    return;
+
+  for (int py = 0; py < h; ++py)
+    row_start[py + 1] += row_start[py];
+  auto& bucket = scratch.bucket;
+  bucket.reserve(segments.size());
+  bucket.resize(edges.size());
+  {
+    auto& next = scratch.fill;
+    next.assign(row_start.begin(), row_start.end() - 1);
+    for (std::uint32_t e = 0; e < edges.size(); ++e)
+      bucket[next[first_row[e]]++] = e;
+  }
+
+  auto& active = scratch.active;
+  auto& intersections = scratch.intersections;
+  active.clear();
+  active.reserve(segments.size());
+  intersections.reserve(segments.size());
+
+  for (int py = 0; py < h; ++py) {
+    const double y_coord = row_y(py);
+
+    active.insert(active.end(),
+                  bucket.begin() + row_start[py],
+                  bucket.begin() + row_start[py + 1]);
+    std::erase_if(active,
+                  [&](std::uint32_t e) { return edges[e].y_end <= y_coord; });
+    if (active.empty())
+      continue;
+
+    intersections.clear();
+    for (std::uint32_t e : active) {
+      const Edge& ed = edges[e];
+      intersections.push_back(ed.x1 + ed.dx * (y_coord - ed.y1) / ed.dy);
+    }
     std::sort(intersections.begin(), intersections.end());
 
     for (size_t i = 0; i + 1 < intersections.size(); i += 2) {
-      int px_start = static_cast<int>(std::round(intersections[i] / pitch));
-      int px_end = static_cast<int>(std::round(intersections[i + 1] / pitch));
-
-      for (int px = std::max(0, px_start); px < std::min(w, px_end); ++px) {
-        mask[static_cast<size_t>(py) * w + px] = 1;
-      }
+      const int px_start =
+          std::max(0, static_cast<int>(std::round(intersections[i] / pitch)));
+      const int px_end = std::min(
+          w, static_cast<int>(std::round(intersections[i + 1] / pitch)));
+      if (px_start < px_end)
+        fill(py, px_start, px_end);
     }
   }
 }
+
+template<typename SpanFn>
+inline void rasterizeSpans(int w,
+                           int h,
+                           double pitch,
+                           const std::vector<Segment2D>& segments,
+                           double offset_x,
+                           double offset_y,
+                           SpanFn&& fill)
+{
+  RasterScratch scratch;
+  rasterizeSpans(w,
+                 h,
+                 pitch,
+                 segments,
+                 offset_x,
+                 offset_y,
+                 std::forward<SpanFn>(fill),
+                 scratch);
+}
+
+// The default span kernel of the raster layer engine: the edge-table scanline
+// rasterizer above. A kernel is a compile-time policy with the signature of
+// rasterizeSpans, so mask formats can be instantiated with another one.
+struct ScanlineKernel
+{
+  static constexpr std::string_view kName = "scanline";
+
+  template<typename SpanFn>
+  static void spans(int w,
+                    int h,
+                    double pitch,
+                    const std::vector<Segment2D>& segments,
+                    double offset_x,
+                    double offset_y,
+                    SpanFn&& fill,
+                    RasterScratch& scratch)
+  {
+    rasterizeSpans(w,
+                   h,
+                   pitch,
+                   segments,
+                   offset_x,
+                   offset_y,
+                   std::forward<SpanFn>(fill),
+                   scratch);
+  }
+};
+
+// Fills a byte-per-pixel mask by rasterizing 2D line segments, applying an
+// offset to center the model.
+inline void rasterizeCenteredSegments(std::vector<uint8_t>& mask,
+                                      int w,
+                                      int h,
+                                      double pitch,
+                                      const std::vector<Segment2D>& segments,
+                                      double offset_x,
+                                      double offset_y)
+{
+  uint8_t* const data = mask.data();
+  rasterizeSpans(w,
+                 h,
+                 pitch,
+                 segments,
+                 offset_x,
+                 offset_y,
+                 [data, w](int py, int x0, int x1)
+                 {
+                   std::memset(data + static_cast<size_t>(py) * w + x0,
+                               1,
+                               static_cast<size_t>(x1 - x0));
+                 });
+}
+
+// Fills a bit-packed mask by rasterizing 2D line segments, applying an offset
+// to center the model. Uses the mask's own dimensions.
+inline void rasterizeCenteredSegments(BitMask& mask,
+                                      double pitch,
+                                      const std::vector<Segment2D>& segments,
+                                      double offset_x,
+                                      double offset_y,
+                                      RasterScratch& scratch)
+{
+  rasterizeSpans(
+      mask.width(),
+      mask.height(),
+      pitch,
+      segments,
+      offset_x,
+      offset_y,
+      [&mask](int py, int x0, int x1) { mask.setSpan(py, x0, x1); },
+      scratch);
+}
+
+inline void rasterizeCenteredSegments(BitMask& mask,
+                                      double pitch,
+                                      const std::vector<Segment2D>& segments,
+                                      double offset_x,
+                                      double offset_y)
+{
+  RasterScratch scratch;
+  rasterizeCenteredSegments(mask, pitch, segments, offset_x, offset_y, scratch);
+}
+
+// Fills a greyscale mask with the area coverage of every pixel, estimated
+// from samples x samples sub-pixels (1..16): the segments are scan-converted
+// at pitch / samples and each sub-pixel span is added to a per-row coverage
+// accumulator, which is scaled to 0..255 once all sub-rows of a pixel row are
+// done. The inner loops are branch-free over contiguous arrays so they
+// vectorize. With samples == 1 the result is the binary mask at 0 / 255.
+template<typename Kernel = ScanlineKernel>
+inline void rasterizeCoverage(GreyMask& mask,
+                              double pitch,
+                              int samples,
+                              const std::vector<Segment2D>& segments,
+                              double offset_x,
+                              double offset_y,
+                              RasterScratch& scratch)
+{
+  if (samples < 1 || samples > 16)
+    throw std::invalid_argument("coverage samples must be in [1, 16]");
+
+  mask.clear();
+  const int w = mask.width();
+  const int n = samples;
+  auto& acc = scratch.coverage;
+  acc.assign(static_cast<std::size_t>(w), 0);
+  // 255 / n^2 in 16.16 fixed point, rounded.
+  const std::uint32_t scale =
+      ((255u << 16) + static_cast<std::uint32_t>(n * n) / 2)
+      / static_cast<std::uint32_t>(n * n);
+  int row = -1;
+  int lo = w, hi = 0;  // touched pixels [lo, hi) of the current row
+
+  const auto flush = [&]
+  {
+    uint8_t* out = mask.row(row);
+    for (int x = lo; x < hi; ++x)
+      out[x] = static_cast<uint8_t>((acc[x] * scale + 0x8000u) >> 16);
+    std::fill(acc.begin() + lo, acc.begin() + hi, std::uint16_t {0});
+    lo = w;
+    hi = 0;
+  };
+
+  Kernel::spans(w * n,
+                mask.height() * n,
+                pitch / n,
+                segments,
+                offset_x,
+                offset_y,
+                [&](int sy, int a, int b)
+                {
+                  if (sy / n != row) {
+                    if (row >= 0)
+                      flush();
+                    row = sy / n;
+                  }
+                  const int pa = a / n;
+                  const int pb = b / n;
+                  lo = std::min(lo, pa);
+                  hi = std::max(hi, std::min(w, pb + 1));
+                  if (pa == pb) {
+                    acc[pa] += static_cast<std::uint16_t>(b - a);
+                    return;
+                  }
+                  acc[pa] += static_cast<std::uint16_t>(n - a % n);
+                  std::uint16_t* full = acc.data();
+                  for (int x = pa + 1; x < pb; ++x)
+                    full[x] += static_cast<std::uint16_t>(n);
+                  if (pb < w)
+                    acc[pb] += static_cast<std::uint16_t>(b % n);
+                },
+                scratch);
+  if (row >= 0)
+    flush();
+}
+
+inline void rasterizeCoverage(GreyMask& mask,
+                              double pitch,
+                              int samples,
+                              const std::vector<Segment2D>& segments,
+                              double offset_x,
+                              double offset_y)
+{
+  RasterScratch scratch;
+  rasterizeCoverage(mask, pitch, samples, segments, offset_x, offset_y, scratch);
+}
 }  // namespace Slicer
 
 /*
@@ -278,44 +1499,109 @@ inline void rasterizeCenteredSegments(std::vector<uint8_t>& mask,
  ************************************************************************
  */
 
-// Write a monochrome (1-bit) PNG mask: white = expose, black = off.
-inline void writeMonoPNG(const std::filesystem::path& file,
-                         int w,
-                         int h,
-                         const std::vector<uint8_t>& mask)
+// Encodes a monochrome (1-bit greyscale) PNG mask into `out`: white =
+// expose, black = off. `level` selects the encoder: Png::kStore, kRle and
+// kDeflate use the streaming MonoPngWriter, Png::kLodepng uses lodepng.
+inline void encodeMonoPNG(std::vector<uint8_t>& out,
+                          const BitMask& mask,
+                          int level = Png::kRle,
+                          Png::Buffers* buffers = nullptr)
 {
-  if (static_cast<std::size_t>(w) * static_cast<std::size_t>(h) != mask.size())
-    throw std::runtime_error("mask dimension mismatch while writing "
-                             + file.string());
-
-  std::vector<uint8_t> rgba(
-      static_cast<std::size_t>(w) * static_cast<std::size_t>(h) * 4, 0);
+  if (level != Png::kLodepng) {
+    Png::encodeMono(out, mask, level, buffers);
+    return;
+  }
 
-  for (std::size_t i = 0; i < mask.size(); ++i) {
-    const uint8_t v = mask[i] ? 255u : 0u;
-    rgba[i * 4 + 0] = v;
-    rgba[i * 4 + 1] = v;
-    rgba[i * 4 + 2] = v;
-    rgba[i * 4 + 3] = 255u;
+  const unsigned w = static_cast<unsigned>(mask.width());
+  const unsigned h = static_cast<unsigned>(mask.height());
+
+  // lodepng expects sub-byte raw pixels packed without row padding, which
+  // only matches BitMask's layout when the width is a multiple of 8.
+  std::vector<uint8_t> unpadded;
+  const std::vector<uint8_t>* raw = &mask.bytes();
+  if (w % 8 != 0) {
+    unpadded.assign((static_cast<std::size_t>(w) * h + 7) / 8, 0);
+    std::size_t bit = 0;
+    for (unsigned y = 0; y < h; ++y) {
+      for (unsigned x = 0; x < w; ++x, ++bit) {
+        if (mask.get(static_cast<int>(x), static_cast<int>(y)))
+          unpadded[bit >> 3] |= static_cast<uint8_t>(0x80u >> (bit & 7));
+      }
+    }
+    raw = &unpadded;
   }
 
-  const unsigned err = lodepng::encode(file.string(), rgba, w, h);
+  out.clear();
+  const unsigned err = lodepng::encode(out, *raw, w, h, LCT_GREY, 1);
+  if (err)
+    throw std::runtime_error("PNG encode error: "
+                             + std::string(lodepng_error_text(err)));
+}
+
+// Encodes an 8-bit greyscale PNG mask into `out`; levels as for
+// encodeMonoPNG.
+inline void encodeGreyPNG(std::vector<uint8_t>& out,
+                          const GreyMask& mask,
+                          int level = Png::kRle,
+                          Png::Buffers* buffers = nullptr)
+{
+  if (level != Png::kLodepng) {
+    Png::encodeGrey(out, mask, level, buffers);
+    return;
+  }
+  out.clear();
+  const unsigned err = lodepng::encode(out,
+                                       mask.bytes(),
+                                       static_cast<unsigned>(mask.width()),
+                                       static_cast<unsigned>(mask.height()),
+                                       LCT_GREY,
+                                       8);
   if (err)
     throw std::runtime_error("PNG encode error: "
                              + std::string(lodepng_error_text(err)));
 }
 
-// Very small helpers to emit G-code or comments through an output iterator.
-template<typename Out>
-inline void comment(Out& o, const std::string& t)
+// Writes an encoded buffer to `file`, replacing it.
+inline void writeFileBytes(const std::filesystem::path& file,
+                           const std::vector<uint8_t>& bytes)
 {
-  *o++ = "; " + t;
+  std::ofstream f(file, std::ios::binary);
+  f.write(reinterpret_cast<const char*>(bytes.data()),
+          static_cast<std::streamsize>(bytes.size()));
+  if (!f)
+    throw std::runtime_error("cannot write " + file.string());
 }
 
-template<typename Out>
-inline void cmd(Out& o, const std::string& g)
+// Write a monochrome (1-bit greyscale) PNG mask: white = expose, black = off.
+inline void writeMonoPNG(const std::filesystem::path& file,
+                         const BitMask& mask,
+                         int level = Png::kRle)
 {
-  *o++ = g;
+  std::vector<uint8_t> png;
+  encodeMonoPNG(png, mask, level);
+  writeFileBytes(file, png);
+}
+
+// Byte-per-pixel overload; any non-zero value is exposed.
+inline void writeMonoPNG(const std::filesystem::path& file,
+                         int w,
+                         int h,
+                         const std::vector<uint8_t>& mask,
+                         int level = Png::kRle)
+{
+  if (static_cast<std::size_t>(w) * static_cast<std::size_t>(h) != mask.size())
+    throw std::runtime_error("mask dimension mismatch while writing "
+                             + file.string());
+
+  BitMask bits(w, h);
+  for (int y = 0; y < h; ++y) {
+    const uint8_t* src = mask.data() + static_cast<std::size_t>(y) * w;
+    for (int x = 0; x < w; ++x) {
+      if (src[x])
+        bits.set(x, y);
+    }
+  }
+  writeMonoPNG(file, bits, level);
 }
 
 // --- Auto-scaling and centering helper ---
@@ -348,137 +1634,790 @@ inline double calculateScaleFactor(const Cfg& cfg,
 
 /*
  ************************************************************************
- * LCD / MSLA specialization
+ * Raster layer engine policies
  ************************************************************************
  */
 
-template<IsLCD Cfg, typename Out>
-void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
+// The LCD and DLP printers share one layer engine (generateMaskGCode) that is
+// instantiated with compile-time policies:
+//
+//   pitch policy   pixel pitch and auto-scaling of a printer config, plus the
+//                  names used in errors and the G-code header;
+//   mask format    mask type, how a layer is rasterized into it and how it is
+//                  encoded as a PNG;
+//   span kernel    the scan converter the format rasterizes with
+//                  (Slicer::ScanlineKernel by default);
+//   G-code sink    where the emitter's text goes.
+//
+// Formats and kernels carry a fixed kName that identifies them in layer
+// cache entries, which outlive the build that wrote them.
+//
+// Each combination gets its own copy of the per-layer loops with the policy
+// calls inlined, so choosing a policy costs nothing per layer.
+namespace Raster
 {
-  if (cfg.cols <= 0 || cfg.rows <= 0)
-    throw std::invalid_argument("LCDConfig.cols/rows must be positive");
 
-  if (cfg.layer_height <= 0)
-    throw std::invalid_argument("LCDConfig.layer_height must be positive");
+template<typename P>
+concept PitchPolicy = requires {
+  { P::kConfig } -> std::convertible_to<std::string_view>;
+  { P::kTitle } -> std::convertible_to<std::string_view>;
+};
 
-  Bounds3D initial_bb;
-  auto triangles = Slicer::readStl(stl, initial_bb);
+template<typename K>
+concept SpanKernel = requires(const std::vector<Slicer::Segment2D>& segments,
+                              void (*fill)(int, int, int),
+                              Slicer::RasterScratch& scratch) {
+  { K::kName } -> std::convertible_to<std::string_view>;
+  K::spans(1, 1, 1.0, segments, 0.0, 0.0, fill, scratch);
+};
 
-  const double pitch = 2.0 * cfg.led_radius;
+template<typename F>
+concept MaskFormat = requires(std::vector<uint8_t>& out,
+                              const typename F::Mask& mask,
+                              Png::Buffers* buffers) {
+  { F::kName } -> std::convertible_to<std::string_view>;
+  { F::kDepth } -> std::convertible_to<std::uint32_t>;
+  F::encodePng(out, mask, 1, buffers);
+};
 
-  double build_w, build_h;
-  double scale_factor = cfg.autoscale
-                            ? calculateScaleFactor(cfg, initial_bb, pitch, build_w, build_h)
-                            : (build_w = cfg.cols * pitch, build_h = cfg.rows * pitch, 1.0);
+// LCD: one pixel per LED, so the pitch is the LED diameter. Auto-scaling
+// follows cfg.autoscale.
+struct LedPitch
+{
+  static constexpr std::string_view kConfig = "LCDConfig";
+  static constexpr std::string_view kTitle = "**** MSLA Print ****";
 
-  Bounds3D scaled_bb = initial_bb;
-  if (std::abs(scale_factor - 1.0) > 1e-9) {
-    Slicer::Vec3 center = {
-        initial_bb.min_x + (initial_bb.max_x - initial_bb.min_x) / 2.0,
-        initial_bb.min_y + (initial_bb.max_y - initial_bb.min_y) / 2.0,
-        initial_bb.min_z};
-    const double maxD = std::numeric_limits<double>::max();
-    const double minD = std::numeric_limits<double>::lowest();
-    scaled_bb = {maxD, maxD, maxD, minD, minD, minD};
+  template<typename Cfg>
+  static double pitch(const Cfg& cfg)
+  {
+    return 2.0 * cfg.led_radius;
+  }
+
+  template<typename Cfg>
+  static bool autoscale(const Cfg& cfg)
+  {
+    return cfg.autoscale;
+  }
+
+  template<typename Cfg>
+  static void validate(const Cfg&)
+  {
+  }
+};
+
+// DLP: explicit pixel pitch; models are always scaled to the build area.
+struct PixelPitch
+{
+  static constexpr std::string_view kConfig = "DLPConfig";
+  static constexpr std::string_view kTitle = "**** DLP/MSLA Print ****";
+
+  template<typename Cfg>
+  static double pitch(const Cfg& cfg)
+  {
+    return cfg.pixel_pitch_mm;
+  }
+
+  template<typename Cfg>
+  static bool autoscale(const Cfg&)
+  {
+    return true;
+  }
+
+  template<typename Cfg>
+  static void validate(const Cfg& cfg)
+  {
+    if (cfg.pixel_pitch_mm <= 0.0)
+      throw std::invalid_argument("DLPConfig.pixel_pitch_mm must be positive");
+  }
+};
+
+// Bit-packed binary masks stored as 1-bit PNGs.
+struct BitPacked
+{
+  static constexpr std::string_view kName = "bitpacked";
+  using Mask = BitMask;
+  static constexpr std::uint32_t kDepth = 1;
+
+  template<typename Kernel>
+  static void render(Mask& mask,
+                     int w,
+                     int h,
+                     double pitch,
+                     int /*samples*/,
+                     const std::vector<Slicer::Segment2D>& segments,
+                     double offset_x,
+                     double offset_y,
+                     Slicer::RasterScratch& scratch)
+  {
+    mask.resize(w, h);
+    Kernel::spans(
+        w,
+        h,
+        pitch,
+        segments,
+        offset_x,
+        offset_y,
+        [&mask](int py, int x0, int x1) { mask.setSpan(py, x0, x1); },
+        scratch);
+  }
+
+  static void encodePng(std::vector<uint8_t>& out,
+                        const Mask& mask,
+                        int level,
+                        Png::Buffers* buffers)
+  {
+    encodeMonoPNG(out, mask, level, buffers);
+  }
+};
+
+// Binary masks with a byte per pixel (0 or 255), stored as 8-bit PNGs for
+// printers that only take 8-bit greyscale layers.
+struct Bytes
+{
+  static constexpr std::string_view kName = "bytes";
+  using Mask = GreyMask;
+  static constexpr std::uint32_t kDepth = 8;
+
+  template<typename Kernel>
+  static void render(Mask& mask,
+                     int w,
+                     int h,
+                     double pitch,
+                     int /*samples*/,
+                     const std::vector<Slicer::Segment2D>& segments,
+                     double offset_x,
+                     double offset_y,
+                     Slicer::RasterScratch& scratch)
+  {
+    mask.resize(w, h);
+    Kernel::spans(
+        w,
+        h,
+        pitch,
+        segments,
+        offset_x,
+        offset_y,
+        [&mask](int py, int x0, int x1)
+        { std::memset(mask.row(py) + x0, 0xFF, static_cast<std::size_t>(x1 - x0)); },
+        scratch);
+  }
+
+  static void encodePng(std::vector<uint8_t>& out,
+                        const Mask& mask,
+                        int level,
+                        Png::Buffers* buffers)
+  {
+    encodeGreyPNG(out, mask, level, buffers);
+  }
+};
+
+// Anti-aliased masks holding the area coverage from samples x samples
+// sub-pixels, stored as 8-bit PNGs.
+struct Greyscale
+{
+  static constexpr std::string_view kName = "greyscale";
+  using Mask = GreyMask;
+  static constexpr std::uint32_t kDepth = 8;
+
+  template<typename Kernel>
+  static void render(Mask& mask,
+                     int w,
+                     int h,
+                     double pitch,
+                     int samples,
+                     const std::vector<Slicer::Segment2D>& segments,
+                     double offset_x,
+                     double offset_y,
+                     Slicer::RasterScratch& scratch)
+  {
+    mask.resize(w, h);
+    Slicer::rasterizeCoverage<Kernel>(
+        mask, pitch, samples, segments, offset_x, offset_y, scratch);
+  }
+
+  static void encodePng(std::vector<uint8_t>& out,
+                        const Mask& mask,
+                        int level,
+                        Png::Buffers* buffers)
+  {
+    encodeGreyPNG(out, mask, level, buffers);
+  }
+};
+
+}  // namespace Raster
+
+// Open-addressing table from a mask hash to the id of the stored mask (its
+// layer index for PNG files, its archive index otherwise). Sized once for the
+// whole job, so lookups and inserts never allocate.
+class MaskTable
+{
+public:
+  explicit MaskTable(std::size_t capacity)
+  {
+    std::size_t n = 16;
+    while (n < 2 * capacity)
+      n *= 2;
+    slots_.resize(n);
+  }
+
+  // Returns the id stored for h, or -1.
+  int find(const MaskHash& h) const
+  {
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = h.lo & mask;; i = (i + 1) & mask) {
+      if (slots_[i].id < 0)
+        return -1;
+      if (slots_[i].hash == h)
+        return slots_[i].id;
+    }
+  }
+
+  void insert(const MaskHash& h, int id)
+  {
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t i = h.lo & mask;
+    while (slots_[i].id >= 0)
+      i = (i + 1) & mask;
+    slots_[i] = {h, id};
+  }
+
+private:
+  struct Slot
+  {
+    MaskHash hash;
+    int id = -1;
+  };
+  std::vector<Slot> slots_;
+};
+
+// Everything one layer is sliced, rasterized and encoded into. Workspaces are
+// recycled from layer to layer, so once their buffers have grown to the
+// largest layer the mask pipeline stops allocating.
+template<typename Mask>
+struct LayerWorkspace
+{
+  std::vector<Slicer::Segment2D> segments;
+  Slicer::RasterScratch raster;
+  Mask mask;
+  Png::Buffers png;
+  MaskHash hash;
+  bool encoded = false;  // `bytes` holds this layer's PNG or archive payload
+  std::vector<uint8_t> bytes;
+};
+
+// File name of the PNG mask of layer `idx` (counted from 0) in cfg.png_dir.
+template<typename Cfg>
+std::filesystem::path maskPngPath(const Cfg& cfg, int idx)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "layer%04d.png", idx + 1);
+  return cfg.png_dir / name;
+}
+
+// The per-layer G-code of mask jobs. emitMaskLayers and emitCachedLayers
+// both go through these, so a replayed plan is identical to a fresh run.
+
+// Moves the build plate to layer l.
+template<typename Cfg, GCodeSink Sink>
+void emitLayerMove(GCodeEmitter<Sink>& gcode,
+                   const Cfg& cfg,
+                   double base_z,
+                   int l)
+{
+  gcode.text("G1")
+      .fixed('Z', base_z + (l + 1) * cfg.layer_height)
+      .general('F', cfg.layer_feed)
+      .end();
+}
+
+// Exposes stored mask `id`: an archive layer index or, for PNG masks, the
+// layer whose file holds it.
+template<typename Cfg, GCodeSink Sink>
+void emitLayerExposure(GCodeEmitter<Sink>& gcode, const Cfg& cfg, int id)
+{
+  if (!cfg.archive_path.empty())
+    gcode.text("M701").integer('L', id);
+  else
+    gcode.text("M701 P\"layer").digits(id + 1, 4).text(".png\"");
+  gcode.general('S', cfg.exposure_s).integer('I', cfg.intensity_pct).end();
+}
+
+template<GCodeSink Sink>
+void emitEmptyLayer(GCodeEmitter<Sink>& gcode, int l)
+{
+  gcode.text("; Layer ").digits(l + 1).text(" is empty, skipping.").end();
+}
+
+template<GCodeSink Sink>
+void emitDedupSummary(GCodeEmitter<Sink>& gcode,
+                      int stored,
+                      int exposed,
+                      int skipped_raster)
+{
+  std::ostringstream s;
+  s << "Layer masks: " << stored << " stored for " << exposed << " layers, "
+    << (exposed - stored) << " reused (" << skipped_raster
+    << " without rasterizing), dedup ratio " << std::fixed
+    << std::setprecision(2) << static_cast<double>(exposed) / stored;
+  gcode.comment(s.str());
+}
+
+// Slices every layer, rasterizes its mask in the given Format with the given
+// Kernel, stores it as a PNG in cfg.png_dir (or in the single layer archive
+// cfg.archive_path when set) and emits the matching G-code. With
+// cfg.workers != 1, masks are rasterized and encoded on a ThreadPool while
+// the calling thread slices, stores masks and emits G-code in strict layer
+// order, so the output is identical to the serial loop. At most
+// cfg.max_inflight_layers layers (default: twice the worker count) are held
+// in memory at once.
+//
+// With cfg.dedup_layers, a layer whose mask was already stored reuses that
+// PNG file or archive entry in its M701 command. Masks are matched by a
+// 128-bit content hash; a layer the slicer reports as an extrusion of the
+// previous one (SweepSlicer::repeatsPrevious) is not even rasterized. The
+// stored and reused masks are counted in the MasksStored and MasksReused
+// instrumentation counters; cfg.dedup_summary also notes them in a comment.
+//
+// Layers are built in recycled LayerWorkspaces and G-code goes through the
+// emitter's buffer. Writing to an archive with the default PNG/archive
+// encodings, the serial loop therefore performs no heap allocation per layer
+// once the buffers have reached their high-water mark, apart from what the
+// sink itself does with the text. Opening PNG files, the deflate level and the
+// thread pool's task bookkeeping still allocate.
+//
+// When `plan` is given, the mask id of every layer and the dedup statistics
+// are recorded in it for the layer cache.
+template<Raster::MaskFormat Format,
+         Raster::SpanKernel Kernel,
+         typename Cfg,
+         GCodeSink Sink>
+void emitMaskLayers(GCodeEmitter<Sink>& gcode,
+                    Slicer::SweepSlicer& slicer,
+                    const Cfg& cfg,
+                    double pitch,
+                    double base_z,
+                    int total_layers,
+                    double offset_x,
+                    double offset_y,
+                    LayerCache::Plan* plan = nullptr)
+{
+  using Workspace = LayerWorkspace<typename Format::Mask>;
+
+  std::unique_ptr<LayerArchive::Writer> archive;
+  if (!cfg.archive_path.empty()) {
+    archive = std::make_unique<LayerArchive::Writer>(
+        cfg.archive_path,
+        cfg.cols,
+        cfg.rows,
+        static_cast<std::uint32_t>(cfg.archive_encoding),
+        Format::kDepth);
+    archive->reserve(static_cast<std::size_t>(std::max(total_layers, 0)));
+  }
+
+  // Stored masks by content hash. Only the calling thread inserts, in layer
+  // order; workers look up under the lock to skip encoding known masks.
+  const bool dedup = cfg.dedup_layers;
+  MaskTable stored(dedup ? static_cast<std::size_t>(std::max(total_layers, 0))
+                         : 0);
+  std::mutex stored_m;
+  const auto is_stored = [&](const MaskHash& h)
+  {
+    std::lock_guard<std::mutex> lk(stored_m);
+    return stored.find(h) >= 0;
+  };
+
+  // Hashes a rasterized mask and, unless it is already stored, encodes it
+  // into ws.bytes.
+  const bool to_archive = archive != nullptr;
+  const auto encode =
+      [&cfg, &is_stored, to_archive, dedup](Workspace& ws,
+                                            [[maybe_unused]] int l)
+  {
+    STRATUM_LAYER_SPAN(span, "encode", l);
+    ws.encoded = false;
+    if (dedup) {
+      ws.hash = ws.mask.hash();
+      if (is_stored(ws.hash))
+        return;
+    }
+    if (to_archive) {
+      LayerArchive::encode(
+          ws.mask, static_cast<std::uint32_t>(cfg.archive_encoding), ws.bytes);
+    } else {
+      Format::encodePng(ws.bytes, ws.mask, cfg.png_level, &ws.png);
+    }
+    ws.encoded = true;
+    STRATUM_COUNT(BytesEncoded, ws.bytes.size());
+  };
+  const auto render =
+      [&cfg, &encode, pitch, offset_x, offset_y](Workspace& ws, int l)
+  {
+    STRATUM_LAYER_SPAN(span, "rasterize", l);
+    Format::template render<Kernel>(ws.mask,
+                                    cfg.cols,
+                                    cfg.rows,
+                                    pitch,
+                                    cfg.antialias,
+                                    ws.segments,
+                                    offset_x,
+                                    offset_y,
+                                    ws.raster);
+    STRATUM_COUNT(PixelsSet, ws.mask.count());
+    STRATUM_SPAN_END(span);
+    encode(ws, l);
+  };
+
+  int stored_count = 0, skipped_raster = 0, exposed = 0;
+  int previous = -1;  // mask id of the last exposed layer
+  if (plan) {
+    plan->base_z = base_z;
+    plan->layers.assign(static_cast<std::size_t>(std::max(total_layers, 0)), -1);
+  }
+
+  const auto emit_move = [&](int l) { emitLayerMove(gcode, cfg, base_z, l); };
+
+  // Emits the exposure of layer l, first storing its mask unless an equal
+  // one was stored before; `ws` is null for a repeat of the previous layer.
+  // Archive layers are referenced by their index, PNG layers by file name.
+  const auto emit_expose = [&](int l, const Workspace* ws)
+  {
+    STRATUM_LAYER_SPAN(span, "emit", l);
+    if (ws) {
+      int id = dedup ? stored.find(ws->hash) : -1;
+      if (id < 0) {
+        if (!ws->encoded)
+          throw std::logic_error("stored layer mask not found");
+        if (archive) {
+          id = static_cast<int>(archive->addEncoded(ws->bytes));
+        } else {
+          writeFileBytes(maskPngPath(cfg, l), ws->bytes);
+          id = l;
+        }
+        ++stored_count;
+        if (dedup) {
+          std::lock_guard<std::mutex> lk(stored_m);
+          stored.insert(ws->hash, id);
+        }
+      }
+      previous = id;
+    } else {
+      ++skipped_raster;
+    }
+    ++exposed;
+    if (plan)
+      plan->layers[static_cast<std::size_t>(l)] = previous;
+    emitLayerExposure(gcode, cfg, previous);
+  };
+
+  const auto emit_empty = [&](int l) { emitEmptyLayer(gcode, l); };
+
+  const auto finish = [&]
+  {
+    if (archive)
+      archive->close();
+    STRATUM_COUNT(MasksStored, stored_count);
+    STRATUM_COUNT(MasksReused, exposed - stored_count);
+    if (dedup && cfg.dedup_summary && exposed > 0)
+      emitDedupSummary(gcode, stored_count, exposed, skipped_raster);
+    if (plan) {
+      plan->stored = static_cast<std::uint32_t>(stored_count);
+      plan->skipped = static_cast<std::uint32_t>(skipped_raster);
+    }
+  };
 
-    for (auto& tri : triangles) {
-      for (auto* v : {&tri.v1, &tri.v2, &tri.v3}) {
-        v->x = center.x + (v->x - center.x) * scale_factor;
-        v->y = center.y + (v->y - center.y) * scale_factor;
+  const unsigned workers = cfg.workers == 0
+      ? std::max(1u, std::thread::hardware_concurrency())
+      : static_cast<unsigned>(cfg.workers);
 
-        scaled_bb.min_x = std::min(scaled_bb.min_x, v->x);
-        scaled_bb.min_y = std::min(scaled_bb.min_y, v->y);
-        scaled_bb.min_z = std::min(scaled_bb.min_z, v->z);
-        scaled_bb.max_x = std::max(scaled_bb.max_x, v->x);
-        scaled_bb.max_y = std::max(scaled_bb.max_y, v->y);
-        scaled_bb.max_z = std::max(scaled_bb.max_z, v->z);
+  if (workers == 1) {
+    Workspace ws;
+    for (int l = 0; l < total_layers; ++l) {
+      const double z_mm = base_z + (l + 0.5) * cfg.layer_height;
+
+      STRATUM_LAYER_SPAN(slice_span, "slice", l);
+      slicer.slice(z_mm, ws.segments);
+      STRATUM_SPAN_END(slice_span);
+      if (ws.segments.empty()) {
+        emit_empty(l);
+        continue;
+      }
+
+      emit_move(l);
+      if (dedup && slicer.repeatsPrevious()) {
+        emit_expose(l, nullptr);
+      } else {
+        render(ws, l);
+        emit_expose(l, &ws);
       }
     }
+    finish();
+    return;
   }
 
-  const int total_layers = static_cast<int>(
-      std::ceil((scaled_bb.max_z - scaled_bb.min_z) / cfg.layer_height));
-  const double offset_x = (build_w - (scaled_bb.max_x - scaled_bb.min_x)) / 2.0 - scaled_bb.min_x;
-  const double offset_y = (build_h - (scaled_bb.max_y - scaled_bb.min_y)) / 2.0 - scaled_bb.min_y;
-
-  std::filesystem::create_directories(cfg.png_dir);
+  // Layers in flight, oldest first, each in its own workspace. Empty layers
+  // and layers repeating the previous one carry no future.
+  struct InFlight
+  {
+    int layer;
+    std::unique_ptr<Workspace> ws;
+    std::future<void> done;
+  };
+  const std::size_t cap = cfg.max_inflight_layers > 0
+      ? static_cast<std::size_t>(cfg.max_inflight_layers)
+      : std::size_t {2} * workers;
+  std::deque<InFlight> window;
+  std::vector<std::unique_ptr<Workspace>> spare;
 
-  // Header
-  comment(out, "**** MSLA Print ****");
-  cmd(out, "G28");
-  cmd(out, "G90");
+  const auto retire = [&](InFlight& job)
+  {
+    if (job.ws->segments.empty()) {
+      emit_empty(job.layer);
+    } else {
+      emit_move(job.layer);
+      if (job.done.valid()) {
+        job.done.get();  // rethrows in layer order
+        emit_expose(job.layer, job.ws.get());
+      } else {
+        emit_expose(job.layer, nullptr);
+      }
+    }
+    spare.push_back(std::move(job.ws));
+  };
 
-  const auto layer_png = [&](int idx) -> std::filesystem::path
+  const auto ready = [](const InFlight& job)
   {
-    std::ostringstream n;
-    n << "layer" << std::setw(4) << std::setfill('0') << (idx + 1) << ".png";
-    return cfg.png_dir / n.str();
+    return !job.done.valid()
+        || job.done.wait_for(std::chrono::seconds(0))
+        == std::future_status::ready;
   };
 
-  // Layer loop
+  // Declared last so queued tasks finish before anything they reference.
+  ThreadPool pool(workers);
+
   for (int l = 0; l < total_layers; ++l) {
-    const double z_mm = scaled_bb.min_z + (l + 0.5) * cfg.layer_height;
+    const double z_mm = base_z + (l + 0.5) * cfg.layer_height;
 
-    const auto segments = Slicer::sliceTriangles(triangles, z_mm);
-    if (segments.empty()) {
-      comment(out, "Layer " + std::to_string(l + 1) + " is empty, skipping.");
-      continue;
+    InFlight job {l, nullptr, {}};
+    if (spare.empty()) {
+      job.ws = std::make_unique<Workspace>();
+    } else {
+      job.ws = std::move(spare.back());
+      spare.pop_back();
+    }
+    STRATUM_LAYER_SPAN(slice_span, "slice", l);
+    slicer.slice(z_mm, job.ws->segments);
+    STRATUM_SPAN_END(slice_span);
+    if (!job.ws->segments.empty() && !(dedup && slicer.repeatsPrevious())) {
+      job.done = pool.submit([&render, ws = job.ws.get(), l] { render(*ws, l); });
     }
+    window.push_back(std::move(job));
 
-    std::ostringstream s_g1;
-    s_g1 << "G1 Z" << std::fixed << std::setprecision(4)
-         << (scaled_bb.min_z + (l + 1) * cfg.layer_height) << " F50";
-    cmd(out, s_g1.str());
+    while (!window.empty() && (window.size() > cap || ready(window.front()))) {
+      retire(window.front());
+      window.pop_front();
+    }
+  }
+  while (!window.empty()) {
+    retire(window.front());
+    window.pop_front();
+  }
+  finish();
+}
 
-    std::vector<uint8_t> mask(static_cast<size_t>(cfg.cols) * cfg.rows, 0);
-    Slicer::rasterizeCenteredSegments(
-        mask, cfg.cols, cfg.rows, pitch, segments, offset_x, offset_y);
+// Creates the directory that receives the layer masks.
+template<typename Cfg>
+inline void prepareMaskOutput(const Cfg& cfg)
+{
+  if (cfg.archive_path.empty()) {
+    std::filesystem::create_directories(cfg.png_dir);
+  } else if (cfg.archive_path.has_parent_path()) {
+    std::filesystem::create_directories(cfg.archive_path.parent_path());
+  }
+}
 
-    const auto png_path = layer_png(l);
-    writeMonoPNG(png_path, cfg.cols, cfg.rows, mask);
+// Trailing comment naming where the layer masks were stored.
+template<typename Cfg>
+inline std::string maskOutputNote(const Cfg& cfg)
+{
+  if (cfg.archive_path.empty())
+    return "PNG layers stored in " + cfg.png_dir.string();
+  return "Layer archive stored in " + cfg.archive_path.string();
+}
 
-    std::ostringstream s_m701;
-    s_m701 << "M701 P\"" << png_path.filename().string() << "\" S"
-           << cfg.exposure_s << " I" << cfg.intensity_pct;
-    cmd(out, s_m701.str());
+// Emits the layers of a cached plan as emitMaskLayers did when it recorded
+// the plan, with the current exposure and feed settings.
+template<typename Cfg, GCodeSink Sink>
+void emitCachedLayers(GCodeEmitter<Sink>& gcode,
+                      const Cfg& cfg,
+                      const LayerCache::Plan& plan)
+{
+  int exposed = 0;
+  for (std::size_t l = 0; l < plan.layers.size(); ++l) {
+    const int layer = static_cast<int>(l);
+    if (plan.layers[l] < 0) {
+      emitEmptyLayer(gcode, layer);
+      continue;
+    }
+    emitLayerMove(gcode, cfg, plan.base_z, layer);
+    emitLayerExposure(gcode, cfg, plan.layers[l]);
+    ++exposed;
   }
+  if (cfg.dedup_layers && cfg.dedup_summary && exposed > 0) {
+    emitDedupSummary(gcode,
+                     static_cast<int>(plan.stored),
+                     exposed,
+                     static_cast<int>(plan.skipped));
+  }
+}
 
-  // End / post-lift
+// End of a mask job: the post-print lift and the trailing commands.
+template<typename Cfg, GCodeSink Sink>
+void emitMaskFooter(GCodeEmitter<Sink>& gcode, const Cfg& cfg, double final_z)
+{
   if (cfg.final_lift_mm > 1e-9) {
-    const double final_z = scaled_bb.min_z + total_layers * cfg.layer_height;
-    std::ostringstream s_lift;
-    s_lift << "G1 Z" << (final_z + cfg.final_lift_mm) << " F100";
-    cmd(out, s_lift.str());
+    gcode.text("G1")
+        .general('Z', final_z + cfg.final_lift_mm)
+        .general('F', cfg.lift_feed)
+        .end();
   }
-  cmd(out, "M702");
-  cmd(out, "M84");
-  cmd(out, "M30");
-  comment(out, "PNG layers stored in " + cfg.png_dir.string());
+  gcode.line("M702");
+  gcode.line("M84");
+  gcode.line("M30");
+  gcode.comment(maskOutputNote(cfg));
 }
 
+// Size and modification time of the mask files `plan` refers to: the layer
+// archive, or each distinct PNG in id order. False if one is missing.
+template<typename Cfg>
+bool maskOutputs(const Cfg& cfg,
+                 const LayerCache::Plan& plan,
+                 std::vector<LayerCache::Output>& out)
+{
+  out.clear();
+  LayerCache::Output o;
+  if (!cfg.archive_path.empty()) {
+    if (!LayerCache::statOutput(cfg.archive_path, o))
+      return false;
+    out.push_back(o);
+    return true;
+  }
+  std::vector<std::int32_t> ids;
+  for (std::int32_t id : plan.layers)
+    if (id >= 0)
+      ids.push_back(id);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  for (std::int32_t id : ids) {
+    if (!LayerCache::statOutput(maskPngPath(cfg, id), o))
+      return false;
+    out.push_back(o);
+  }
+  return true;
+}
+
+// Layer cache key of a mask job: the STL contents and every setting that
+// changes the masks, their numbering or where they are stored. Exposure,
+// intensity, feeds, the final lift and the worker count are left out, so
+// changing only those reuses the cached layers.
+template<Raster::PitchPolicy Pitch,
+         Raster::MaskFormat Format,
+         Raster::SpanKernel Kernel,
+         typename Cfg>
+LayerCache::Key maskCacheKey(const std::filesystem::path& stl, const Cfg& cfg)
+{
+  LayerCache::Key key(LayerCache::meshHash(cfg.layer_cache_dir, stl));
+  key.add(Pitch::kConfig)
+      .add(Format::kName)
+      .add(Kernel::kName)
+      .add(static_cast<std::uint64_t>(cfg.cols))
+      .add(static_cast<std::uint64_t>(cfg.rows))
+      .add(Pitch::pitch(cfg))
+      .add(static_cast<std::uint64_t>(Pitch::autoscale(cfg)))
+      .add(cfg.padding_percentage)
+      .add(cfg.layer_height)
+      .add(static_cast<std::uint64_t>(cfg.antialias))
+      .add(static_cast<std::uint64_t>(cfg.dedup_layers))
+      .add(cfg.png_dir.string())
+      .add(static_cast<std::uint64_t>(cfg.png_level))
+      .add(cfg.archive_path.string())
+      .add(static_cast<std::uint64_t>(cfg.archive_encoding));
+  return key;
+}
+
+/*
+ ************************************************************************
+ * Raster layer engine (LCD / MSLA and DLP)
+ ************************************************************************
+ */
+
+// Scales and centres the model in the cols x rows pixel area, slices it
+// layer by layer and emits mask-projection G-code, with the pixel pitch,
+// mask format, span kernel and sink fixed at compile time. The LCD and DLP
+// generateGCode overloads pick the format from cfg.antialias and forward
+// here; call it directly for another combination, e.g.
 //
-// DLP / MSLA (projector) specialization using explicit pixel pitch
-//
-template<IsDLP Cfg, typename Out>
-void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
+//   generateMaskGCode<Raster::PixelPitch, Raster::Bytes>(stl, dlp, gcode);
+template<Raster::PitchPolicy Pitch,
+         Raster::MaskFormat Format,
+         Raster::SpanKernel Kernel = Slicer::ScanlineKernel,
+         typename Cfg,
+         GCodeSink Sink>
+void generateMaskGCode(const std::filesystem::path& stl,
+                       const Cfg& cfg,
+                       GCodeEmitter<Sink>& gcode)
 {
+  const std::string name(Pitch::kConfig);
   if (cfg.cols <= 0 || cfg.rows <= 0)
-    throw std::invalid_argument("DLPConfig.cols/rows must be positive");
+    throw std::invalid_argument(name + ".cols/rows must be positive");
 
   if (cfg.layer_height <= 0)
-    throw std::invalid_argument("DLPConfig.layer_height must be positive");
-
-  if (cfg.pixel_pitch_mm <= 0.0)
-    throw std::invalid_argument("DLPConfig.pixel_pitch_mm must be positive");
+    throw std::invalid_argument(name + ".layer_height must be positive");
+
+  if (cfg.workers < 0)
+    throw std::invalid_argument(name + ".workers must not be negative");
+
+  if (cfg.antialias < 1 || cfg.antialias > 16)
+    throw std::invalid_argument(name + ".antialias must be in [1, 16]");
+
+  Pitch::validate(cfg);
+
+  // A cached plan whose masks are still in place only needs its G-code
+  // written again; nothing is sliced, rasterized or stored. Meshes read
+  // from a pipe can only be read once, so they are never cached.
+  std::unique_ptr<LayerCache::Key> key;
+  std::filesystem::path cache_entry;
+  LayerCache::Plan plan;
+  std::error_code stl_ec;
+  if (!cfg.layer_cache_dir.empty()
+      && std::filesystem::is_regular_file(stl, stl_ec)) {
+    key = std::make_unique<LayerCache::Key>(
+        maskCacheKey<Pitch, Format, Kernel>(stl, cfg));
+    cache_entry = LayerCache::entryPath(cfg.layer_cache_dir, *key);
+    std::vector<LayerCache::Output> outputs;
+    if (LayerCache::load(cache_entry, *key, plan)
+        && maskOutputs(cfg, plan, outputs) && outputs == plan.outputs) {
+      gcode.comment(Pitch::kTitle);
+      gcode.line("G28");
+      gcode.line("G90");
+      emitCachedLayers(gcode, cfg, plan);
+      emitMaskFooter(gcode,
+                     cfg,
+                     plan.base_z
+                         + static_cast<double>(plan.layers.size())
+                             * cfg.layer_height);
+      return;
+    }
+  }
 
   Bounds3D initial_bb;
   auto triangles = Slicer::readStl(stl, initial_bb);
 
-  const double pitch = cfg.pixel_pitch_mm;
+  const double pitch = Pitch::pitch(cfg);
 
   double build_w, build_h;
-  double scale_factor =
-      calculateScaleFactor(cfg, initial_bb, pitch, build_w, build_h);
+  double scale_factor = Pitch::autoscale(cfg)
+                            ? calculateScaleFactor(cfg, initial_bb, pitch, build_w, build_h)
+                            : (build_w = cfg.cols * pitch, build_h = cfg.rows * pitch, 1.0);
 
   Bounds3D scaled_bb = initial_bb;
   if (std::abs(scale_factor - 1.0) > 1e-9) {
@@ -512,57 +2451,60 @@ void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
   const double offset_y =
       (build_h - (scaled_bb.max_y - scaled_bb.min_y)) / 2.0 - scaled_bb.min_y;
 
-  std::filesystem::create_directories(cfg.png_dir);
+  prepareMaskOutput(cfg);
+  Slicer::SweepSlicer slicer(triangles);
 
   // Header
-  comment(out, "**** DLP/MSLA Print ****");
-  cmd(out, "G28");
-  cmd(out, "G90");
-
-  const auto layer_png = [&](int idx) -> std::filesystem::path
-  {
-    std::ostringstream n;
-    n << "layer" << std::setw(4) << std::setfill('0') << (idx + 1) << ".png";
-    return cfg.png_dir / n.str();
-  };
-
-  for (int l = 0; l < total_layers; ++l) {
-    const double z_mm = scaled_bb.min_z + (l + 0.5) * cfg.layer_height;
-
-    const auto segments = Slicer::sliceTriangles(triangles, z_mm);
-    if (segments.empty()) {
-      comment(out, "Layer " + std::to_string(l + 1) + " is empty, skipping.");
-      continue;
-    }
-
-    std::ostringstream s_g1;
-    s_g1 << "G1 Z" << std::fixed << std::setprecision(4)
-         << (scaled_bb.min_z + (l + 1) * cfg.layer_height) << " F50";
-    cmd(out, s_g1.str());
-
-    std::vector<uint8_t> mask(static_cast<size_t>(cfg.cols) * cfg.rows, 0);
-    Slicer::rasterizeCenteredSegments(
-        mask, cfg.cols, cfg.rows, pitch, segments, offset_x, offset_y);
+  gcode.comment(Pitch::kTitle);
+  gcode.line("G28");
+  gcode.line("G90");
+
+  emitMaskLayers<Format, Kernel>(gcode,
+                                 slicer,
+                                 cfg,
+                                 pitch,
+                                 scaled_bb.min_z,
+                                 total_layers,
+                                 offset_x,
+                                 offset_y,
+                                 key ? &plan : nullptr);
+
+  emitMaskFooter(gcode, cfg, scaled_bb.min_z + total_layers * cfg.layer_height);
+
+  if (key && maskOutputs(cfg, plan, plan.outputs))
+    LayerCache::save(cache_entry, *key, plan);
+}
 
-    const auto png_path = layer_png(l);
-    writeMonoPNG(png_path, cfg.cols, cfg.rows, mask);
+// Binary masks are bit-packed; anti-aliased ones carry 8-bit coverage.
+template<Raster::PitchPolicy Pitch, typename Cfg, GCodeSink Sink>
+void generateMaskGCode(const std::filesystem::path& stl,
+                       const Cfg& cfg,
+                       GCodeEmitter<Sink>& gcode)
+{
+  STRATUM_SPAN(span, "generate");
+  if (cfg.antialias > 1)
+    generateMaskGCode<Pitch, Raster::Greyscale>(stl, cfg, gcode);
+  else
+    generateMaskGCode<Pitch, Raster::BitPacked>(stl, cfg, gcode);
+}
 
-    std::ostringstream s_m701;
-    s_m701 << "M701 P\"" << png_path.filename().string() << "\" S"
-           << cfg.exposure_s << " I" << cfg.intensity_pct;
-    cmd(out, s_m701.str());
-  }
+template<IsLCD Cfg, GCodeSink Sink>
+void generateGCode(const std::filesystem::path& stl,
+                   const Cfg& cfg,
+                   GCodeEmitter<Sink>& gcode)
+{
+  generateMaskGCode<Raster::LedPitch>(stl, cfg, gcode);
+}
 
-  if (cfg.final_lift_mm > 1e-9) {
-    const double final_z = scaled_bb.min_z + total_layers * cfg.layer_height;
-    std::ostringstream s_lift;
-    s_lift << "G1 Z" << (final_z + cfg.final_lift_mm) << " F100";
-    cmd(out, s_lift.str());
-  }
-  cmd(out, "M702");
-  cmd(out, "M84");
-  cmd(out, "M30");
-  comment(out, "PNG layers stored in " + cfg.png_dir.string());
+//
+// DLP / MSLA (projector) specialization using explicit pixel pitch
+//
+template<IsDLP Cfg, GCodeSink Sink>
+void generateGCode(const std::filesystem::path& stl,
+                   const Cfg& cfg,
+                   GCodeEmitter<Sink>& gcode)
+{
+  generateMaskGCode<Raster::PixelPitch>(stl, cfg, gcode);
 }
 
 /*
@@ -570,256 +2512,794 @@ void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
  * Laser SLA specialization
  ************************************************************************
  */
-namespace
-{  // Anonymous namespace for internal helpers
+namespace Toolpath
+{
 
-// A comparator for map keys to handle floating point inaccuracies for Vec2
-struct Vec2Comparator
+using Slicer::Vec2;
+
+inline double distance(const Vec2& a, const Vec2& b)
 {
-  bool operator()(const Slicer::Vec2& a, const Slicer::Vec2& b) const
-  {
-    constexpr double tol = 1e-6;
-    if (std::abs(a.x - b.x) > tol) {
-      return a.x < b.x;
-    }
-    if (std::abs(a.y - b.y) > tol) {
-      return a.y < b.y;
-    }
-    return false;
-  }
+  return std::hypot(b.x - a.x, b.y - a.y);
+}
+
+// One exposed straight line, reached with a rapid to `from`.
+struct Stroke
+{
+  Vec2 from, to;
 };
 
-// Stitches unordered segments into continuous polygons and determines if they
-// are closed.
-inline std::vector<std::pair<std::vector<Slicer::Vec2>, bool>> stitchSegments(
-    const std::vector<Slicer::Segment2D>& segments)
+// Hatch spans of one scanline, as sorted [xs[2i], xs[2i + 1]] pairs. A line
+// with an odd number of crossings grazes a vertex or hits a meshing error
+// and is left empty with `skipped` set.
+struct HatchRow
 {
-  if (segments.empty())
-    return {};
+  double y;
+  std::vector<double> xs;
+  bool skipped = false;
+};
+
+// Intersects the layer's segments with scanlines `spacing` apart, starting
+// at the lowest point.
+inline std::vector<HatchRow> hatchRows(
+    const std::vector<Slicer::Segment2D>& segments,
+    double spacing)
+{
+  std::vector<HatchRow> rows;
+  if (segments.empty() || spacing <= 1e-9)
+    return rows;
 
-  using AdjacencyList =
-      std::map<Slicer::Vec2, std::list<Slicer::Vec2>, Vec2Comparator>;
-  AdjacencyList adj;
+  double min_y = std::numeric_limits<double>::max();
+  double max_y = std::numeric_limits<double>::lowest();
   for (const auto& seg : segments) {
-    adj[seg.p1].push_back(seg.p2);
-    adj[seg.p2].push_back(seg.p1);
+    min_y = std::min({min_y, seg.p1.y, seg.p2.y});
+    max_y = std::max({max_y, seg.p1.y, seg.p2.y});
   }
 
-  std::vector<std::pair<std::vector<Slicer::Vec2>, bool>> polygons;
+  for (double y = min_y; y <= max_y; y += spacing) {
+    HatchRow row {y, {}};
+    for (const auto& seg : segments) {
+      const Vec2& p1 = seg.p1;
+      const Vec2& p2 = seg.p2;
+      // Robust check for scanline intersection
+      if ((p1.y < y && p2.y >= y) || (p2.y < y && p1.y >= y)) {
+        if (std::abs(p2.y - p1.y) > 1e-9)
+          row.xs.push_back(p1.x + (p2.x - p1.x) * (y - p1.y) / (p2.y - p1.y));
+      }
+    }
+    std::sort(row.xs.begin(), row.xs.end());
+    if (row.xs.size() % 2 != 0) {
+      row.xs.clear();
+      row.skipped = true;
+    }
+    rows.push_back(std::move(row));
+  }
+  return rows;
+}
 
-  while (!adj.empty()) {
-    std::vector<Slicer::Vec2> path;
-    Slicer::Vec2 start_node = adj.begin()->first;
-    Slicer::Vec2 current_node = start_node;
-    path.push_back(current_node);
+// Strokes in plain scanline order, alternating direction from line to line:
+// the order used without travel planning.
+inline std::vector<Stroke> scanlineStrokes(const std::vector<HatchRow>& rows)
+{
+  std::vector<Stroke> strokes;
+  bool forward = true;
+  for (const auto& row : rows) {
+    if (row.skipped)
+      continue;
+    const auto& xs = row.xs;
+    if (forward) {
+      for (std::size_t i = 0; i + 1 < xs.size(); i += 2)
+        strokes.push_back({{xs[i], row.y}, {xs[i + 1], row.y}});
+    } else {
+      for (std::size_t i = xs.size(); i >= 2; i -= 2)
+        strokes.push_back({{xs[i - 1], row.y}, {xs[i - 2], row.y}});
+    }
+    forward = !forward;
+  }
+  return strokes;
+}
 
-    bool is_closed = false;
-    while (true) {
-      if (adj.find(current_node) == adj.end() || adj.at(current_node).empty()) {
-        break;  // Path is open
+// Splits the hatch into blocks: runs of spans on consecutive scanlines where
+// each span overlaps exactly one span of the next line and vice versa. A
+// block is a monotone piece of one island and is hatched back and forth, so
+// the laser never leaves it between lines.
+inline std::vector<std::vector<Stroke>> hatchBlocks(
+    const std::vector<HatchRow>& rows)
+{
+  // Spans numbered row by row; row r holds spans
+  // [row_first[r], row_first[r + 1]).
+  std::vector<std::size_t> row_first(rows.size() + 1, 0);
+  for (std::size_t r = 0; r < rows.size(); ++r)
+    row_first[r + 1] = row_first[r] + rows[r].xs.size() / 2;
+  const std::size_t n = row_first.back();
+
+  constexpr std::size_t kNone = std::numeric_limits<std::size_t>::max();
+  std::vector<std::size_t> down(n, kNone), up(n, kNone);
+  std::vector<int> down_count(n, 0), up_count(n, 0);
+  for (std::size_t r = 0; r + 1 < rows.size(); ++r) {
+    const auto& a = rows[r].xs;
+    const auto& b = rows[r + 1].xs;
+    std::size_t i = 0, j = 0;
+    while (2 * i < a.size() && 2 * j < b.size()) {
+      if (a[2 * i] < b[2 * j + 1] && b[2 * j] < a[2 * i + 1]) {
+        const std::size_t s = row_first[r] + i;
+        const std::size_t t = row_first[r + 1] + j;
+        down[s] = t;
+        up[t] = s;
+        ++down_count[s];
+        ++up_count[t];
+      }
+      if (a[2 * i + 1] < b[2 * j + 1])
+        ++i;
+      else
+        ++j;
+    }
+  }
+  const auto linked = [&](std::size_t s)
+  { return down_count[s] == 1 && up_count[down[s]] == 1; };
+
+  std::vector<std::vector<Stroke>> blocks;
+  for (std::size_t r = 0; r < rows.size(); ++r) {
+    for (std::size_t s = row_first[r]; s < row_first[r + 1]; ++s) {
+      if (up_count[s] == 1 && linked(up[s]))
+        continue;  // continues a block started above
+      std::vector<Stroke> block;
+      bool forward = true;
+      for (std::size_t t = s, row = r;; t = down[t], ++row) {
+        const double x0 = rows[row].xs[2 * (t - row_first[row])];
+        const double x1 = rows[row].xs[2 * (t - row_first[row]) + 1];
+        const double y = rows[row].y;
+        if (forward)
+          block.push_back({{x0, y}, {x1, y}});
+        else
+          block.push_back({{x1, y}, {x0, y}});
+        forward = !forward;
+        if (!linked(t))
+          break;
       }
+      blocks.push_back(std::move(block));
+    }
+  }
+  return blocks;
+}
 
-      Slicer::Vec2 next_node = adj.at(current_node).front();
+// One piece of a layer's toolpath that is exposed in one go: an open
+// polyline or hatch block runs from `first` to `last`, or backwards when
+// `reversed`; a closed contour starts and ends at `loop[start]`.
+struct Unit
+{
+  Vec2 first, last;
+  const std::vector<Vec2>* loop = nullptr;
+  bool reversed = false;
+  std::size_t start = 0;
 
-      adj.at(current_node).pop_front();
-      auto& neighbors_of_next = adj.at(next_node);
-      for (auto it = neighbors_of_next.begin(); it != neighbors_of_next.end();
-           ++it)
-      {
-        if (Vec2Comparator {}(*it, current_node) == false
-            && Vec2Comparator {}(current_node, *it) == false)
-        {
-          neighbors_of_next.erase(it);
-          break;
+  Vec2 entry() const
+  {
+    return loop ? (*loop)[start] : reversed ? last : first;
+  }
+  Vec2 exit() const { return loop ? (*loop)[start] : reversed ? first : last; }
+};
+
+// Rapid distance from `from` through `units` in the given order.
+inline double tourTravel(const std::vector<Unit>& units,
+                         const std::vector<std::size_t>& order,
+                         Vec2 from)
+{
+  double travel = 0.0;
+  for (std::size_t i : order) {
+    travel += distance(from, units[i].entry());
+    from = units[i].exit();
+  }
+  return travel;
+}
+
+// Orders `units` to shorten the rapids from `from` through all of them and
+// returns the visiting order, with each unit's direction or start point set.
+// The tour is built nearest-neighbour first and then improved with 2-opt
+// moves, which reverse a run of units (and each unit in it). Closed contours
+// finally start at the point closest to their neighbours in the tour.
+inline std::vector<std::size_t> planTour(std::vector<Unit>& units, Vec2 from)
+{
+  const std::size_t n = units.size();
+  std::vector<std::size_t> order;
+  order.reserve(n);
+  if (n == 0)
+    return order;
+
+  // Bounding boxes of closed contours, to skip scanning contours that cannot
+  // be nearer than the best unit found so far.
+  struct Box
+  {
+    double x0, y0, x1, y1;
+  };
+  std::vector<Box> boxes(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (!units[i].loop)
+      continue;
+    Box b {std::numeric_limits<double>::max(),
+           std::numeric_limits<double>::max(),
+           std::numeric_limits<double>::lowest(),
+           std::numeric_limits<double>::lowest()};
+    for (const auto& p : *units[i].loop) {
+      b = {std::min(b.x0, p.x), std::min(b.y0, p.y),
+           std::max(b.x1, p.x), std::max(b.y1, p.y)};
+    }
+    boxes[i] = b;
+  }
+
+  // Nearest neighbour.
+  std::vector<uint8_t> done(n, 0);
+  Vec2 at = from;
+  for (std::size_t step = 0; step < n; ++step) {
+    double best = std::numeric_limits<double>::max();
+    std::size_t pick = 0, pick_start = 0;
+    bool pick_reversed = false;
+    for (std::size_t i = 0; i < n; ++i) {
+      if (done[i])
+        continue;
+      const Unit& u = units[i];
+      if (u.loop) {
+        const Box& b = boxes[i];
+        const double dx = std::max({b.x0 - at.x, 0.0, at.x - b.x1});
+        const double dy = std::max({b.y0 - at.y, 0.0, at.y - b.y1});
+        if (std::hypot(dx, dy) >= best)
+          continue;
+        for (std::size_t k = 0; k < u.loop->size(); ++k) {
+          const double d = distance(at, (*u.loop)[k]);
+          if (d < best) {
+            best = d;
+            pick = i;
+            pick_start = k;
+          }
+        }
+      } else {
+        const double d_first = distance(at, u.first);
+        const double d_last = distance(at, u.last);
+        if (std::min(d_first, d_last) < best) {
+          best = std::min(d_first, d_last);
+          pick = i;
+          pick_reversed = d_last < d_first;
         }
       }
+    }
+    done[pick] = 1;
+    units[pick].start = pick_start;
+    units[pick].reversed = pick_reversed;
+    order.push_back(pick);
+    at = units[pick].exit();
+  }
 
-      if (adj.at(current_node).empty()) {
-        adj.erase(current_node);
-      }
-      if (adj.count(next_node) > 0 && adj.at(next_node).empty()) {
-        adj.erase(next_node);
+  // 2-opt: reversing the run order[i..j] changes only the rapids into unit i
+  // and out of unit j; the tour has an open end. Each pass is quadratic, so
+  // very large tours keep their nearest-neighbour order.
+  const auto entry = [&](std::size_t k) { return units[order[k]].entry(); };
+  const auto exit = [&](std::size_t k) { return units[order[k]].exit(); };
+  constexpr std::size_t kMaxTwoOptUnits = 1000;
+  constexpr int kMaxPasses = 32;
+  for (int pass = 0; n <= kMaxTwoOptUnits && pass < kMaxPasses; ++pass) {
+    bool improved = false;
+    for (std::size_t i = 0; i < n; ++i) {
+      const Vec2 before = i == 0 ? from : exit(i - 1);
+      for (std::size_t j = i + 1; j < n; ++j) {
+        double old_cost = distance(before, entry(i));
+        double new_cost = distance(before, exit(j));
+        if (j + 1 < n) {
+          old_cost += distance(exit(j), entry(j + 1));
+          new_cost += distance(entry(i), entry(j + 1));
+        }
+        if (new_cost < old_cost - 1e-9) {
+          std::reverse(order.begin() + static_cast<std::ptrdiff_t>(i),
+                       order.begin() + static_cast<std::ptrdiff_t>(j) + 1);
+          for (std::size_t k = i; k <= j; ++k)
+            units[order[k]].reversed = !units[order[k]].reversed;
+          improved = true;
+        }
       }
+    }
+    if (!improved)
+      break;
+  }
 
-      if (Vec2Comparator {}(next_node, start_node) == false
-          && Vec2Comparator {}(start_node, next_node) == false)
-      {
-        is_closed = true;  // Closed the loop
-        break;
+  // Closed contours start where the rapids in and out are shortest.
+  for (std::size_t k = 0; k < n; ++k) {
+    Unit& u = units[order[k]];
+    if (!u.loop)
+      continue;
+    const Vec2 before = k == 0 ? from : exit(k - 1);
+    double best = std::numeric_limits<double>::max();
+    for (std::size_t v = 0; v < u.loop->size(); ++v) {
+      double d = distance(before, (*u.loop)[v]);
+      if (k + 1 < n)
+        d += distance((*u.loop)[v], entry(k + 1));
+      if (d < best) {
+        best = d;
+        u.start = v;
       }
-
-      path.push_back(next_node);
-      current_node = next_node;
     }
-    polygons.push_back({path, is_closed});
   }
-  return polygons;
+  return order;
 }
 
-// ** CORRECTED HATCHING ALGORITHM **
-// This function now uses the raw segments from the slicer, which is the most
-// robust way to perform a scanline fill.
-template<typename Out>
-void generateSlaHatching(
-    Out& out,
-    const std::vector<Slicer::Segment2D>& segments,  // Takes raw segments
-    const SLAConfig& cfg,
-    double rapid_feed,
-    double expose_feed)
+// How an edge of a simplified contour runs: straight (turn 0), or along a
+// circular arc around `center`, counter-clockwise (turn 1, G3) or clockwise
+// (turn -1, G2).
+struct Arc
 {
-  if (segments.empty())
-    return;
+  Vec2 center;
+  int turn = 0;
+};
 
-  double hatch_dist = 2.0 * cfg.spot_radius;
-  if (hatch_dist <= 1e-9)
-    return;
+// A contour prepared for the laser. arcs[k] describes the edge leaving
+// points[k] (the closing edge of a closed path is arcs.back()); it is empty
+// when every edge is straight.
+struct Path
+{
+  std::vector<Vec2> points;
+  bool closed = false;
+  std::vector<Arc> arcs;
+};
 
-  double min_y = std::numeric_limits<double>::max();
-  double max_y = std::numeric_limits<double>::lowest();
-  for (const auto& seg : segments) {
-    min_y = std::min({min_y, seg.p1.y, seg.p2.y});
-    max_y = std::max({max_y, seg.p1.y, seg.p2.y});
-  }
+namespace detail
+{
 
-  bool forward = true;
-  for (double y = min_y; y <= max_y; y += hatch_dist) {
-    std::vector<double> intersections;
-    for (const auto& seg : segments) {
-      const Slicer::Vec2& p1 = seg.p1;
-      const Slicer::Vec2& p2 = seg.p2;
-      // Robust check for scanline intersection
-      if ((p1.y < y && p2.y >= y) || (p2.y < y && p1.y >= y)) {
-        if (std::abs(p2.y - p1.y) > 1e-9) {
-          double x_intersect =
-              p1.x + (p2.x - p1.x) * (y - p1.y) / (p2.y - p1.y);
-          intersections.push_back(x_intersect);
-        }
+inline double cross(const Vec2& o, const Vec2& a, const Vec2& b)
+{
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Distance from p to the segment a-b.
+inline double segmentDistance(const Vec2& p, const Vec2& a, const Vec2& b)
+{
+  const double dx = b.x - a.x, dy = b.y - a.y;
+  const double len2 = dx * dx + dy * dy;
+  double t = len2 > 0.0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / len2 : 0.0;
+  t = std::clamp(t, 0.0, 1.0);
+  return distance(p, {a.x + t * dx, a.y + t * dy});
+}
+
+// Marks the points of pts[first..last] that Douglas-Peucker keeps at
+// `tolerance`; both ends are always kept.
+inline void douglasPeucker(const std::vector<Vec2>& pts,
+                           std::size_t first,
+                           std::size_t last,
+                           double tolerance,
+                           std::vector<uint8_t>& keep)
+{
+  keep[first] = keep[last] = 1;
+  std::vector<std::pair<std::size_t, std::size_t>> stack {{first, last}};
+  while (!stack.empty()) {
+    const auto [a, b] = stack.back();
+    stack.pop_back();
+    double worst = tolerance;
+    std::size_t split = a;
+    for (std::size_t k = a + 1; k < b; ++k) {
+      const double d = segmentDistance(pts[k], pts[a], pts[b]);
+      if (d > worst) {
+        worst = d;
+        split = k;
       }
     }
+    if (split == a)
+      continue;
+    keep[split] = 1;
+    stack.push_back({a, split});
+    stack.push_back({split, b});
+  }
+}
 
-    std::sort(intersections.begin(), intersections.end());
-
-    if (intersections.size() % 2 != 0) {
-      // Odd number of intersections means the scanline is likely grazing a
-      // vertex or a meshing error occurred. Skip this line for safety.
+// Fits one arc through pts[i..j]. Every point and every edge midpoint must
+// lie within `tolerance` of the circle, and the points must turn one way
+// through less than half a turn. `bend` receives the largest distance of a
+// point from the chord pts[i]-pts[j].
+inline bool fitArc(const std::vector<Vec2>& pts,
+                   std::size_t i,
+                   std::size_t j,
+                   double tolerance,
+                   Arc& arc,
+                   double& bend)
+{
+  const Vec2& a = pts[i];
+  const Vec2& m = pts[(i + j) / 2];
+  const Vec2& b = pts[j];
+  const double d = 2.0 * cross(a, m, b);
+  if (std::abs(d) < 1e-12)
+    return false;
+  const double a2 = a.x * a.x + a.y * a.y;
+  const double m2 = m.x * m.x + m.y * m.y;
+  const double b2 = b.x * b.x + b.y * b.y;
+  const Vec2 c {(a2 * (m.y - b.y) + m2 * (b.y - a.y) + b2 * (a.y - m.y)) / d,
+                (a2 * (b.x - m.x) + m2 * (a.x - b.x) + b2 * (m.x - a.x)) / d};
+  const double r = distance(c, a);
+  const int turn = d > 0.0 ? 1 : -1;
+
+  double sweep = 0.0;
+  bend = 0.0;
+  for (std::size_t k = i; k <= j; ++k) {
+    if (std::abs(distance(c, pts[k]) - r) > tolerance)
+      return false;
+    bend = std::max(bend, segmentDistance(pts[k], a, b));
+    if (k == j)
       continue;
-    }
+    const Vec2& p = pts[k];
+    const Vec2& q = pts[k + 1];
+    const Vec2 mid {(p.x + q.x) / 2.0, (p.y + q.y) / 2.0};
+    if (std::abs(distance(c, mid) - r) > tolerance)
+      return false;
+    const double step = std::atan2(cross(c, p, q),
+                                   (p.x - c.x) * (q.x - c.x)
+                                       + (p.y - c.y) * (q.y - c.y));
+    if (step * turn <= 0.0)
+      return false;
+    sweep += std::abs(step);
+  }
+  if (sweep >= std::numbers::pi)
+    return false;
+  arc = {c, turn};
+  return true;
+}
 
-    auto generate_gcode_line = [&](double x1, double x2)
-    {
-      std::ostringstream ss;
-      ss << std::fixed << std::setprecision(4);
-      ss << "G0 X" << x1 << " Y" << y << " F" << rapid_feed;
-      cmd(out, ss.str());
-      ss.str("");
-      ss.clear();
-      ss << "G1 X" << x2 << " Y" << y << " F" << expose_feed;
-      cmd(out, ss.str());
-    };
+}  // namespace detail
+
+// Prepares a contour for the laser: drops repeated and exactly collinear
+// points, then simplifies it with Douglas-Peucker so that no removed point
+// lies further than `tolerance` from the result. With `fit_arcs`, runs of at
+// least four points on a circle (within `tolerance`, edge midpoints
+// included) become single arcs first, as long as they bend further than
+// `tolerance` from their chord; flatter runs are left to Douglas-Peucker. A
+// tolerance of 0 keeps the contour.
+inline Path simplifyContour(const Slicer::Contour& contour,
+                            double tolerance,
+                            bool fit_arcs)
+{
+  Path path;
+  path.closed = contour.closed;
+  if (tolerance <= 0.0 || contour.points.size() < 3) {
+    path.points = contour.points;
+    return path;
+  }
 
-    if (forward) {
-      for (size_t i = 0; i + 1 < intersections.size(); i += 2) {
-        generate_gcode_line(intersections[i], intersections[i + 1]);
+  // Collinear removal; a closed contour is walked with its start repeated
+  // at the end.
+  std::vector<Vec2> pts;
+  pts.reserve(contour.points.size() + 1);
+  const auto push = [&](const Vec2& p)
+  {
+    if (!pts.empty() && pts.back().x == p.x && pts.back().y == p.y)
+      return;
+    if (pts.size() >= 2 && detail::cross(pts[pts.size() - 2], pts.back(), p) == 0.0
+        && (pts.back().x - pts[pts.size() - 2].x) * (p.x - pts.back().x)
+                + (pts.back().y - pts[pts.size() - 2].y) * (p.y - pts.back().y)
+            > 0.0)
+      pts.pop_back();
+    pts.push_back(p);
+  };
+  for (const auto& p : contour.points)
+    push(p);
+  if (contour.closed)
+    push(contour.points.front());
+
+  // Arcs, then Douglas-Peucker over the straight runs between them.
+  const std::size_t n = pts.size();
+  std::vector<uint8_t> keep(n, 0);
+  std::vector<Arc> arc_at(n);  // arc leaving pts[k], if any
+  std::size_t run = 0;  // first point of the current straight run
+  std::size_t i = 0;
+  while (fit_arcs && i + 3 < n) {
+    // Longest run from pts[i] that fits: doubling its length, then a binary
+    // search between the last fit and the first miss.
+    Arc arc;
+    double bend = 0.0;
+    const auto fits = [&](std::size_t j)
+    { return detail::fitArc(pts, i, j, tolerance, arc, bend); };
+    std::size_t end = 0, miss = n;
+    for (std::size_t len = 3; i + len < n; len *= 2) {
+      if (!fits(i + len)) {
+        miss = i + len;
+        break;
       }
-    } else {
-      for (int i = intersections.size() - 2; i >= 0; i -= 2) {
-        generate_gcode_line(intersections[i + 1], intersections[i]);
+      end = i + len;
+    }
+    if (end != 0) {
+      while (miss - end > 1) {
+        const std::size_t mid = end + (miss - end) / 2;
+        if (fits(mid))
+          end = mid;
+        else
+          miss = mid;
       }
     }
-    forward = !forward;
+    if (end == 0 || !fits(end) || bend <= tolerance) {
+      ++i;
+      continue;
+    }
+    if (run < i)
+      detail::douglasPeucker(pts, run, i, tolerance, keep);
+    keep[i] = keep[end] = 1;
+    arc_at[i] = arc;
+    run = i = end;
   }
+  if (run + 1 < n)
+    detail::douglasPeucker(pts, run, n - 1, tolerance, keep);
+  keep[0] = keep[n - 1] = 1;
+
+  bool any_arc = false;
+  for (std::size_t k = 0; k < n; ++k) {
+    if (!keep[k] || (contour.closed && k == n - 1))
+      continue;
+    path.points.push_back(pts[k]);
+    path.arcs.push_back(arc_at[k]);
+    any_arc = any_arc || arc_at[k].turn != 0;
+  }
+  if (!contour.closed)
+    path.arcs.pop_back();  // no edge leaves the last point
+  if (!any_arc)
+    path.arcs.clear();
+  return path;
 }
-}  // namespace
 
-template<IsSLA Cfg, typename Out>
-void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
+}  // namespace Toolpath
+
+template<IsSLA Cfg, GCodeSink Sink>
+void generateGCode(const std::filesystem::path& stl,
+                   const Cfg& cfg,
+                   GCodeEmitter<Sink>& gcode)
 {
   if (cfg.layer_height <= 0)
     throw std::invalid_argument("SLAConfig.layer_height must be positive");
 
+  if (cfg.simplify_pct < 0)
+    throw std::invalid_argument("SLAConfig.simplify_pct must not be negative");
+
+  STRATUM_SPAN(span, "generate");
   Bounds3D bb;
-  auto triangles = Slicer::readStl(stl, bb);
+  const auto mesh = [&]
+  {
+    const auto triangles = Slicer::readStl(stl, bb);
+    return Slicer::buildIndexedMesh(triangles);
+  }();
+  Slicer::ContourSlicer<double> slicer(mesh);
+  const auto sweep_index = Slicer::ZSweepIndex::fromMesh(mesh);
+  Slicer::ZSweep sweep(sweep_index);
   const int total_layers =
       static_cast<int>(std::ceil((bb.max_z - bb.min_z) / cfg.layer_height));
 
   // Header
-  comment(out, "**** Laser SLA Print ****");
-  cmd(out, "G28");
-  cmd(out, "G90");
+  gcode.comment("**** Laser SLA Print ****");
+  gcode.line("G28");
+  gcode.line("G90");
 
   const double expose_feed = 150.0;
   const double rapid_feed = 200.0;
+  const double tolerance = cfg.spot_radius * cfg.simplify_pct / 100.0;
+
+  // Laser position and rapid distance as emitted, and as the unordered
+  // scanline toolpath would have travelled.
+  Toolpath::Vec2 pos {0.0, 0.0}, scan_pos {0.0, 0.0};
+  double travel = 0.0, scan_travel = 0.0;
+  const auto rapid = [&](const Toolpath::Vec2& p)
+  {
+    travel += Toolpath::distance(pos, p);
+    pos = p;
+    gcode.text("G0")
+        .fixed('X', p.x)
+        .fixed('Y', p.y)
+        .fixed('F', rapid_feed)
+        .end();
+  };
+  const auto expose = [&](const Toolpath::Vec2& p)
+  {
+    pos = p;
+    gcode.text("G1")
+        .fixed('X', p.x)
+        .fixed('Y', p.y)
+        .fixed('F', expose_feed)
+        .end();
+  };
+  // G2 (clockwise, turn -1) or G3 to `to` around `center`, which is given
+  // relative to the start point.
+  const auto arc_move = [&](const Toolpath::Vec2& from,
+                            const Toolpath::Vec2& to,
+                            const Toolpath::Vec2& center,
+                            int turn)
+  {
+    pos = to;
+    gcode.text(turn > 0 ? "G3" : "G2")
+        .fixed('X', to.x)
+        .fixed('Y', to.y)
+        .fixed('I', center.x - from.x)
+        .fixed('J', center.y - from.y)
+        .fixed('F', expose_feed)
+        .end();
+  };
+  const auto scan_rapid = [&](const Toolpath::Vec2& from,
+                              const Toolpath::Vec2& to)
+  {
+    scan_travel += Toolpath::distance(scan_pos, from);
+    scan_pos = to;
+  };
 
   // Layer loop
   for (int l = 0; l < total_layers; ++l) {
     const double z_mm = bb.min_z + (l + 0.5) * cfg.layer_height;
 
-    const auto segments = Slicer::sliceTriangles(triangles, z_mm);
-    if (segments.empty()) {
-      comment(out, "Layer " + std::to_string(l + 1) + " is empty, skipping.");
+    STRATUM_LAYER_SPAN(slice_span, "slice", l);
+    const auto& active = sweep.advance(z_mm);
+    STRATUM_COUNT(TrianglesTested, active.size());
+    const auto contours = slicer.slice(z_mm, active);
+    if (contours.empty()) {
+      gcode.text("; Layer ").digits(l + 1).text(" is empty, skipping.").end();
       continue;
     }
+    const auto segments = Slicer::contourSegments(contours);
+    STRATUM_COUNT(Segments, segments.size());
+    STRATUM_SPAN_END(slice_span);
 
     const double current_z = bb.min_z + (l + 1) * cfg.layer_height;
-    comment(out,
-            "Layer " + std::to_string(l + 1)
-                + " (Z = " + std::to_string(current_z) + " mm)");
-    std::ostringstream s_g1;
-    s_g1 << "G1 Z" << std::fixed << std::setprecision(4) << current_z << " F60";
-    cmd(out, s_g1.str());
-
-    std::ostringstream s_m3;
-    s_m3 << "M3 S" << cfg.laser_power_pct;
-    cmd(out, s_m3.str());
+    gcode.text("; Layer ")
+        .digits(l + 1)
+        .text(" (Z = ")
+        .number(current_z, 6)
+        .text(" mm)")
+        .end();
+    gcode.text("G1").fixed('Z', current_z).text(" F60").end();
+    gcode.text("M3").general('S', cfg.laser_power_pct).end();
 
     // --- Contour Pass ---
-    // Use stitched polygons for a clean, continuous contour toolpath.
-    auto polygon_data = stitchSegments(segments);
-    comment(out, "--- Contour Pass ---");
-    for (const auto& data_pair : polygon_data) {
-      const auto& poly = data_pair.first;
-      if (poly.size() < 2)
-        continue;
-
-      std::ostringstream ss_g0;
-      ss_g0 << std::fixed << std::setprecision(4) << "G0 X" << poly.front().x
-            << " Y" << poly.front().y << " F" << rapid_feed;
-      cmd(out, ss_g0.str());
-
-      for (size_t i = 1; i < poly.size(); ++i) {
-        std::ostringstream ss_g1;
-        ss_g1 << std::fixed << std::setprecision(4) << "G1 X" << poly[i].x
-              << " Y" << poly[i].y << " F" << expose_feed;
-        cmd(out, ss_g1.str());
-      }
+    // Closed loops come straight from the face walk; open pieces left by
+    // cracked or non-manifold meshes are re-joined by the stitcher.
+    STRATUM_LAYER_SPAN(contour_span, "contours", l);
+    std::vector<const Slicer::Contour*> passes;
+    std::vector<Slicer::Contour> open_pieces;
+    for (const auto& c : contours) {
+      if (c.closed)
+        passes.push_back(&c);
+      else
+        open_pieces.push_back(c);
+    }
+    const auto stitched =
+        Slicer::stitchContours(Slicer::contourSegments(open_pieces));
+    for (const auto& c : stitched)
+      passes.push_back(&c);
+
+    // Simplified within the tolerance; paths of fewer than two points have
+    // nothing to trace.
+    std::vector<Toolpath::Path> paths;
+    for (const Slicer::Contour* c : passes) {
+      auto path = Toolpath::simplifyContour(*c, tolerance, cfg.fit_arcs);
+      if (path.points.size() >= 2)
+        paths.push_back(std::move(path));
+    }
 
-      if (data_pair.second) {  // is_closed
-        std::ostringstream ss_g1_close;
-        ss_g1_close << std::fixed << std::setprecision(4) << "G1 X"
-                    << poly.front().x << " Y" << poly.front().y << " F"
-                    << expose_feed;
-        cmd(out, ss_g1_close.str());
+    std::vector<Toolpath::Unit> units;
+    for (const auto& path : paths) {
+      const auto& pts = path.points;
+      units.push_back({pts.front(),
+                       path.closed ? pts.front() : pts.back(),
+                       path.closed ? &pts : nullptr});
+      scan_rapid(pts.front(), units.back().last);
+    }
+    std::vector<std::size_t> order(units.size());
+    std::iota(order.begin(), order.end(), std::size_t {0});
+    if (cfg.optimize_travel)
+      order = Toolpath::planTour(units, pos);
+
+    gcode.comment("--- Contour Pass ---");
+    for (std::size_t i : order) {
+      const auto& path = paths[i];
+      const auto& poly = path.points;
+      const std::size_t n = poly.size();
+      const Toolpath::Unit& u = units[i];
+      // Edge k runs from poly[k] to poly[k + 1], or backwards.
+      const auto edge = [&](std::size_t k, bool backwards)
+      {
+        const Toolpath::Arc arc =
+            path.arcs.empty() ? Toolpath::Arc {} : path.arcs[k];
+        if (arc.turn == 0)
+          return expose(poly[backwards ? k : (k + 1) % n]);
+        const auto& from = poly[backwards ? (k + 1) % n : k];
+        const auto& to = poly[backwards ? k : (k + 1) % n];
+        arc_move(from, to, arc.center, backwards ? -arc.turn : arc.turn);
+      };
+      if (u.loop) {
+        rapid(poly[u.start]);
+        for (std::size_t k = 0; k < n; ++k)
+          edge((u.start + k) % n, false);
+      } else if (u.reversed) {
+        rapid(poly.back());
+        for (std::size_t k = n - 1; k-- > 0;)
+          edge(k, true);
+      } else {
+        rapid(poly.front());
+        for (std::size_t k = 0; k + 1 < n; ++k)
+          edge(k, false);
       }
     }
 
     // --- Hatch Pass ---
     // Use the original raw segments for a robust fill, avoiding errors from
-    // complex polygons.
-    comment(out, "--- Hatch Pass ---");
-    generateSlaHatching(out, segments, cfg, rapid_feed, expose_feed);
+    // complex polygons. Planned hatching runs block by block, each back and
+    // forth within one island.
+    STRATUM_SPAN_END(contour_span);
+    STRATUM_LAYER_SPAN(hatch_span, "hatch", l);
+    gcode.comment("--- Hatch Pass ---");
+    const auto rows = Toolpath::hatchRows(segments, 2.0 * cfg.spot_radius);
+    const auto scan_strokes = Toolpath::scanlineStrokes(rows);
+    for (const auto& s : scan_strokes)
+      scan_rapid(s.from, s.to);
+    if (cfg.optimize_travel) {
+      const auto blocks = Toolpath::hatchBlocks(rows);
+      units.clear();
+      for (const auto& b : blocks)
+        units.push_back({b.front().from, b.back().to});
+      for (std::size_t i : Toolpath::planTour(units, pos)) {
+        const auto& b = blocks[i];
+        if (units[i].reversed) {
+          for (auto s = b.rbegin(); s != b.rend(); ++s) {
+            rapid(s->to);
+            expose(s->from);
+          }
+        } else {
+          for (const auto& s : b) {
+            rapid(s.from);
+            expose(s.to);
+          }
+        }
+      }
+    } else {
+      for (const auto& s : scan_strokes) {
+        rapid(s.from);
+        expose(s.to);
+      }
+    }
+
+    gcode.line("M5");  // laser off
+  }
 
-    cmd(out, "M5");  // laser off
+  if (cfg.optimize_travel) {
+    gcode.text("; Rapid travel: ")
+        .number(travel, 1)
+        .text(" mm (")
+        .number(scan_travel, 1)
+        .text(" mm in scanline order)")
+        .end();
   }
 
   // End
   if (cfg.final_lift_mm > 1e-9) {
     const double final_z = bb.min_z + total_layers * cfg.layer_height;
-    std::ostringstream s_lift;
-    s_lift << "G1 Z" << (final_z + cfg.final_lift_mm) << " F200";
-    cmd(out, s_lift.str());
+    gcode.text("G1")
+        .general('Z', final_z + cfg.final_lift_mm)
+        .text(" F200")
+        .end();
   }
-  cmd(out, "M84");
-  cmd(out, "M30");
+  gcode.line("M84");
+  gcode.line("M30");
+}
+
+// Output-iterator interface: every G-code line is assigned to *out++ as a
+// std::string without its trailing newline, as soon as it is generated, so
+// the consumer can follow the job's progress.
+template<typename Cfg, typename Out>
+  requires(IsLCD<Cfg> || IsDLP<Cfg> || IsSLA<Cfg>)
+void generateGCode(const std::filesystem::path& stl, const Cfg& cfg, Out out)
+{
+  GCodeEmitter<LineSink<Out>> gcode {LineSink<Out>(std::move(out)), 0};
+  generateGCode(stl, cfg, gcode);
+  gcode.flush();
+}
+
+// Writes the G-code for `stl` straight to `file` in large blocks.
+template<typename Cfg>
+  requires(IsLCD<Cfg> || IsDLP<Cfg> || IsSLA<Cfg>)
+void writeGCodeFile(const std::filesystem::path& stl,
+                    const Cfg& cfg,
+                    const std::filesystem::path& file)
+{
+  std::ofstream f(file, std::ios::binary | std::ios::trunc);
+  if (!f)
+    throw std::runtime_error("cannot open " + file.string());
+  GCodeEmitter<StreamSink> gcode {StreamSink(f)};
+  generateGCode(stl, cfg, gcode);
+  gcode.flush();
 }
 
 }  // namespace Stratum
@@ -1,15 +1,27 @@
 #pragma once
 
-#include <cctype>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "instrumentation.h"
+#include "mapped_file.h"
+
 namespace Stratum
 {
 
@@ -26,125 +38,539 @@ struct GCodeCommand
   std::vector<Arg> arguments;
 };
 
-// This is a completely new, more robust parsing implementation that handles
-// commands, numbers, and quoted strings without relying on simple token
-// splitting.
-inline GCodeCommand parseLine(std::string_view view)
+// An argument parsed in place: a number, or a view of the contents of a
+// quoted string in the parsed text.
+struct ArgView
 {
-  GCodeCommand cmd;
+  char letter {};
+  bool is_text = false;
+  double number = 0.0;
+  std::string_view text;
+};
+
+// The arguments of one command. Up to kInline of them are stored in the
+// object itself; longer lists move to a heap buffer that is kept when the
+// list is cleared, so a reused ArgList stops allocating.
+class ArgList
+{
+public:
+  static constexpr std::size_t kInline = 8;
+
+  void clear()
+  {
+    size_ = 0;
+    heap_.clear();
+  }
+
+  void push_back(const ArgView& arg)
+  {
+    if (size_ < kInline) {
+      inline_[size_++] = arg;
+      return;
+    }
+    if (size_ == kInline)
+      heap_.assign(inline_.begin(), inline_.end());
+    heap_.push_back(arg);
+    ++size_;
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const ArgView* begin() const
+  {
+    return size_ <= kInline ? inline_.data() : heap_.data();
+  }
+  const ArgView* end() const { return begin() + size_; }
+  const ArgView& operator[](std::size_t i) const { return begin()[i]; }
+
+private:
+  std::array<ArgView, kInline> inline_ {};
+  std::vector<ArgView> heap_;
+  std::size_t size_ = 0;
+};
+
+// A command parsed in place. The command name and text arguments point into
+// the parsed text and are only valid while it is.
+struct CommandView
+{
+  std::string_view command;
+  ArgList arguments;
+};
+
+namespace detail
+{
+// ASCII classification, as <cctype> in the "C" locale.
+inline bool isSpace(char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+inline bool isAlpha(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+inline bool isNumberChar(char c)
+{
+  return (c >= '0' && c <= '9') || c == '.' || c == '-';
+}
+}  // namespace detail
+
+// Parses one trimmed G-code line into `cmd`, replacing its contents. The
+// command runs up to the first space; each argument is a letter followed by
+// a number or a quoted string, and a bare letter may only end the line.
+// Numbers are read with std::from_chars, so no text is copied.
+inline void parseCommand(std::string_view view, CommandView& cmd)
+{
+  cmd.arguments.clear();
 
   // 1. Find the first space to isolate the command (e.g., "G1", "M701")
-  auto first_space = view.find(' ');
+  const auto first_space = view.find(' ');
   if (first_space == std::string_view::npos) {
     // Line is only a command, no arguments (e.g., "G28")
-    cmd.command = std::string(view);
-    return cmd;
+    cmd.command = view;
+    return;
   }
 
-  cmd.command = std::string(view.substr(0, first_space));
+  cmd.command = view.substr(0, first_space);
   view.remove_prefix(first_space + 1);
 
   // 2. Parse the arguments
-  size_t pos = 0;
-  while (pos < view.length()) {
+  const char* p = view.data();
+  const char* const end = p + view.size();
+  while (p < end) {
     // Skip whitespace
-    while (pos < view.length()
-           && std::isspace(static_cast<unsigned char>(view[pos])))
-    {
-      pos++;
-    }
-    if (pos >= view.length())
+    while (p < end && detail::isSpace(*p))
+      ++p;
+    if (p == end)
       break;
 
     // An argument must start with a letter
-    if (!std::isalpha(static_cast<unsigned char>(view[pos]))) {
+    if (!detail::isAlpha(*p))
       throw std::runtime_error("Invalid G-code argument format.");
-    }
 
-    Arg current_arg;
-    current_arg.letter = view[pos];
-    pos++;
+    ArgView arg;
+    arg.letter = *p++;
 
-    if (pos >= view.length()) {  // Letter-only argument (e.g., M5)
-      cmd.arguments.push_back(current_arg);
+    if (p == end) {  // Letter-only argument (e.g., M5)
+      cmd.arguments.push_back(arg);
       break;
     }
 
     // Check for a quoted string value
-    if (view[pos] == '"') {
-      pos++;  // Skip the opening quote
-      auto end_quote = view.find('"', pos);
-      if (end_quote == std::string_view::npos) {
+    if (*p == '"') {
+      ++p;  // Skip the opening quote
+      const auto* close = static_cast<const char*>(
+          std::memchr(p, '"', static_cast<std::size_t>(end - p)));
+      if (close == nullptr)
         throw std::runtime_error("Mismatched quote in G-code argument.");
-      }
-      current_arg.value = std::string(view.substr(pos, end_quote - pos));
-      pos = end_quote + 1;
+      arg.is_text = true;
+      arg.text = std::string_view(p, static_cast<std::size_t>(close - p));
+      p = close + 1;
     } else {  // Assume numeric value
-      size_t num_end = pos;
-      while (num_end < view.length()
-             && (std::isdigit(static_cast<unsigned char>(view[num_end]))
-                 || view[num_end] == '.' || view[num_end] == '-'))
-      {
-        num_end++;
-      }
-      std::string num_str = std::string(view.substr(pos, num_end - pos));
-      try {
-        current_arg.value = std::stod(num_str);
-      } catch (const std::exception&) {
-        throw std::runtime_error("Invalid numeric value in argument: "
-                                 + num_str);
-      }
-      pos = num_end;
+      const char* num_end = p;
+      while (num_end < end && detail::isNumberChar(*num_end))
+        ++num_end;
+      const auto r = std::from_chars(p, num_end, arg.number);
+      if (r.ec != std::errc())
+        throw std::runtime_error(
+            "Invalid numeric value in argument: "
+            + std::string(p, static_cast<std::size_t>(num_end - p)));
+      p = num_end;
     }
-    cmd.arguments.push_back(current_arg);
+    cmd.arguments.push_back(arg);
   }
-  return cmd;
 }
 
-// Parses a G-code file and writes each command to the output iterator.
-// Throws std::runtime_error if the file cannot be opened.
-template<typename OutputIt>
-void parseFile(const std::filesystem::path& path, OutputIt out)
+// Copies a parsed command into the owning GCodeCommand form.
+inline GCodeCommand toCommand(const CommandView& view)
 {
-  std::ifstream file(path);
-  if (!file.is_open()) {
-    throw std::runtime_error("Failed to open " + path.string());
+  GCodeCommand cmd;
+  cmd.command = std::string(view.command);
+  cmd.arguments.reserve(view.arguments.size());
+  for (const ArgView& a : view.arguments) {
+    Arg arg {a.letter, {}};
+    if (a.is_text)
+      arg.value = std::string(a.text);
+    else
+      arg.value = a.number;
+    cmd.arguments.push_back(std::move(arg));
   }
+  return cmd;
+}
 
-  std::string line;
-  while (std::getline(file, line)) {
-    // Trim leading whitespace
-    std::string_view view(line);
-    size_t start = view.find_first_not_of(" \t");
-    if (start != std::string_view::npos) {
-      view = view.substr(start);
-    } else {
-      continue;  // Line is all whitespace
-    }
+// Parses one trimmed G-code line.
+inline GCodeCommand parseLine(std::string_view view)
+{
+  CommandView cmd;
+  parseCommand(view, cmd);
+  return toCommand(cmd);
+}
+
+// Strips leading blanks, comments and trailing whitespace (including the
+// '\r' of CRLF line ends) from a line. Returns false when nothing is left.
+inline bool trimCommandLine(std::string_view& line)
+{
+  // Trim leading whitespace
+  const std::size_t start = line.find_first_not_of(" \t");
+  if (start == std::string_view::npos)
+    return false;  // Line is all whitespace
+  line.remove_prefix(start);
+
+  // Skip comments; trim trailing comments
+  if (line.front() == ';')
+    return false;
+  if (const auto* semi = static_cast<const char*>(
+          std::memchr(line.data(), ';', line.size())))
+    line = line.substr(0, static_cast<std::size_t>(semi - line.data()));
+
+  // Trim trailing whitespace
+  const std::size_t last = line.find_last_not_of(" \t\r");
+  if (last == std::string_view::npos)
+    return false;
+  line = line.substr(0, last + 1);
+  return true;
+}
 
-    // Skip empty lines or comments
-    if (view.empty() || view.front() == ';') {
+// Parses every command in `text` and calls fn(const CommandView&) for each,
+// in order. Line ends are found with memchr, which the C library implements
+// with vector instructions, and one CommandView is reused for all lines, so
+// parsing does not allocate unless a command has more than ArgList::kInline
+// arguments.
+template<typename Fn>
+void forEachCommand(std::string_view text, Fn&& fn)
+{
+  CommandView cmd;
+  const char* p = text.data();
+  const char* const end = p + text.size();
+  while (p < end) {
+    const auto* nl = static_cast<const char*>(
+        std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+    const char* line_end = nl ? nl : end;
+    std::string_view line(p, static_cast<std::size_t>(line_end - p));
+    p = nl ? nl + 1 : end;
+
+    if (!trimCommandLine(line))
       continue;
-    }
+    parseCommand(line, cmd);
+    fn(static_cast<const CommandView&>(cmd));
+  }
+}
+
+// Pull-based G-code reader that parses one command per call to next().
+// Reading a file goes through a fixed-size buffer, refilled as lines are
+// consumed, so memory use does not depend on the file size (the buffer only
+// grows to hold a line longer than itself). Reading text that is already in
+// memory, such as a MappedFile view, parses it in place. A stream can start
+// at any line start; offset() is the position to resume from after the last
+// command returned.
+class CommandStream
+{
+public:
+  static constexpr std::size_t kDefaultBuffer = std::size_t {64} << 10;
+
+  // Reads `path` from byte `offset`. Throws std::runtime_error if the file
+  // cannot be opened.
+  explicit CommandStream(const std::filesystem::path& path,
+                         std::uint64_t offset = 0,
+                         std::size_t buffer_size = kDefaultBuffer)
+      : file_(path, std::ios::binary)
+      , buffer_(std::max<std::size_t>(buffer_size, 1))
+      , base_(offset)
+  {
+    if (!file_)
+      throw std::runtime_error("Failed to open " + path.string());
+    if (offset > 0 && !file_.seekg(static_cast<std::streamoff>(offset)))
+      throw std::runtime_error("cannot seek in " + path.string());
+    data_ = buffer_.data();
+  }
+
+  // Reads `text` from byte `offset`; the text must outlive the stream.
+  static CommandStream fromText(std::string_view text, std::uint64_t offset = 0)
+  {
+    CommandStream stream;
+    stream.data_ = text.data();
+    stream.end_ = text.size();
+    stream.pos_ = std::min<std::size_t>(static_cast<std::size_t>(offset),
+                                        stream.end_);
+    stream.eof_ = true;
+    return stream;
+  }
 
-    // Trim trailing comments
-    auto comment_pos = view.find(';');
-    if (comment_pos != std::string_view::npos) {
-      view = view.substr(0, comment_pos);
+  // Parses the next command, or returns nullptr at the end of the input. The
+  // command and its text arguments stay valid until the next call. On a
+  // malformed line std::runtime_error is thrown and the stream moves past
+  // that line.
+  const CommandView* next()
+  {
+    while (true) {
+      const auto* nl = pos_ < end_
+          ? static_cast<const char*>(
+              std::memchr(data_ + pos_, '\n', end_ - pos_))
+          : nullptr;
+      std::size_t line_end;
+      if (nl != nullptr) {
+        line_end = static_cast<std::size_t>(nl - data_);
+      } else if (!eof_) {
+        refill();
+        continue;
+      } else if (pos_ < end_) {
+        line_end = end_;  // Last line without a newline
+      } else {
+        return nullptr;
+      }
+
+      std::string_view line(data_ + pos_, line_end - pos_);
+      line_offset_ = base_ + pos_;
+      pos_ = std::min(line_end + 1, end_);
+      if (!trimCommandLine(line))
+        continue;
+      parseCommand(line, cmd_);
+      return &cmd_;
     }
+  }
+
+  // Byte offset just past the line of the last command returned: a stream
+  // opened at this offset continues with the following command.
+  std::uint64_t offset() const { return base_ + pos_; }
 
-    // Trim trailing whitespace
-    size_t end = view.find_last_not_of(" \t");
-    if (end != std::string_view::npos) {
-      view = view.substr(0, end + 1);
+  // Byte offset of the start of the last command's line.
+  std::uint64_t lineOffset() const { return line_offset_; }
+
+  // Single-pass iteration, e.g. `for (const CommandView& cmd : stream)`.
+  // Breaking out of the loop leaves the stream after the last command seen.
+  class iterator
+  {
+  public:
+    using value_type = CommandView;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(CommandStream* stream)
+        : stream_(stream)
+        , cmd_(stream->next())
+    {
     }
 
-    if (view.empty()) {
-      continue;
+    const CommandView& operator*() const { return *cmd_; }
+    const CommandView* operator->() const { return cmd_; }
+    iterator& operator++()
+    {
+      cmd_ = stream_->next();
+      return *this;
     }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const { return cmd_ == nullptr; }
+
+  private:
+    CommandStream* stream_ = nullptr;
+    const CommandView* cmd_ = nullptr;
+  };
+
+  iterator begin() { return iterator(this); }
+  std::default_sentinel_t end() const { return {}; }
+
+private:
+  CommandStream() = default;
+
+  // Moves the unread tail to the front of the buffer and reads more after
+  // it, doubling the buffer if one line fills it.
+  void refill()
+  {
+    const std::size_t tail = end_ - pos_;
+    if (tail == buffer_.size())
+      buffer_.resize(buffer_.size() * 2);
+    std::memmove(buffer_.data(), buffer_.data() + pos_, tail);
+    base_ += pos_;
+    pos_ = 0;
+    end_ = tail;
+    data_ = buffer_.data();
+    file_.read(buffer_.data() + end_,
+               static_cast<std::streamsize>(buffer_.size() - end_));
+    end_ += static_cast<std::size_t>(file_.gcount());
+    if (file_.eof())
+      eof_ = true;
+    else if (!file_)
+      throw std::runtime_error("cannot read G-code");
+  }
 
-    *out++ = parseLine(view);
+  std::ifstream file_;
+  std::vector<char> buffer_;
+  const char* data_ = nullptr;
+  std::size_t pos_ = 0;  // next unread byte in data_
+  std::size_t end_ = 0;  // end of valid data in data_
+  std::uint64_t base_ = 0;  // file offset of data_[0]
+  std::uint64_t line_offset_ = 0;
+  bool eof_ = false;
+  CommandView cmd_;
+};
+
+namespace detail
+{
+// Maps `path` into `file` if it is a regular file that can be mapped.
+inline bool tryMap(const std::filesystem::path& path, MappedFile& file)
+{
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec))
+    return false;
+  try {
+    file = MappedFile(path);
+  } catch (const std::runtime_error&) {
+    return false;
   }
+  return true;
+}
+}  // namespace detail
+
+// Memory-maps a G-code file and calls fn(const CommandView&) for every
+// command; the views point into the mapping and are only valid during the
+// call. Pipes, FIFOs, devices such as /dev/stdin and files that cannot be
+// mapped are read through a CommandStream buffer instead. Throws
+// std::runtime_error if the file cannot be opened.
+template<typename Fn>
+void parseMapped(const std::filesystem::path& path, Fn&& fn)
+{
+  STRATUM_SPAN(span, "parse_gcode");
+  [[maybe_unused]] std::uint64_t commands = 0;
+  const auto counted = [&fn, &commands](const CommandView& cmd)
+  {
+    ++commands;
+    fn(cmd);
+  };
+  MappedFile file;
+  if (detail::tryMap(path, file)) {
+    forEachCommand(file.view(), counted);
+  } else {
+    CommandStream stream(path);
+    while (const CommandView* cmd = stream.next())
+      counted(*cmd);
+  }
+  STRATUM_COUNT(Commands, commands);
+}
+
+// Parses a G-code file and writes each command to the output iterator.
+// Throws std::runtime_error if the file cannot be opened.
+template<typename OutputIt>
+void parseFile(const std::filesystem::path& path, OutputIt out)
+{
+  parseMapped(path,
+              [&out](const CommandView& cmd) { *out++ = toCommand(cmd); });
+}
+
+// Below this size G-code text is parsed on the calling thread only.
+inline constexpr std::size_t kGCodeMinChunk = std::size_t {4} << 20;
+
+// Parses G-code text into commands, in order. Large inputs are split into
+// newline-aligned chunks that are parsed concurrently and then moved into
+// one contiguous result; `threads == 0` uses the hardware concurrency. If
+// any line is malformed, the error of the first such line is rethrown.
+inline std::vector<GCodeCommand> parseCommands(
+    std::string_view text,
+    unsigned threads = 0,
+    std::size_t min_chunk = kGCodeMinChunk)
+{
+  STRATUM_SPAN(span, "parse_gcode");
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t by_size = text.size() / std::max<std::size_t>(1, min_chunk);
+  const std::size_t n_chunks = std::clamp<std::size_t>(by_size, 1, threads);
+
+  const auto parseRange = [](std::string_view chunk)
+  {
+    std::vector<GCodeCommand> cmds;
+    forEachCommand(chunk,
+                   [&cmds](const CommandView& cmd)
+                   { cmds.push_back(toCommand(cmd)); });
+    return cmds;
+  };
+  if (n_chunks == 1) {
+    auto cmds = parseRange(text);
+    STRATUM_COUNT(Commands, cmds.size());
+    return cmds;
+  }
+
+  // Chunk boundaries are moved forward to the next line start.
+  std::vector<const char*> cuts(n_chunks + 1);
+  const char* const first = text.data();
+  const char* const last = text.data() + text.size();
+  cuts.front() = first;
+  cuts.back() = last;
+  for (std::size_t i = 1; i < n_chunks; ++i) {
+    const char* c = std::max(first + text.size() * i / n_chunks, cuts[i - 1]);
+    const char* nl = static_cast<const char*>(
+        std::memchr(c, '\n', static_cast<std::size_t>(last - c)));
+    cuts[i] = nl ? nl + 1 : last;
+  }
+
+  std::vector<std::vector<GCodeCommand>> chunks(n_chunks);
+  std::vector<std::exception_ptr> errors(n_chunks);
+  const auto parseChunk = [&](std::size_t i)
+  {
+    try {
+      chunks[i] = parseRange(std::string_view(
+          cuts[i], static_cast<std::size_t>(cuts[i + 1] - cuts[i])));
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  {
+    std::vector<std::thread> workers;
+    workers.reserve(n_chunks - 1);
+    for (std::size_t i = 1; i < n_chunks; ++i)
+      workers.emplace_back(parseChunk, i);
+    parseChunk(0);
+    for (auto& w : workers)
+      w.join();
+  }
+  for (const auto& e : errors)
+    if (e)
+      std::rethrow_exception(e);
+
+  // Each chunk is moved to its offset in the result on its own thread.
+  std::vector<std::size_t> offsets(n_chunks + 1, 0);
+  for (std::size_t i = 0; i < n_chunks; ++i)
+    offsets[i + 1] = offsets[i] + chunks[i].size();
+  std::vector<GCodeCommand> result(offsets.back());
+  const auto moveChunk = [&](std::size_t i)
+  {
+    std::move(chunks[i].begin(), chunks[i].end(), result.begin() + offsets[i]);
+    chunks[i] = {};
+  };
+  std::vector<std::thread> movers;
+  movers.reserve(n_chunks - 1);
+  for (std::size_t i = 1; i < n_chunks; ++i)
+    movers.emplace_back(moveChunk, i);
+  moveChunk(0);
+  for (auto& m : movers)
+    m.join();
+  STRATUM_COUNT(Commands, result.size());
+  return result;
+}
+
+// Memory-maps a G-code file and parses it with parseCommands. Inputs that
+// cannot be mapped, such as pipes, are read into memory first.
+inline std::vector<GCodeCommand> readGCode(
+    const std::filesystem::path& path, unsigned threads = 0)
+{
+  MappedFile file;
+  if (detail::tryMap(path, file))
+    return parseCommands(file.view(), threads);
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("Failed to open " + path.string());
+  const std::string text {std::istreambuf_iterator<char>(in),
+                          std::istreambuf_iterator<char>()};
+  return parseCommands(text, threads);
+}
+
+// Parses a G-code file in parallel and writes each command to the output
+// iterator, in file order.
+template<typename OutputIt>
+void parseFileParallel(const std::filesystem::path& path,
+                       OutputIt out,
+                       unsigned threads = 0)
+{
+  auto cmds = readGCode(path, threads);
+  std::move(cmds.begin(), cmds.end(), out);
 }
 
-}  // namespace Stratum
\ No newline at end of file
+}  // namespace Stratum
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/resource.h>
+#endif
+
+// Instrumentation hooks. Build with STRATUM_INSTRUMENTATION=1 (the CMake
+// option of the same name) and the pipeline records per-stage, per-layer
+// timings and counters into the Instrument::Profile attached at the time;
+// otherwise every hook expands to nothing and costs nothing.
+//
+//   Stratum::Instrument::Profile profile;
+//   {
+//     Stratum::Instrument::Attach attach(profile);
+//     Stratum::writeGCodeFile(stl, cfg, "job.gcode");
+//   }
+//   profile.writeChromeTrace(trace);  // chrome://tracing or Perfetto
+//
+// Allocations are counted only in programs that link
+// src/instrumentation_alloc.cpp, which replaces the global operator new; the
+// CMake option adds it to every target using the library.
+#ifndef STRATUM_INSTRUMENTATION
+#  define STRATUM_INSTRUMENTATION 0
+#endif
+
+namespace Stratum
+{
+namespace Instrument
+{
+
+enum class Counter
+{
+  TrianglesTested,  // faces checked against a layer plane
+  Segments,  // slice segments produced
+  PixelsSet,  // exposed mask pixels
+  BytesEncoded,  // PNG or layer archive payload bytes
+  MasksStored,  // layer masks written as a PNG or archive entry
+  MasksReused,  // exposed layers that reuse a stored mask
+  Commands,  // G-code commands parsed
+  Allocations,  // global operator new calls, see instrumentation_alloc.cpp
+  kCount
+};
+
+inline const char* counterName(Counter c)
+{
+  static constexpr const char* kNames[] = {"triangles_tested",
+                                           "segments",
+                                           "pixels_set",
+                                           "bytes_encoded",
+                                           "masks_stored",
+                                           "masks_reused",
+                                           "commands",
+                                           "allocations"};
+  return kNames[static_cast<int>(c)];
+}
+
+// Process-wide count of global allocations, advanced by the replacement
+// operator new in instrumentation_alloc.cpp when the program links it.
+inline std::atomic<std::uint64_t>& allocationCount()
+{
+  static std::atomic<std::uint64_t> count {0};
+  return count;
+}
+
+// Peak resident set size of the process in bytes, or 0 if unknown.
+inline std::uint64_t peakRssBytes()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage {};
+  if (::getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#  if defined(__APPLE__)
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+#  else
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#  endif
+#else
+  return 0;
+#endif
+}
+
+// Small, stable id of the calling thread, in order of first use.
+inline unsigned threadId()
+{
+  static std::atomic<unsigned> next {0};
+  thread_local const unsigned id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+// Timings and counters of one run. Spans may be recorded from any thread.
+class Profile
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // A timed stage; `layer` is -1 for whole-job stages.
+  struct Event
+  {
+    const char* stage;
+    int layer;
+    unsigned thread;
+    double start_us;  // since the profile was created
+    double duration_us;
+  };
+
+  Profile()
+      : origin_(Clock::now())
+  {
+  }
+
+  Profile(const Profile&) = delete;
+  Profile& operator=(const Profile&) = delete;
+
+  void add(Counter c, std::uint64_t n)
+  {
+    counters_[static_cast<int>(c)].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::uint64_t counter(Counter c) const
+  {
+    return counters_[static_cast<int>(c)].load(std::memory_order_relaxed);
+  }
+
+  void record(const char* stage,
+              int layer,
+              Clock::time_point start,
+              Clock::time_point end)
+  {
+    const Event e {stage,
+                   layer,
+                   threadId(),
+                   micros(start - origin_),
+                   micros(end - start)};
+    std::lock_guard<std::mutex> lk(m_);
+    events_.push_back(e);
+  }
+
+  std::vector<Event> events() const
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    return events_;
+  }
+
+  // Peak RSS seen when the profile was last detached (or now, if attached).
+  std::uint64_t peakRss() const { return peak_rss_ ? peak_rss_ : peakRssBytes(); }
+
+  // Summary: per stage the call count and total / maximum milliseconds, per
+  // layer the milliseconds of each stage, then the counters.
+  void writeJson(std::ostream& os) const
+  {
+    const auto events = this->events();
+    struct Stage
+    {
+      std::uint64_t count = 0;
+      double total_us = 0, max_us = 0;
+    };
+    std::map<std::string, Stage> stages;
+    std::map<int, std::map<std::string, double>> layers;
+    for (const Event& e : events) {
+      Stage& s = stages[e.stage];
+      ++s.count;
+      s.total_us += e.duration_us;
+      s.max_us = std::max(s.max_us, e.duration_us);
+      if (e.layer >= 0)
+        layers[e.layer][e.stage] += e.duration_us;
+    }
+
+    os << "{\n  \"stages\": {";
+    const char* sep = "\n";
+    for (const auto& [name, s] : stages) {
+      os << sep << "    \"" << name << "\": {\"count\": " << s.count
+         << ", \"total_ms\": " << s.total_us / 1000
+         << ", \"max_ms\": " << s.max_us / 1000 << "}";
+      sep = ",\n";
+    }
+    os << "\n  },\n  \"layers\": [";
+    sep = "\n";
+    for (const auto& [layer, times] : layers) {
+      os << sep << "    {\"layer\": " << layer;
+      for (const auto& [name, us] : times)
+        os << ", \"" << name << "_ms\": " << us / 1000;
+      os << "}";
+      sep = ",\n";
+    }
+    os << "\n  ],\n  \"counters\": {";
+    sep = "\n";
+    for (int c = 0; c < static_cast<int>(Counter::kCount); ++c) {
+      os << sep << "    \"" << counterName(static_cast<Counter>(c))
+         << "\": " << counter(static_cast<Counter>(c));
+      sep = ",\n";
+    }
+    os << ",\n    \"peak_rss_bytes\": " << peakRss() << "\n  }\n}\n";
+  }
+
+  // Chrome trace event format: one complete ("X") event per span on its
+  // thread's track, and the counters as a final counter ("C") event.
+  void writeChromeTrace(std::ostream& os) const
+  {
+    const auto events = this->events();
+    double end_us = 0;
+    os << "{\"traceEvents\": [";
+    const char* sep = "\n";
+    for (const Event& e : events) {
+      os << sep << "{\"name\": \"" << e.stage << "\", \"ph\": \"X\", \"pid\": 1"
+         << ", \"tid\": " << e.thread << ", \"ts\": " << e.start_us
+         << ", \"dur\": " << e.duration_us;
+      if (e.layer >= 0)
+        os << ", \"args\": {\"layer\": " << e.layer << "}";
+      os << "}";
+      sep = ",\n";
+      end_us = std::max(end_us, e.start_us + e.duration_us);
+    }
+    os << sep << "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0"
+       << ", \"ts\": " << end_us << ", \"args\": {";
+    for (int c = 0; c < static_cast<int>(Counter::kCount); ++c)
+      os << (c ? ", " : "") << "\"" << counterName(static_cast<Counter>(c))
+         << "\": " << counter(static_cast<Counter>(c));
+    os << ", \"peak_rss_bytes\": " << peakRss() << "}}\n]}\n";
+  }
+
+private:
+  friend class Attach;
+
+  static double micros(Clock::duration d)
+  {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+
+  Clock::time_point origin_;
+  std::array<std::atomic<std::uint64_t>, static_cast<int>(Counter::kCount)>
+      counters_ {};
+  mutable std::mutex m_;
+  std::vector<Event> events_;
+  std::uint64_t peak_rss_ = 0;
+};
+
+inline std::atomic<Profile*>& currentProfile()
+{
+  static std::atomic<Profile*> profile {nullptr};
+  return profile;
+}
+
+inline Profile* current()
+{
+  return currentProfile().load(std::memory_order_acquire);
+}
+
+// Makes `profile` the target of every hook, on all threads, while in scope.
+// Allocations made meanwhile are added to its counter.
+class Attach
+{
+public:
+  explicit Attach(Profile& profile)
+      : profile_(profile)
+      , previous_(currentProfile().exchange(&profile))
+      , allocations_(allocationCount().load(std::memory_order_relaxed))
+  {
+  }
+
+  Attach(const Attach&) = delete;
+  Attach& operator=(const Attach&) = delete;
+
+  ~Attach()
+  {
+    profile_.add(Counter::Allocations,
+                 allocationCount().load(std::memory_order_relaxed)
+                     - allocations_);
+    profile_.peak_rss_ = peakRssBytes();
+    currentProfile().store(previous_);
+  }
+
+private:
+  Profile& profile_;
+  Profile* previous_;
+  std::uint64_t allocations_;
+};
+
+inline void count(Counter c, std::uint64_t n)
+{
+  if (Profile* p = current())
+    p->add(c, n);
+}
+
+// Times the enclosing scope, or until end(), into the current profile.
+class Span
+{
+public:
+  explicit Span(const char* stage, int layer = -1)
+      : profile_(current())
+      , stage_(stage)
+      , layer_(layer)
+  {
+    if (profile_)
+      start_ = Profile::Clock::now();
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  ~Span() { end(); }
+
+  void end()
+  {
+    if (profile_)
+      profile_->record(stage_, layer_, start_, Profile::Clock::now());
+    profile_ = nullptr;
+  }
+
+private:
+  Profile* profile_;
+  const char* stage_;
+  int layer_;
+  Profile::Clock::time_point start_;
+};
+
+}  // namespace Instrument
+}  // namespace Stratum
+
+#if STRATUM_INSTRUMENTATION
+#  define STRATUM_SPAN(var, stage) ::Stratum::Instrument::Span var(stage)
+#  define STRATUM_LAYER_SPAN(var, stage, layer) \
+    ::Stratum::Instrument::Span var(stage, layer)
+#  define STRATUM_SPAN_END(var) var.end()
+#  define STRATUM_COUNT(counter, n) \
+    ::Stratum::Instrument::count(::Stratum::Instrument::Counter::counter, (n))
+#else
+#  define STRATUM_SPAN(var, stage) static_cast<void>(0)
+#  define STRATUM_LAYER_SPAN(var, stage, layer) static_cast<void>(0)
+#  define STRATUM_SPAN_END(var) static_cast<void>(0)
+#  define STRATUM_COUNT(counter, n) static_cast<void>(0)
+#endif
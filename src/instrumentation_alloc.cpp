@@ -0,0 +1,163 @@
+// Replacement global allocation functions that count every allocation in
+// Instrument::allocationCount(). Link this file into a program (at most once)
+// to fill the Allocations counter; the CMake option STRATUM_INSTRUMENTATION
+// does so for every target using the library.
+//
+// All forms are replaced, plain, array, aligned and nothrow, so each operator
+// delete matches the operator new that allocated its pointer.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "instrumentation.h"
+
+// GCC pairs a replaced operator new with the operator delete it sees and
+// reports the free() below as mismatched; here both sides are malloc/free.
+#if defined(__GNUC__) && !defined(__clang__)
+#  pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+void* allocate(std::size_t n)
+{
+  Stratum::Instrument::allocationCount().fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* allocateAligned(std::size_t n, std::align_val_t al)
+{
+  Stratum::Instrument::allocationCount().fetch_add(1, std::memory_order_relaxed);
+  const auto a = static_cast<std::size_t>(al);
+  // aligned_alloc wants a size that is a multiple of the alignment.
+  const std::size_t size = n ? (n + a - 1) / a * a : a;
+  if (void* p = std::aligned_alloc(a, size))
+    return p;
+  throw std::bad_alloc();
+}
+}  // namespace
+
+void* operator new(std::size_t n)
+{
+  return allocate(n);
+}
+
+void* operator new[](std::size_t n)
+{
+  return allocate(n);
+}
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept
+{
+  try {
+    return allocate(n);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept
+{
+  try {
+    return allocate(n);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new(std::size_t n, std::align_val_t al)
+{
+  return allocateAligned(n, al);
+}
+
+void* operator new[](std::size_t n, std::align_val_t al)
+{
+  return allocateAligned(n, al);
+}
+
+void* operator new(std::size_t n,
+                   std::align_val_t al,
+                   const std::nothrow_t&) noexcept
+{
+  try {
+    return allocateAligned(n, al);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t n,
+                     std::align_val_t al,
+                     const std::nothrow_t&) noexcept
+{
+  try {
+    return allocateAligned(n, al);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p,
+                       std::align_val_t,
+                       const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "layer_mask.h"
+#include "lodepng.h"
+#include "mapped_file.h"
+#include "png_encoder.h"
+
+namespace Stratum
+{
+
+/*
+ * Single-file layer archive
+ *
+ * All integers are little-endian.
+ *
+ *   header (40 bytes)
+ *     char[8]  magic "STRATLYR"
+ *     uint32   version (1)
+ *     uint32   width, height (pixels)
+ *     uint32   encoding (LayerArchive::kRaw, kRle or kDeflate)
+ *     uint32   layer count
+ *     uint32   bits per pixel (1, or 8 for anti-aliased greyscale masks)
+ *     uint64   offset of the index
+ *   payloads, back to back
+ *   index: one 24-byte entry per layer
+ *     uint64   payload offset
+ *     uint64   payload size
+ *     uint32   CRC-32 of the payload
+ *     uint32   reserved (0)
+ *
+ * A payload is the BitMask image (byte-aligned rows, MSB-first) or, at 8 bits
+ * per pixel, the GreyMask image after the archive's encoding. The index sits
+ * at the end so layers can be streamed out before their count is known.
+ */
+namespace LayerArchive
+{
+
+inline constexpr char kMagic[8] = {'S', 'T', 'R', 'A', 'T', 'L', 'Y', 'R'};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::size_t kHeaderSize = 40;
+inline constexpr std::size_t kEntrySize = 24;
+
+inline constexpr std::uint32_t kRaw = 0;
+inline constexpr std::uint32_t kRle = 1;  // PackBits over the packed bytes
+inline constexpr std::uint32_t kDeflate = 2;  // zlib stream
+
+inline void putLE32(std::vector<uint8_t>& out, std::uint32_t v)
+{
+  for (int i = 0; i < 4; ++i)
+    out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+inline void putLE64(std::vector<uint8_t>& out, std::uint64_t v)
+{
+  for (int i = 0; i < 8; ++i)
+    out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+inline std::uint64_t loadLE(const char* p, int bytes)
+{
+  std::uint64_t v = 0;
+  for (int i = 0; i < bytes; ++i)
+    v |= std::uint64_t {static_cast<unsigned char>(p[i])} << (8 * i);
+  return v;
+}
+
+// PackBits: a control byte n < 128 copies the next n + 1 bytes, n >= 128
+// repeats the next byte n - 125 times (3..130).
+inline void packBits(const uint8_t* p, std::size_t n, std::vector<uint8_t>& out)
+{
+  std::size_t i = 0;
+  while (i < n) {
+    std::size_t run = 1;
+    while (i + run < n && run < 130 && p[i + run] == p[i])
+      ++run;
+    if (run >= 3) {
+      out.push_back(static_cast<uint8_t>(run + 125));
+      out.push_back(p[i]);
+      i += run;
+      continue;
+    }
+
+    // Literal stretch up to the next run of three.
+    std::size_t lit = 0;
+    while (i + lit < n && lit < 128) {
+      if (i + lit + 2 < n && p[i + lit] == p[i + lit + 1]
+          && p[i + lit] == p[i + lit + 2])
+        break;
+      ++lit;
+    }
+    out.push_back(static_cast<uint8_t>(lit - 1));
+    out.insert(out.end(), p + i, p + i + lit);
+    i += lit;
+  }
+}
+
+inline void unpackBits(std::string_view in, uint8_t* out, std::size_t n)
+{
+  std::size_t i = 0, o = 0;
+  while (i < in.size()) {
+    const auto c = static_cast<uint8_t>(in[i++]);
+    if (c < 128) {
+      const std::size_t lit = std::size_t {c} + 1;
+      if (i + lit > in.size() || o + lit > n)
+        throw std::runtime_error("corrupt RLE layer payload");
+      std::memcpy(out + o, in.data() + i, lit);
+      i += lit;
+      o += lit;
+    } else {
+      const std::size_t run = std::size_t {c} - 125;
+      if (i >= in.size() || o + run > n)
+        throw std::runtime_error("corrupt RLE layer payload");
+      std::memset(out + o, static_cast<uint8_t>(in[i++]), run);
+      o += run;
+    }
+  }
+  if (o != n)
+    throw std::runtime_error("corrupt RLE layer payload");
+}
+
+// Encodes raw mask bytes into `out` (replacing its contents) with the given
+// encoding.
+inline void encode(const std::vector<uint8_t>& bytes,
+                   std::uint32_t encoding,
+                   std::vector<uint8_t>& out)
+{
+  out.clear();
+  if (encoding == kRaw) {
+    out.assign(bytes.begin(), bytes.end());
+  } else if (encoding == kRle) {
+    packBits(bytes.data(), bytes.size(), out);
+  } else if (encoding == kDeflate) {
+    const unsigned err = lodepng::compress(out, bytes);
+    if (err)
+      throw std::runtime_error("layer deflate error: "
+                               + std::string(lodepng_error_text(err)));
+  } else {
+    throw std::invalid_argument("unknown layer archive encoding");
+  }
+}
+
+inline void encode(const BitMask& mask,
+                   std::uint32_t encoding,
+                   std::vector<uint8_t>& out)
+{
+  encode(mask.bytes(), encoding, out);
+}
+
+inline void encode(const GreyMask& mask,
+                   std::uint32_t encoding,
+                   std::vector<uint8_t>& out)
+{
+  encode(mask.bytes(), encoding, out);
+}
+
+// Streams layers into an archive file. Layers are appended in call order and
+// addressed by the returned index. `depth` is 1 for BitMask layers and 8 for
+// GreyMask layers.
+class Writer
+{
+public:
+  Writer(const std::filesystem::path& file,
+         int width,
+         int height,
+         std::uint32_t encoding = kRle,
+         std::uint32_t depth = 1)
+      : file_(file)
+      , f_(file, std::ios::binary | std::ios::trunc)
+      , width_(width)
+      , height_(height)
+      , encoding_(encoding)
+      , depth_(depth)
+  {
+    if (!f_)
+      throw std::runtime_error("cannot open " + file.string());
+    if (encoding > kDeflate)
+      throw std::invalid_argument("unknown layer archive encoding");
+    if (depth != 1 && depth != 8)
+      throw std::invalid_argument("layer archive depth must be 1 or 8");
+    writeHeader(0);
+    offset_ = kHeaderSize;
+  }
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  ~Writer()
+  {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  std::uint32_t encoding() const { return encoding_; }
+  std::uint32_t depth() const { return depth_; }
+  std::uint32_t size() const { return static_cast<std::uint32_t>(index_.size() / kEntrySize); }
+
+  // Reserves index space for n layers so appending them does not allocate.
+  void reserve(std::size_t n) { index_.reserve(n * kEntrySize); }
+
+  // Encodes and appends one layer mask.
+  std::uint32_t add(const BitMask& mask) { return addMask(mask, 1); }
+  std::uint32_t add(const GreyMask& mask) { return addMask(mask, 8); }
+
+  // Appends a payload already produced by LayerArchive::encode with this
+  // archive's encoding, e.g. on a worker thread.
+  std::uint32_t addEncoded(const std::vector<uint8_t>& payload)
+  {
+    if (closed_)
+      throw std::logic_error("layer archive already closed");
+    f_.write(reinterpret_cast<const char*>(payload.data()),
+             static_cast<std::streamsize>(payload.size()));
+    if (!f_)
+      throw std::runtime_error("cannot write " + file_.string());
+
+    putLE64(index_, offset_);
+    putLE64(index_, payload.size());
+    putLE32(index_, Png::crc32(0, payload.data(), payload.size()));
+    putLE32(index_, 0);
+    offset_ += payload.size();
+    return size() - 1;
+  }
+
+  // Writes the index and final header. Called by the destructor if needed.
+  void close()
+  {
+    if (closed_)
+      return;
+    closed_ = true;
+    f_.write(reinterpret_cast<const char*>(index_.data()),
+             static_cast<std::streamsize>(index_.size()));
+    f_.seekp(0);
+    writeHeader(offset_);
+    f_.close();
+    if (!f_)
+      throw std::runtime_error("cannot write " + file_.string());
+  }
+
+private:
+  template<typename Mask>
+  std::uint32_t addMask(const Mask& mask, std::uint32_t depth)
+  {
+    if (mask.width() != width_ || mask.height() != height_)
+      throw std::invalid_argument("layer size does not match the archive");
+    if (depth != depth_)
+      throw std::invalid_argument("layer depth does not match the archive");
+    encode(mask, encoding_, scratch_);
+    return addEncoded(scratch_);
+  }
+
+  void writeHeader(std::uint64_t index_offset)
+  {
+    std::vector<uint8_t> h(kMagic, kMagic + 8);
+    putLE32(h, kVersion);
+    putLE32(h, static_cast<std::uint32_t>(width_));
+    putLE32(h, static_cast<std::uint32_t>(height_));
+    putLE32(h, encoding_);
+    putLE32(h, size());
+    putLE32(h, depth_);
+    putLE64(h, index_offset);
+    f_.write(reinterpret_cast<const char*>(h.data()),
+             static_cast<std::streamsize>(h.size()));
+  }
+
+  std::filesystem::path file_;
+  std::ofstream f_;
+  int width_, height_;
+  std::uint32_t encoding_;
+  std::uint32_t depth_;
+  std::uint64_t offset_ = 0;
+  std::vector<uint8_t> index_;
+  std::vector<uint8_t> scratch_;
+  bool closed_ = false;
+};
+
+// Memory-maps an archive; any layer is located through the index in O(1).
+class Reader
+{
+public:
+  explicit Reader(const std::filesystem::path& file)
+      : map_(file)
+  {
+    const char* p = map_.data();
+    if (map_.size() < kHeaderSize || std::memcmp(p, kMagic, 8) != 0)
+      throw std::runtime_error("not a layer archive: " + file.string());
+    if (loadLE(p + 8, 4) != kVersion)
+      throw std::runtime_error("unsupported layer archive version");
+    width_ = static_cast<int>(loadLE(p + 12, 4));
+    height_ = static_cast<int>(loadLE(p + 16, 4));
+    encoding_ = static_cast<std::uint32_t>(loadLE(p + 20, 4));
+    count_ = static_cast<std::uint32_t>(loadLE(p + 24, 4));
+    depth_ = static_cast<std::uint32_t>(loadLE(p + 28, 4));
+    index_ = loadLE(p + 32, 8);
+    if (depth_ != 1 && depth_ != 8)
+      throw std::runtime_error("unsupported layer archive depth");
+    if (index_ < kHeaderSize || index_ > map_.size()
+        || (map_.size() - index_) / kEntrySize < count_)
+      throw std::runtime_error("truncated layer archive: " + file.string());
+  }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  std::uint32_t encoding() const { return encoding_; }
+  std::uint32_t depth() const { return depth_; }
+  std::uint32_t size() const { return count_; }
+
+  // Encoded bytes of layer i, pointing into the mapping.
+  std::string_view payload(std::uint32_t i) const
+  {
+    if (i >= count_)
+      throw std::out_of_range("layer index out of range");
+    const char* e = map_.data() + index_ + std::size_t {i} * kEntrySize;
+    const std::uint64_t off = loadLE(e, 8);
+    const std::uint64_t len = loadLE(e + 8, 8);
+    if (off < kHeaderSize || off > index_ || len > index_ - off)
+      throw std::runtime_error("corrupt layer archive index");
+    return {map_.data() + off, static_cast<std::size_t>(len)};
+  }
+
+  // Decodes layer i into `mask`, reusing its allocation. The mask type must
+  // match the archive depth.
+  void layer(std::uint32_t i, BitMask& mask) const
+  {
+    if (depth_ != 1)
+      throw std::logic_error("greyscale layer archive read as a BitMask");
+    mask.resize(width_, height_);
+    decode(i, mask.data(), mask.bytes().size());
+  }
+
+  void layer(std::uint32_t i, GreyMask& mask) const
+  {
+    if (depth_ != 8)
+      throw std::logic_error("1-bit layer archive read as a GreyMask");
+    mask.resize(width_, height_);
+    decode(i, mask.data(), mask.bytes().size());
+  }
+
+  BitMask layer(std::uint32_t i) const
+  {
+    BitMask mask;
+    layer(i, mask);
+    return mask;
+  }
+
+  GreyMask greyLayer(std::uint32_t i) const
+  {
+    GreyMask mask;
+    layer(i, mask);
+    return mask;
+  }
+
+private:
+  void decode(std::uint32_t i, uint8_t* out, std::size_t n) const
+  {
+    const std::string_view data = payload(i);
+    const char* e = map_.data() + index_ + std::size_t {i} * kEntrySize;
+    const auto crc = static_cast<std::uint32_t>(loadLE(e + 16, 4));
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+    if (Png::crc32(0, bytes, data.size()) != crc)
+      throw std::runtime_error("layer archive CRC mismatch");
+
+    if (encoding_ == kRaw) {
+      if (data.size() != n)
+        throw std::runtime_error("corrupt raw layer payload");
+      std::memcpy(out, data.data(), n);
+    } else if (encoding_ == kRle) {
+      unpackBits(data, out, n);
+    } else if (encoding_ == kDeflate) {
+      std::vector<unsigned char> raw;
+      const unsigned err = lodepng::decompress(raw, bytes, data.size());
+      if (err || raw.size() != n)
+        throw std::runtime_error("corrupt deflate layer payload");
+      std::memcpy(out, raw.data(), n);
+    } else {
+      throw std::runtime_error("unknown layer archive encoding");
+    }
+  }
+
+private:
+  MappedFile map_;
+  int width_ = 0, height_ = 0;
+  std::uint32_t encoding_ = kRaw;
+  std::uint32_t count_ = 0;
+  std::uint32_t depth_ = 1;
+  std::uint64_t index_ = 0;
+};
+
+}  // namespace LayerArchive
+}  // namespace Stratum
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "layer_archive.h"
+#include "layer_mask.h"
+#include "mapped_file.h"
+
+namespace Stratum
+{
+
+/*
+ * Layer cache entry
+ *
+ * A mask job's layer plan (which stored mask each layer exposes) for one mesh
+ * and one set of geometry settings. Entries are content-addressed: the file
+ * is named after the 128-bit hash of its key record, and the record itself is
+ * stored and compared byte for byte on lookup. All integers are
+ * little-endian.
+ *
+ *   header (16 bytes)
+ *     char[8]  magic "STRATLCH"
+ *     uint32   version (1)
+ *     uint32   key record size
+ *   key record
+ *   plan
+ *     float64  base Z of the model (mm)
+ *     uint32   layer count
+ *     uint32   masks stored
+ *     uint32   layers not rasterized (repeats of the layer before)
+ *     uint32   output file count
+ *     int32    per layer: mask id (archive index or PNG layer), -1 = empty
+ *     per output file (PNGs in id order, or the one archive):
+ *       uint64 size
+ *       int64  modification time, in file clock ticks
+ *
+ * Output files are checked by size and modification time only, so a hit
+ * never opens a mask; a mismatch (masks deleted or rewritten by another job)
+ * is a miss.
+ */
+namespace LayerCache
+{
+
+namespace detail
+{
+// Writes `bytes` next to `file` and renames them into place, so readers
+// never see a partial file.
+inline void replaceFile(const std::filesystem::path& file,
+                        const std::vector<uint8_t>& bytes)
+{
+  if (file.has_parent_path())
+    std::filesystem::create_directories(file.parent_path());
+  std::filesystem::path tmp = file;
+  tmp += ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(bytes.data()),
+            static_cast<std::streamsize>(bytes.size()));
+    if (!f)
+      throw std::runtime_error("cannot write layer cache " + tmp.string());
+  }
+  std::filesystem::rename(tmp, file);
+}
+}  // namespace detail
+
+inline constexpr char kMagic[8] = {'S', 'T', 'R', 'A', 'T', 'L', 'C', 'H'};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::size_t kHeaderSize = 16;
+
+// Size and modification time of a mask file.
+struct Output
+{
+  std::uint64_t size = 0;
+  std::int64_t mtime = 0;
+  bool operator==(const Output&) const = default;
+};
+
+// What the G-code of a mask job needs besides the emission settings.
+struct Plan
+{
+  double base_z = 0.0;
+  std::vector<std::int32_t> layers;  // mask id per layer, -1 = empty
+  std::uint32_t stored = 0;
+  std::uint32_t skipped = 0;
+  std::vector<Output> outputs;
+};
+
+// Key record: the mesh hash followed by every setting that changes the
+// masks or where they are stored.
+class Key
+{
+public:
+  explicit Key(const MaskHash& mesh)
+  {
+    add(mesh.lo);
+    add(mesh.hi);
+  }
+
+  Key& add(std::uint64_t v)
+  {
+    LayerArchive::putLE64(record_, v);
+    return *this;
+  }
+
+  Key& add(double v) { return add(std::bit_cast<std::uint64_t>(v)); }
+
+  Key& add(std::string_view s)
+  {
+    add(static_cast<std::uint64_t>(s.size()));
+    record_.insert(record_.end(), s.begin(), s.end());
+    return *this;
+  }
+
+  const std::vector<uint8_t>& record() const { return record_; }
+
+  MaskHash hash() const
+  {
+    return hashBytes(record_.data(), record_.size(), 0);
+  }
+
+private:
+  std::vector<uint8_t> record_;
+};
+
+// Hashes the contents of a file, such as the STL of a job.
+inline MaskHash hashFile(const std::filesystem::path& path)
+{
+  const MappedFile file(path);
+  const std::string_view data = file.view();
+  return hashBytes(
+      reinterpret_cast<const uint8_t*>(data.data()), data.size(), 0);
+}
+
+// 32 hex digits of a hash, used to name cache files.
+inline std::string hexName(const MaskHash& h)
+{
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string name(32, '0');
+  for (int i = 0; i < 16; ++i) {
+    name[15 - i] = kHex[(h.hi >> (4 * i)) & 0xF];
+    name[31 - i] = kHex[(h.lo >> (4 * i)) & 0xF];
+  }
+  return name;
+}
+
+// File of the entry for `key` in the cache directory `dir`.
+inline std::filesystem::path entryPath(const std::filesystem::path& dir,
+                                       const Key& key)
+{
+  return dir / (hexName(key.hash()) + ".layers");
+}
+
+// Size and modification time of `file`; false if it cannot be read.
+inline bool statOutput(const std::filesystem::path& file, Output& out)
+{
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(file, ec);
+  if (ec)
+    return false;
+  const auto mtime = std::filesystem::last_write_time(file, ec);
+  if (ec)
+    return false;
+  out.size = size;
+  out.mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+  return true;
+}
+
+// Reads the entry at `file` into `plan`. Returns false, leaving `plan`
+// unspecified, if there is no entry, it belongs to another key or it is
+// damaged: a cache miss, never an error.
+inline bool load(const std::filesystem::path& file,
+                 const Key& key,
+                 Plan& plan)
+{
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    return false;
+  const std::string data {std::istreambuf_iterator<char>(in),
+                          std::istreambuf_iterator<char>()};
+  const auto& record = key.record();
+  const std::size_t plan_at = kHeaderSize + record.size();
+  if (data.size() < plan_at + 24
+      || data.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0)
+    return false;
+  const char* p = data.data();
+  if (LayerArchive::loadLE(p + 8, 4) != kVersion
+      || LayerArchive::loadLE(p + 12, 4) != record.size()
+      || std::memcmp(p + kHeaderSize, record.data(), record.size()) != 0)
+    return false;
+
+  p += plan_at;
+  plan.base_z = std::bit_cast<double>(LayerArchive::loadLE(p, 8));
+  const std::size_t layers = LayerArchive::loadLE(p + 8, 4);
+  plan.stored = static_cast<std::uint32_t>(LayerArchive::loadLE(p + 12, 4));
+  plan.skipped = static_cast<std::uint32_t>(LayerArchive::loadLE(p + 16, 4));
+  const std::size_t outputs = LayerArchive::loadLE(p + 20, 4);
+  p += 24;
+  if (data.size() - plan_at - 24 != layers * 4 + outputs * 16)
+    return false;
+
+  plan.layers.resize(layers);
+  for (auto& id : plan.layers) {
+    id = static_cast<std::int32_t>(
+        static_cast<std::uint32_t>(LayerArchive::loadLE(p, 4)));
+    p += 4;
+  }
+  plan.outputs.resize(outputs);
+  for (auto& o : plan.outputs) {
+    o.size = LayerArchive::loadLE(p, 8);
+    o.mtime = static_cast<std::int64_t>(LayerArchive::loadLE(p + 8, 8));
+    p += 16;
+  }
+  return true;
+}
+
+// Writes the entry for `key`, replacing any previous one. The entry is
+// written next to `file` and renamed into place, so readers never see a
+// partial entry.
+inline void save(const std::filesystem::path& file,
+                 const Key& key,
+                 const Plan& plan)
+{
+  std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+  LayerArchive::putLE32(out, kVersion);
+  LayerArchive::putLE32(out, static_cast<std::uint32_t>(key.record().size()));
+  out.insert(out.end(), key.record().begin(), key.record().end());
+  LayerArchive::putLE64(out, std::bit_cast<std::uint64_t>(plan.base_z));
+  LayerArchive::putLE32(out, static_cast<std::uint32_t>(plan.layers.size()));
+  LayerArchive::putLE32(out, plan.stored);
+  LayerArchive::putLE32(out, plan.skipped);
+  LayerArchive::putLE32(out, static_cast<std::uint32_t>(plan.outputs.size()));
+  for (std::int32_t id : plan.layers)
+    LayerArchive::putLE32(out, static_cast<std::uint32_t>(id));
+  for (const Output& o : plan.outputs) {
+    LayerArchive::putLE64(out, o.size);
+    LayerArchive::putLE64(out, static_cast<std::uint64_t>(o.mtime));
+  }
+
+  detail::replaceFile(file, out);
+}
+
+/*
+ * Mesh record
+ *
+ * Hashing the STL of a large job reads all of it, which costs far more than
+ * the cache lookup it feeds. The hash is therefore kept per mesh path in the
+ * cache directory, in <hash of the absolute path>.mesh, together with the
+ * size and modification time it was computed for. Like the output check
+ * above, a mesh rewritten with the same size within one file clock tick is
+ * not noticed.
+ *
+ *   char[8]  magic "STRATMSH"
+ *   uint32   version (1)
+ *   uint32   path size
+ *   char[]   absolute path of the mesh
+ *   uint64   size
+ *   int64    modification time, in file clock ticks
+ *   uint64   hash, low word
+ *   uint64   hash, high word
+ */
+inline constexpr char kMeshMagic[8] = {'S', 'T', 'R', 'A', 'T', 'M', 'S', 'H'};
+
+// Content hash of the mesh `stl`, read from its record in `dir` while the
+// file keeps the recorded size and modification time, and recomputed and
+// recorded otherwise.
+inline MaskHash meshHash(const std::filesystem::path& dir,
+                         const std::filesystem::path& stl)
+{
+  std::error_code ec;
+  const std::string path = std::filesystem::absolute(stl, ec).string();
+  Output stat;
+  if (ec || !statOutput(stl, stat))
+    return hashFile(stl);
+
+  std::vector<uint8_t> record(kMeshMagic, kMeshMagic + sizeof(kMeshMagic));
+  LayerArchive::putLE32(record, kVersion);
+  LayerArchive::putLE32(record, static_cast<std::uint32_t>(path.size()));
+  record.insert(record.end(), path.begin(), path.end());
+  LayerArchive::putLE64(record, stat.size);
+  LayerArchive::putLE64(record, static_cast<std::uint64_t>(stat.mtime));
+
+  const std::filesystem::path file = dir
+      / (hexName(hashBytes(reinterpret_cast<const uint8_t*>(path.data()),
+                           path.size(),
+                           0))
+         + ".mesh");
+  {
+    std::ifstream in(file, std::ios::binary);
+    const std::string data {std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>()};
+    if (data.size() == record.size() + 16
+        && std::memcmp(data.data(), record.data(), record.size()) == 0) {
+      const char* p = data.data() + record.size();
+      return {LayerArchive::loadLE(p, 8), LayerArchive::loadLE(p + 8, 8)};
+    }
+  }
+
+  const MaskHash h = hashFile(stl);
+  LayerArchive::putLE64(record, h.lo);
+  LayerArchive::putLE64(record, h.hi);
+  detail::replaceFile(file, record);
+  return h;
+}
+
+}  // namespace LayerCache
+}  // namespace Stratum
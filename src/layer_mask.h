@@ -0,0 +1,236 @@
+#pragma once
+
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace Stratum
+{
+
+// 128-bit content hash of a layer mask, used to detect repeated layers
+// without keeping them.
+struct MaskHash
+{
+  std::uint64_t lo = 0, hi = 0;
+  auto operator<=>(const MaskHash&) const = default;
+};
+
+// Hashes n bytes with two independent multiply-xorshift lanes over 64-bit
+// words, starting from `seed`.
+inline MaskHash hashBytes(const uint8_t* p, std::size_t n, std::uint64_t seed)
+{
+  std::uint64_t a = 0x9E3779B97F4A7C15ull ^ n;
+  std::uint64_t b = 0xC2B2AE3D27D4EB4Full + seed;
+  const auto mix = [](std::uint64_t h, std::uint64_t v, std::uint64_t k)
+  {
+    h ^= v * k;
+    h = (h << 31) | (h >> 33);
+    return h * 0x9FB21C651E98DF25ull;
+  };
+  const std::size_t words = n / 8;
+  for (std::size_t i = 0; i < words; ++i, p += 8) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    a = mix(a, v, 0x87C37B91114253D5ull);
+    b = mix(b, v ^ i, 0x4CF5AD432745937Full);
+  }
+  std::uint64_t tail = 0;
+  if (n > words * 8)
+    std::memcpy(&tail, p, n - words * 8);
+  a = mix(a, tail, 0x87C37B91114253D5ull);
+  b = mix(b, tail ^ words, 0x4CF5AD432745937Full);
+  a ^= a >> 29;
+  b ^= b >> 32;
+  return {a, b};
+}
+
+// Hashes mask bytes; `width` is mixed in so equal bytes of different shapes
+// differ.
+inline MaskHash hashMask(const std::vector<uint8_t>& bytes, int width)
+{
+  return hashBytes(bytes.data(), bytes.size(), static_cast<std::uint64_t>(width));
+}
+
+// Bit-packed layer mask, one bit per pixel. Bits are stored MSB-first and
+// every row starts on a byte boundary, which is the scanline layout of a
+// 1-bit greyscale PNG. Padding bits at the end of a row are always zero.
+class BitMask
+{
+public:
+  BitMask() = default;
+
+  BitMask(int w, int h) { resize(w, h); }
+
+  // Resizes to w x h and clears every pixel. Keeps the allocation when it is
+  // already large enough.
+  void resize(int w, int h)
+  {
+    if (w < 0 || h < 0)
+      throw std::invalid_argument("BitMask dimensions must not be negative");
+    w_ = w;
+    h_ = h;
+    stride_ = (static_cast<std::size_t>(w) + 7) / 8;
+    bits_.assign(stride_ * static_cast<std::size_t>(h), 0);
+  }
+
+  void clear() { std::memset(bits_.data(), 0, bits_.size()); }
+
+  int width() const { return w_; }
+  int height() const { return h_; }
+  std::size_t stride() const { return stride_; }
+  bool empty() const { return bits_.empty(); }
+
+  const std::vector<uint8_t>& bytes() const { return bits_; }
+  uint8_t* data() { return bits_.data(); }
+  const uint8_t* data() const { return bits_.data(); }
+  uint8_t* row(int y) { return bits_.data() + stride_ * y; }
+  const uint8_t* row(int y) const { return bits_.data() + stride_ * y; }
+
+  bool get(int x, int y) const
+  {
+    return (row(y)[x >> 3] >> (7 - (x & 7))) & 1u;
+  }
+
+  void set(int x, int y, bool on = true)
+  {
+    const uint8_t bit = static_cast<uint8_t>(0x80u >> (x & 7));
+    if (on)
+      row(y)[x >> 3] |= bit;
+    else
+      row(y)[x >> 3] &= static_cast<uint8_t>(~bit);
+  }
+
+  // Sets pixels [x0, x1) of row y. Partial bytes at either end are masked and
+  // the whole bytes in between are written with memset, which the compiler
+  // and C library lower to wide vector stores.
+  void setSpan(int y, int x0, int x1) { span(y, x0, x1, true); }
+
+  // Clears pixels [x0, x1) of row y.
+  void clearSpan(int y, int x0, int x1) { span(y, x0, x1, false); }
+
+  // Number of set pixels, counted 64 bits at a time.
+  std::size_t count() const
+  {
+    std::size_t n = 0;
+    const std::size_t words = bits_.size() / 8;
+    const uint8_t* p = bits_.data();
+    for (std::size_t i = 0; i < words; ++i, p += 8) {
+      std::uint64_t v;
+      std::memcpy(&v, p, sizeof(v));
+      n += static_cast<std::size_t>(std::popcount(v));
+    }
+    for (std::size_t i = words * 8; i < bits_.size(); ++i)
+      n += static_cast<std::size_t>(std::popcount(bits_[i]));
+    return n;
+  }
+
+  MaskHash hash() const { return hashMask(bits_, w_); }
+
+  bool operator==(const BitMask& other) const
+  {
+    return w_ == other.w_ && h_ == other.h_ && bits_ == other.bits_;
+  }
+
+private:
+  void span(int y, int x0, int x1, bool on)
+  {
+    if (x0 < 0)
+      x0 = 0;
+    if (x1 > w_)
+      x1 = w_;
+    if (x0 >= x1)
+      return;
+
+    uint8_t* r = row(y);
+    const int b0 = x0 >> 3;
+    const int b1 = (x1 - 1) >> 3;
+    const uint8_t head = static_cast<uint8_t>(0xFFu >> (x0 & 7));
+    const uint8_t tail = static_cast<uint8_t>(0xFFu << (7 - ((x1 - 1) & 7)));
+
+    if (b0 == b1) {
+      apply(r[b0], static_cast<uint8_t>(head & tail), on);
+      return;
+    }
+    apply(r[b0], head, on);
+    if (b1 - b0 > 1)
+      std::memset(r + b0 + 1, on ? 0xFF : 0x00, static_cast<std::size_t>(b1 - b0 - 1));
+    apply(r[b1], tail, on);
+  }
+
+  static void apply(uint8_t& byte, uint8_t bits, bool on)
+  {
+    if (on)
+      byte |= bits;
+    else
+      byte &= static_cast<uint8_t>(~bits);
+  }
+
+  int w_ = 0;
+  int h_ = 0;
+  std::size_t stride_ = 0;
+  std::vector<uint8_t> bits_;
+};
+
+// 8-bit greyscale layer mask, one byte per pixel (0 = off, 255 = full
+// exposure), stored row by row without padding: the scanline layout of an
+// 8-bit greyscale PNG. Used for anti-aliased layers.
+class GreyMask
+{
+public:
+  GreyMask() = default;
+
+  GreyMask(int w, int h) { resize(w, h); }
+
+  // Resizes to w x h and clears every pixel.
+  void resize(int w, int h)
+  {
+    if (w < 0 || h < 0)
+      throw std::invalid_argument("GreyMask dimensions must not be negative");
+    w_ = w;
+    h_ = h;
+    pixels_.assign(static_cast<std::size_t>(w) * static_cast<std::size_t>(h), 0);
+  }
+
+  void clear() { std::memset(pixels_.data(), 0, pixels_.size()); }
+
+  int width() const { return w_; }
+  int height() const { return h_; }
+  std::size_t stride() const { return static_cast<std::size_t>(w_); }
+  bool empty() const { return pixels_.empty(); }
+
+  const std::vector<uint8_t>& bytes() const { return pixels_; }
+  uint8_t* data() { return pixels_.data(); }
+  const uint8_t* data() const { return pixels_.data(); }
+  uint8_t* row(int y) { return pixels_.data() + stride() * y; }
+  const uint8_t* row(int y) const { return pixels_.data() + stride() * y; }
+
+  uint8_t get(int x, int y) const { return row(y)[x]; }
+  void set(int x, int y, uint8_t v) { row(y)[x] = v; }
+
+  // Number of pixels with any exposure.
+  std::size_t count() const
+  {
+    std::size_t n = 0;
+    for (uint8_t v : pixels_)
+      n += v != 0;
+    return n;
+  }
+
+  MaskHash hash() const { return hashMask(pixels_, w_); }
+
+  bool operator==(const GreyMask& other) const
+  {
+    return w_ == other.w_ && h_ == other.h_ && pixels_ == other.pixels_;
+  }
+
+private:
+  int w_ = 0;
+  int h_ = 0;
+  std::vector<uint8_t> pixels_;
+};
+
+}  // namespace Stratum
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define STRATUM_HAS_MMAP 1
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  define STRATUM_HAS_MMAP 0
+#  include <fstream>
+#  include <vector>
+#endif
+
+namespace Stratum
+{
+
+// Read-only view of a whole file. On POSIX hosts the file is memory-mapped so
+// large meshes and G-code jobs can be decoded without an intermediate copy;
+// elsewhere the contents are read into an owned buffer instead.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::filesystem::path& p)
+  {
+#if STRATUM_HAS_MMAP
+    const int fd = ::open(p.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("cannot open " + p.string());
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot stat " + p.string());
+    }
+
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+      void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("cannot map " + p.string());
+      }
+      ::madvise(addr, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+#else
+    std::ifstream f(p, std::ios::binary | std::ios::ate);
+    if (!f)
+      throw std::runtime_error("cannot open " + p.string());
+    buffer_.resize(static_cast<std::size_t>(f.tellg()));
+    f.seekg(0);
+    f.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept { swap(other); }
+
+  MappedFile& operator=(MappedFile&& other) noexcept
+  {
+    if (this != &other) {
+      MappedFile tmp(std::move(other));
+      swap(tmp);
+    }
+    return *this;
+  }
+
+  ~MappedFile()
+  {
+#if STRATUM_HAS_MMAP
+    if (data_ != nullptr)
+      ::munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view view() const { return {data_, size_}; }
+
+private:
+  void swap(MappedFile& other) noexcept
+  {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+#if !STRATUM_HAS_MMAP
+    std::swap(buffer_, other.buffer_);
+#endif
+  }
+
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+#if !STRATUM_HAS_MMAP
+  std::vector<char> buffer_;
+#endif
+};
+
+}  // namespace Stratum
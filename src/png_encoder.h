@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "layer_mask.h"
+#include "lodepng.h"
+
+namespace Stratum
+{
+namespace Png
+{
+
+// Compression levels of MonoPngWriter. kLodepng selects lodepng's own
+// encoder in writeMonoPNG instead.
+inline constexpr int kLodepng = -1;
+inline constexpr int kStore = 0;  // stored deflate blocks, no compression
+inline constexpr int kRle = 1;  // run-length matches, fixed Huffman codes
+inline constexpr int kDeflate = 2;  // lodepng's LZ77 deflate, smallest files
+
+inline const std::array<std::uint32_t, 256>& crcTable()
+{
+  static const std::array<std::uint32_t, 256> table = []
+  {
+    std::array<std::uint32_t, 256> t {};
+    for (std::uint32_t n = 0; n < 256; ++n) {
+      std::uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+// Updates a running CRC-32; start with 0.
+inline std::uint32_t crc32(std::uint32_t crc, const uint8_t* p, std::size_t n)
+{
+  const auto& t = crcTable();
+  crc = ~crc;
+  for (std::size_t i = 0; i < n; ++i)
+    crc = t[(crc ^ p[i]) & 0xFFu] ^ (crc >> 8);
+  return ~crc;
+}
+
+inline void putBE32(std::vector<uint8_t>& out, std::uint32_t v)
+{
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// Working buffers of a MonoPngWriter. Passing the same Buffers to successive
+// writers lets them encode without allocating once the buffers have grown to
+// the image size.
+struct Buffers
+{
+  std::vector<uint8_t> prev;  // previous row, unfiltered
+  std::vector<uint8_t> filtered;  // current row with its filter byte
+  std::vector<uint8_t> pending;  // data not yet compressed
+};
+
+// Streaming encoder for single-channel greyscale PNGs of bit depth 1 or 8.
+// Rows (packed MSB-first as in BitMask at depth 1, one byte per pixel as in
+// GreyMask at depth 8) are filtered and compressed as they arrive and the
+// compressed data is appended to `out` in IDAT chunks of about 64 KiB.
+//
+// Each row uses filter None or Up, whichever breaks fewer byte runs; both
+// cost one pass over the row. At kStore and kRle the deflate stream is
+// produced incrementally; kDeflate buffers the filtered image and hands it to
+// lodepng's compressor in finish().
+class MonoPngWriter
+{
+public:
+  MonoPngWriter(std::vector<uint8_t>& out,
+                int w,
+                int h,
+                int level = kRle,
+                int depth = 1,
+                Buffers* buffers = nullptr)
+      : out_(out)
+      , w_(w)
+      , h_(h)
+      , level_(level < kStore ? kStore : (level > kDeflate ? kDeflate : level))
+      , stride_((static_cast<std::size_t>(w) * (depth == 8 ? 8 : 1) + 7) / 8)
+      , buf_(buffers ? *buffers : own_)
+      , prev_(buf_.prev)
+      , filtered_(buf_.filtered)
+      , pending_(buf_.pending)
+  {
+    if (w <= 0 || h <= 0)
+      throw std::invalid_argument("PNG dimensions must be positive");
+    if (depth != 1 && depth != 8)
+      throw std::invalid_argument("PNG bit depth must be 1 or 8");
+    prev_.assign(stride_, 0);
+    filtered_.resize(stride_ + 1);
+    pending_.clear();
+
+    static constexpr uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    out_.insert(out_.end(), signature, signature + 8);
+
+    beginChunk("IHDR");
+    putBE32(out_, static_cast<std::uint32_t>(w));
+    putBE32(out_, static_cast<std::uint32_t>(h));
+    out_.push_back(static_cast<uint8_t>(depth));  // bit depth
+    out_.push_back(0);  // greyscale
+    out_.push_back(0);  // deflate
+    out_.push_back(0);  // adaptive filtering
+    out_.push_back(0);  // no interlace
+    endChunk();
+
+    if (level_ != kDeflate) {
+      beginChunk("IDAT");
+      out_.push_back(0x78);  // zlib: deflate, 32K window
+      out_.push_back(0x01);  // fastest compression
+      if (level_ == kRle)
+        putBits(0b011, 3);  // one final block with fixed Huffman codes
+    }
+  }
+
+  // Appends the next row of stride() bytes.
+  void writeRow(const uint8_t* row)
+  {
+    if (row_ >= h_)
+      throw std::logic_error("MonoPngWriter: too many rows");
+
+    // Pick None or Up by the number of run breaks each would produce.
+    std::size_t breaks_none = 0, breaks_up = 0;
+    uint8_t last_none = row[0], last_up = static_cast<uint8_t>(row[0] - prev_[0]);
+    for (std::size_t i = 1; i < stride_; ++i) {
+      const uint8_t up = static_cast<uint8_t>(row[i] - prev_[i]);
+      breaks_none += row[i] != last_none;
+      breaks_up += up != last_up;
+      last_none = row[i];
+      last_up = up;
+    }
+    const bool use_up = row_ > 0 && breaks_up < breaks_none;
+
+    filtered_[0] = use_up ? 2 : 0;
+    for (std::size_t i = 0; i < stride_; ++i)
+      filtered_[i + 1] =
+          use_up ? static_cast<uint8_t>(row[i] - prev_[i]) : row[i];
+    std::memcpy(prev_.data(), row, stride_);
+    ++row_;
+
+    compress(filtered_.data(), filtered_.size());
+  }
+
+  // Completes the deflate stream and writes the trailing chunks.
+  void finish()
+  {
+    if (row_ != h_)
+      throw std::logic_error("MonoPngWriter: missing rows");
+
+    if (level_ == kDeflate) {
+      std::vector<uint8_t> zlib;
+      const unsigned err = lodepng::compress(zlib, pending_);
+      if (err)
+        throw std::runtime_error("PNG deflate error: "
+                                 + std::string(lodepng_error_text(err)));
+      for (std::size_t pos = 0; pos < zlib.size(); pos += kChunk) {
+        beginChunk("IDAT");
+        const std::size_t n = std::min(kChunk, zlib.size() - pos);
+        out_.insert(out_.end(), zlib.begin() + pos, zlib.begin() + pos + n);
+        endChunk();
+      }
+    } else {
+      if (level_ == kRle) {
+        flushRun();
+        putCode(256);  // end of block
+      } else {
+        storeBlock(true);
+      }
+      flushBits();
+      const std::uint32_t adler = (adler_b_ << 16) | adler_a_;
+      putBE32(out_, adler);
+      endChunk();
+    }
+
+    beginChunk("IEND");
+    endChunk();
+  }
+
+  std::size_t stride() const { return stride_; }
+
+private:
+  static constexpr std::size_t kChunk = 65536;
+  static constexpr std::size_t kStoredMax = 65535;
+
+  void beginChunk(const char* type)
+  {
+    chunk_start_ = out_.size();
+    putBE32(out_, 0);  // patched in endChunk
+    out_.insert(out_.end(), type, type + 4);
+  }
+
+  void endChunk()
+  {
+    const std::size_t len = out_.size() - chunk_start_ - 8;
+    for (int i = 0; i < 4; ++i)
+      out_[chunk_start_ + i] = static_cast<uint8_t>(len >> (24 - 8 * i));
+    putBE32(out_, crc32(0, out_.data() + chunk_start_ + 4, len + 4));
+  }
+
+  // Starts a new IDAT chunk once the current one is large enough. Deflate
+  // data may be split at any byte boundary.
+  void maybeSplitChunk()
+  {
+    if (out_.size() - chunk_start_ - 8 >= kChunk) {
+      endChunk();
+      beginChunk("IDAT");
+    }
+  }
+
+  void putBits(std::uint32_t bits, int n)
+  {
+    bitbuf_ |= static_cast<std::uint64_t>(bits) << bitcount_;
+    bitcount_ += n;
+    while (bitcount_ >= 8) {
+      out_.push_back(static_cast<uint8_t>(bitbuf_));
+      bitbuf_ >>= 8;
+      bitcount_ -= 8;
+    }
+  }
+
+  void flushBits()
+  {
+    if (bitcount_ > 0)
+      putBits(0, 8 - bitcount_);
+  }
+
+  // Writes a Huffman code MSB-first into the LSB-first bit stream.
+  void putHuffman(std::uint32_t code, int len)
+  {
+    std::uint32_t rev = 0;
+    for (int i = 0; i < len; ++i)
+      rev |= ((code >> i) & 1u) << (len - 1 - i);
+    putBits(rev, len);
+  }
+
+  // Fixed literal/length code (RFC 1951, 3.2.6).
+  void putCode(int sym)
+  {
+    if (sym < 144)
+      putHuffman(0x30 + sym, 8);
+    else if (sym < 256)
+      putHuffman(0x190 + (sym - 144), 9);
+    else if (sym < 280)
+      putHuffman(sym - 256, 7);
+    else
+      putHuffman(0xC0 + (sym - 280), 8);
+  }
+
+  // Emits a distance-1 match of 3..258 bytes.
+  void putMatch(int len)
+  {
+    static constexpr int base[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                   15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                   67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr int extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    int c = 28;
+    while (base[c] > len)
+      --c;
+    putCode(257 + c);
+    if (extra[c] > 0)
+      putBits(static_cast<std::uint32_t>(len - base[c]), extra[c]);
+    putHuffman(0, 5);  // distance code 0 = distance 1
+  }
+
+  void flushRun()
+  {
+    if (run_ >= 3)
+      putMatch(run_);
+    else
+      for (int i = 0; i < run_; ++i)
+        putCode(last_);
+    run_ = 0;
+  }
+
+  void storeBlock(bool final)
+  {
+    putBits(final ? 1 : 0, 3);  // BTYPE 00
+    flushBits();
+    const auto len = static_cast<std::uint16_t>(pending_.size());
+    const auto nlen = static_cast<std::uint16_t>(~len);
+    out_.push_back(static_cast<uint8_t>(len));
+    out_.push_back(static_cast<uint8_t>(len >> 8));
+    out_.push_back(static_cast<uint8_t>(nlen));
+    out_.push_back(static_cast<uint8_t>(nlen >> 8));
+    out_.insert(out_.end(), pending_.begin(), pending_.end());
+    pending_.clear();
+  }
+
+  void updateAdler(const uint8_t* p, std::size_t n)
+  {
+    while (n > 0) {
+      const std::size_t k = n < 5552 ? n : 5552;
+      for (std::size_t i = 0; i < k; ++i) {
+        adler_a_ += p[i];
+        adler_b_ += adler_a_;
+      }
+      adler_a_ %= 65521;
+      adler_b_ %= 65521;
+      p += k;
+      n -= k;
+    }
+  }
+
+  void compress(const uint8_t* p, std::size_t n)
+  {
+    if (level_ == kDeflate) {
+      pending_.insert(pending_.end(), p, p + n);
+      return;
+    }
+
+    updateAdler(p, n);
+    if (level_ == kStore) {
+      while (n > 0) {
+        const std::size_t k = std::min(n, kStoredMax - pending_.size());
+        pending_.insert(pending_.end(), p, p + k);
+        p += k;
+        n -= k;
+        if (pending_.size() == kStoredMax) {
+          storeBlock(false);
+          maybeSplitChunk();
+        }
+      }
+      return;
+    }
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const int b = p[i];
+      if (have_last_ && b == last_) {
+        if (++run_ == 258)
+          flushRun();
+      } else {
+        flushRun();
+        putCode(b);
+        last_ = b;
+        have_last_ = true;
+      }
+    }
+    maybeSplitChunk();
+  }
+
+  std::vector<uint8_t>& out_;
+  int w_, h_;
+  int level_;
+  std::size_t stride_;
+  Buffers own_;
+  Buffers& buf_;
+  std::vector<uint8_t>& prev_;
+  std::vector<uint8_t>& filtered_;
+  std::vector<uint8_t>& pending_;
+  int row_ = 0;
+
+  std::size_t chunk_start_ = 0;
+  std::uint64_t bitbuf_ = 0;
+  int bitcount_ = 0;
+  std::uint32_t adler_a_ = 1, adler_b_ = 0;
+
+  int last_ = 0;
+  bool have_last_ = false;
+  int run_ = 0;
+};
+
+// Encodes a whole BitMask into `out`, replacing its contents.
+inline void encodeMono(std::vector<uint8_t>& out,
+                       const BitMask& mask,
+                       int level = kRle,
+                       Buffers* buffers = nullptr)
+{
+  out.clear();
+  MonoPngWriter png(out, mask.width(), mask.height(), level, 1, buffers);
+  for (int y = 0; y < mask.height(); ++y)
+    png.writeRow(mask.row(y));
+  png.finish();
+}
+
+// Encodes a whole GreyMask as an 8-bit greyscale PNG into `out`, replacing
+// its contents.
+inline void encodeGrey(std::vector<uint8_t>& out,
+                       const GreyMask& mask,
+                       int level = kRle,
+                       Buffers* buffers = nullptr)
+{
+  out.clear();
+  MonoPngWriter png(out, mask.width(), mask.height(), level, 8, buffers);
+  for (int y = 0; y < mask.height(); ++y)
+    png.writeRow(mask.row(y));
+  png.finish();
+}
+
+}  // namespace Png
+}  // namespace Stratum
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <numbers>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <variant>
+#include <vector>
+
+#include "gcode_parser.h"
+
+namespace Stratum
+{
+
+struct EstimatorConfig
+{
+  double xy_acceleration = 0.0;  // mm/s^2, 0 = reach the feed rate at once
+  double z_acceleration = 0.0;  // mm/s^2, 0 = reach the feed rate at once
+  double default_feed = 1000.0;  // mm/min until the first F word
+};
+
+struct LayerEstimate
+{
+  double z = 0.0;  // height of the layer's exposures
+  double time_s = 0.0;
+  double exposure_s = 0.0;
+};
+
+struct PrintEstimate
+{
+  double total_s = 0.0;
+  double exposure_s = 0.0;  // M701 exposures plus laser-on feed moves and dwells
+  double motion_s = 0.0;
+  double dwell_s = 0.0;
+  double travel_mm = 0.0;  // length of every move
+  double rapid_mm = 0.0;  // length of G0 moves
+  std::vector<LayerEstimate> layers;
+};
+
+// Single-pass print-time estimator. Feed it commands in order with add() and
+// read the totals with report().
+//
+// Modal state follows the usual firmware rules: G90/G91 absolute or relative
+// coordinates, G20/G21 inches or millimetres, and a sticky F feed rate that
+// G0 uses as well as G1 (as Marlin does). Each move starts and ends at rest,
+// accelerating at the lowest of the per-axis limits projected onto the move,
+// so times are an upper bound for firmware that blends corners. G2/G3 arcs
+// are measured around their I/J centre. G4 dwells (P ms or S s) and M701
+// layer exposures (S s) add their time; M3/M4 with S > 0 or M42 with S > 0
+// switch the laser on and M5, M3 S0 or M42 S0 switch it off, and feed moves
+// and dwells with the laser on count as exposure. Homing (G28) only resets
+// the position.
+//
+// A new layer starts at the first Z move after a layer has been exposed, so
+// peel lifts and returns stay within their layer. Time before the first
+// exposure belongs to the first layer and time after the last one to the
+// last layer.
+class PrintEstimator
+{
+public:
+  explicit PrintEstimator(const EstimatorConfig& cfg = {})
+      : cfg_(cfg)
+      , feed_(cfg.default_feed)
+  {
+  }
+
+  void add(const CommandView& cmd)
+  {
+    if (cmd.command.size() < 2)
+      return;
+    int code = 0;
+    const char* first = cmd.command.data() + 1;
+    const char* last = cmd.command.data() + cmd.command.size();
+    if (std::from_chars(first, last, code).ec != std::errc())
+      return;
+
+    if (cmd.command[0] == 'G') {
+      switch (code) {
+      case 0:
+      case 1:
+        linear(cmd, code == 0);
+        break;
+      case 2:
+      case 3:
+        arc(cmd, code == 3);
+        break;
+      case 4:
+        dwell(cmd);
+        break;
+      case 20:
+        scale_ = 25.4;
+        break;
+      case 21:
+        scale_ = 1.0;
+        break;
+      case 28:
+        home(cmd);
+        break;
+      case 90:
+        relative_ = false;
+        break;
+      case 91:
+        relative_ = true;
+        break;
+      case 92:
+        for (int a = 0; a < 3; ++a)
+          if (const ArgView* v = find(cmd, kAxes[a]))
+            pos_[a] = v->number * scale_;
+        break;
+      default:
+        break;
+      }
+    } else if (cmd.command[0] == 'M') {
+      switch (code) {
+      case 3:
+      case 4:
+        laser_ = number(cmd, 'S', 1.0) > 0.0;
+        break;
+      case 5:
+        laser_ = false;
+        break;
+      case 42:
+        laser_ = number(cmd, 'S', 0.0) > 0.0;
+        break;
+      case 701: {
+        const double s = std::max(0.0, number(cmd, 'S', 0.0));
+        spend(s, true);
+        break;
+      }
+      default:
+        break;
+      }
+    }
+  }
+
+  void add(const GCodeCommand& cmd)
+  {
+    view_.command = cmd.command;
+    view_.arguments.clear();
+    for (const Arg& a : cmd.arguments) {
+      ArgView arg;
+      arg.letter = a.letter;
+      if (const auto* text = std::get_if<std::string>(&a.value)) {
+        arg.is_text = true;
+        arg.text = *text;
+      } else {
+        arg.number = std::get<double>(a.value);
+      }
+      view_.arguments.push_back(arg);
+    }
+    add(view_);
+  }
+
+  // Parses G-code text, such as generated lines, and adds every command.
+  void addText(std::string_view text)
+  {
+    forEachCommand(text, [this](const CommandView& cmd) { add(cmd); });
+  }
+
+  // The estimate so far, with the open layer closed.
+  PrintEstimate report() const
+  {
+    PrintEstimate r = report_;
+    if (current_.exposure_s > 0.0 || r.layers.empty())
+      r.layers.push_back(current_);
+    else
+      r.layers.back().time_s += current_.time_s;
+    if (r.layers.size() == 1 && r.layers[0].time_s == 0.0)
+      r.layers.clear();
+    return r;
+  }
+
+private:
+  static constexpr char kAxes[3] = {'X', 'Y', 'Z'};
+
+  static const ArgView* find(const CommandView& cmd, char letter)
+  {
+    for (const ArgView& a : cmd.arguments)
+      if (a.letter == letter && !a.is_text)
+        return &a;
+    return nullptr;
+  }
+
+  static double number(const CommandView& cmd, char letter, double fallback)
+  {
+    const ArgView* a = find(cmd, letter);
+    return a ? a->number : fallback;
+  }
+
+  // Reads the target of a move and its feed rate.
+  void target(const CommandView& cmd, double* to)
+  {
+    for (int a = 0; a < 3; ++a) {
+      to[a] = pos_[a];
+      if (const ArgView* v = find(cmd, kAxes[a]))
+        to[a] = relative_ ? pos_[a] + v->number * scale_ : v->number * scale_;
+    }
+    if (const ArgView* f = find(cmd, 'F'))
+      feed_ = f->number * scale_;
+  }
+
+  void linear(const CommandView& cmd, bool rapid)
+  {
+    double to[3];
+    target(cmd, to);
+    const double dx = to[0] - pos_[0], dy = to[1] - pos_[1];
+    const double dz = to[2] - pos_[2];
+    const double xy = std::hypot(dx, dy);
+    move(to, std::hypot(xy, dz), xy, std::abs(dz), rapid);
+  }
+
+  void arc(const CommandView& cmd, bool ccw)
+  {
+    double to[3];
+    const double from[2] = {pos_[0], pos_[1]};
+    target(cmd, to);
+    const ArgView* i = find(cmd, 'I');
+    const ArgView* j = find(cmd, 'J');
+    if (i == nullptr && j == nullptr) {
+      linear(cmd, false);
+      return;
+    }
+    const double cx = from[0] + (i ? i->number * scale_ : 0.0);
+    const double cy = from[1] + (j ? j->number * scale_ : 0.0);
+    const double a0 = std::atan2(from[1] - cy, from[0] - cx);
+    const double a1 = std::atan2(to[1] - cy, to[0] - cx);
+    double sweep = ccw ? a1 - a0 : a0 - a1;
+    if (sweep <= 1e-12)
+      sweep += 2 * std::numbers::pi;  // an equal start and end is a full circle
+    const double xy = std::hypot(from[0] - cx, from[1] - cy) * sweep;
+    const double dz = std::abs(to[2] - pos_[2]);
+    move(to, std::hypot(xy, dz), xy, dz, false);
+  }
+
+  void move(const double* to, double length, double xy, double dz, bool rapid)
+  {
+    if (to[2] != pos_[2]) {
+      if (current_.exposure_s > 0.0) {
+        report_.layers.push_back(current_);
+        current_ = {};
+      }
+      current_.z = to[2];
+    }
+    pos_[0] = to[0];
+    pos_[1] = to[1];
+    pos_[2] = to[2];
+
+    report_.travel_mm += length;
+    if (rapid)
+      report_.rapid_mm += length;
+    const double v = feed_ / 60.0;
+    if (length <= 0.0 || !(v > 0.0))
+      return;
+
+    // Rest-to-rest trapezoid; a triangle when the move is too short to
+    // reach the feed rate.
+    double a = std::numeric_limits<double>::infinity();
+    if (cfg_.xy_acceleration > 0.0 && xy > 0.0)
+      a = std::min(a, cfg_.xy_acceleration * length / xy);
+    if (cfg_.z_acceleration > 0.0 && dz > 0.0)
+      a = std::min(a, cfg_.z_acceleration * length / dz);
+    double t = length / v;
+    if (a < std::numeric_limits<double>::infinity())
+      t = length * a >= v * v ? t + v / a : 2.0 * std::sqrt(length / a);
+    report_.motion_s += t;
+    spend(t, laser_ && !rapid);
+  }
+
+  void dwell(const CommandView& cmd)
+  {
+    double t = 0.0;
+    if (const ArgView* p = find(cmd, 'P'))
+      t = p->number / 1000.0;
+    else if (const ArgView* s = find(cmd, 'S'))
+      t = s->number;
+    t = std::max(0.0, t);
+    report_.dwell_s += t;
+    spend(t, laser_);
+  }
+
+  void home(const CommandView& cmd)
+  {
+    bool any = false;
+    for (int a = 0; a < 3; ++a)
+      if (find(cmd, kAxes[a])) {
+        pos_[a] = 0.0;
+        any = true;
+      }
+    if (!any)
+      pos_[0] = pos_[1] = pos_[2] = 0.0;
+  }
+
+  void spend(double t, bool exposing)
+  {
+    report_.total_s += t;
+    current_.time_s += t;
+    if (exposing) {
+      report_.exposure_s += t;
+      current_.exposure_s += t;
+    }
+  }
+
+  EstimatorConfig cfg_;
+  double pos_[3] = {0.0, 0.0, 0.0};
+  double feed_;  // mm/min
+  double scale_ = 1.0;  // mm per input unit
+  bool relative_ = false;
+  bool laser_ = false;
+  LayerEstimate current_;
+  PrintEstimate report_;
+  CommandView view_;
+};
+
+// Estimates the print time of a G-code file in one pass over its mapping.
+inline PrintEstimate estimatePrint(const std::filesystem::path& gcode,
+                                   const EstimatorConfig& cfg = {})
+{
+  PrintEstimator estimator(cfg);
+  parseMapped(gcode, [&](const CommandView& cmd) { estimator.add(cmd); });
+  return estimator.report();
+}
+
+}  // namespace Stratum
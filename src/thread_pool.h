@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Stratum
+{
+
+// Fixed-size work-stealing pool. Each worker owns a task deque: it pops its
+// own newest task first and steals the oldest task of another worker when its
+// deque runs dry. Tasks submitted from outside the pool are spread round-robin.
+class ThreadPool
+{
+public:
+  // `workers == 0` uses the hardware concurrency.
+  explicit ThreadPool(unsigned workers = 0)
+  {
+    if (workers == 0)
+      workers = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < workers; ++i)
+      queues_.push_back(std::make_unique<Queue>());
+    threads_.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+      threads_.emplace_back([this, i] { run(i); });
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Finishes every queued task, then joins the workers.
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lk(wake_m_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+  }
+
+  unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+  template<typename F>
+  auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+  {
+    using R = std::invoke_result_t<std::decay_t<F>>;
+    auto task =
+        std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+
+    const unsigned q = (current_pool() == this)
+        ? current_index()
+        : next_.fetch_add(1, std::memory_order_relaxed) % size();
+    // Count the task before publishing it so a worker that steals it at
+    // once never decrements pending_ below zero.
+    {
+      std::lock_guard<std::mutex> lk(wake_m_);
+      ++pending_;
+    }
+    {
+      std::lock_guard<std::mutex> lk(queues_[q]->m);
+      queues_[q]->tasks.emplace_back([task] { (*task)(); });
+    }
+    wake_.notify_one();
+    return result;
+  }
+
+private:
+  struct Queue
+  {
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  static const ThreadPool*& current_pool()
+  {
+    thread_local const ThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  static unsigned& current_index()
+  {
+    thread_local unsigned index = 0;
+    return index;
+  }
+
+  bool tryPop(unsigned self, std::function<void()>& task)
+  {
+    {
+      Queue& own = *queues_[self];
+      std::lock_guard<std::mutex> lk(own.m);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (std::size_t k = 1; k < queues_.size(); ++k) {
+      Queue& victim = *queues_[(self + k) % queues_.size()];
+      std::lock_guard<std::mutex> lk(victim.m);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(unsigned self)
+  {
+    current_pool() = this;
+    current_index() = self;
+    std::function<void()> task;
+    while (true) {
+      if (tryPop(self, task)) {
+        {
+          std::lock_guard<std::mutex> lk(wake_m_);
+          --pending_;
+        }
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lk(wake_m_);
+      wake_.wait(lk, [&] { return stop_ || pending_ > 0; });
+      if (stop_ && pending_ == 0)
+        return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex wake_m_;
+  std::condition_variable wake_;
+  std::size_t pending_ = 0;
+  bool stop_ = false;
+  std::atomic<unsigned> next_ {0};
+};
+
+}  // namespace Stratum
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+
+// ASCII STL meshes shared by the generator tests.
+
+// Square pyramid, 4 x 4 x 4.
+inline void writePyramid(const std::filesystem::path& path)
+{
+  std::ofstream out(path);
+  const double b[4][3] = {{0, 0, 0}, {4, 0, 0}, {4, 4, 0}, {0, 4, 0}};
+  const double apex[3] = {2, 2, 4};
+  out << "solid pyramid\n";
+  const auto facet = [&](const double* a, const double* c, const double* d)
+  {
+    out << "facet normal 0 0 0\nouter loop\n";
+    for (const double* v : {a, c, d})
+      out << "vertex " << v[0] << " " << v[1] << " " << v[2] << "\n";
+    out << "endloop\nendfacet\n";
+  };
+  for (int i = 0; i < 4; ++i)
+    facet(b[i], b[(i + 1) % 4], apex);
+  facet(b[0], b[2], b[1]);
+  facet(b[0], b[3], b[2]);
+  out << "endsolid pyramid\n";
+}
+
+// Box 3 x 2 x 2, two triangles per face.
+inline void writeBox(const std::filesystem::path& path)
+{
+  std::ofstream out(path);
+  const double v[8][3] = {{0, 0, 0}, {3, 0, 0}, {3, 2, 0}, {0, 2, 0},
+                          {0, 0, 2}, {3, 0, 2}, {3, 2, 2}, {0, 2, 2}};
+  const int quads[6][4] = {{0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4},
+                           {1, 2, 6, 5}, {2, 3, 7, 6}, {3, 0, 4, 7}};
+  out << "solid box\n";
+  for (const auto& q : quads) {
+    const int tris[2][3] = {{q[0], q[1], q[2]}, {q[0], q[2], q[3]}};
+    for (const auto& t : tris) {
+      out << "facet normal 0 0 0\nouter loop\n";
+      for (int c : t)
+        out << "vertex " << v[c][0] << " " << v[c][1] << " " << v[c][2]
+            << "\n";
+      out << "endloop\nendfacet\n";
+    }
+  }
+  out << "endsolid box\n";
+}
+
+// Tetrahedron with legs of 2 along each axis from the origin.
+inline void writeTetrahedron(const std::filesystem::path& path)
+{
+  std::ofstream out(path);
+  out << "solid t\n";
+  const double v[4][3] = {{0, 0, 0}, {2, 0, 0}, {0, 2, 0}, {0, 0, 2}};
+  const int f[4][3] = {{0, 2, 1}, {0, 1, 3}, {1, 2, 3}, {0, 3, 2}};
+  for (const auto& t : f) {
+    out << "facet normal 0 0 0\nouter loop\n";
+    for (int c : t)
+      out << "vertex " << v[c][0] << " " << v[c][1] << " " << v[c][2] << "\n";
+    out << "endloop\nendfacet\n";
+  }
+  out << "endsolid t\n";
+}
@@ -0,0 +1,138 @@
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gcode_binary.h>
+
+namespace
+{
+std::string slurp(const std::filesystem::path& p)
+{
+  std::ifstream f(p, std::ios::binary);
+  return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+bool sameCommands(const std::vector<Stratum::GCodeCommand>& a,
+                  const std::vector<Stratum::GCodeCommand>& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (a[i].command != b[i].command
+        || a[i].arguments.size() != b[i].arguments.size())
+      return false;
+    for (std::size_t k = 0; k < a[i].arguments.size(); ++k)
+      if (a[i].arguments[k].letter != b[i].arguments[k].letter
+          || a[i].arguments[k].value != b[i].arguments[k].value)
+        return false;
+  }
+  return true;
+}
+
+template<typename Fn>
+bool throws(Fn&& fn)
+{
+  try {
+    fn();
+  } catch (const std::exception&) {
+    return true;
+  }
+  return false;
+}
+}  // namespace
+
+int main()
+{
+  namespace Bin = Stratum::GCodeBinary;
+  const std::filesystem::path text = "job.gcode";
+  const std::filesystem::path binary = "job.sgcb";
+  const std::filesystem::path back = "job_back.gcode";
+  const std::filesystem::path again = "job_again.sgcb";
+
+  {
+    std::ofstream out(text, std::ios::binary);
+    out << "; **** SLA Print ****\n";
+    out << "G21\nG90\nG28\n";
+    for (int layer = 1; layer <= 50; ++layer) {
+      out << "; Layer " << layer << "\r\n";
+      out << "G0 Z" << layer * 0.05 << " F300.0000\n";
+      out << "M701 P\"layer" << layer << ".png\" S2.5 ; expose\n";
+      for (int i = 0; i < 20; ++i)
+        out << "G1 X" << i * 0.1 + 1.0 / 3 << " Y-" << layer * 1e-7
+            << " F1200\n";
+      out << "M6054 A1 B2 C3 D4 E5 F6 G7 H8 I9 J10\n";
+    }
+    out << "M3 S\n";
+    out << "M30\n";
+  }
+
+  std::vector<Stratum::GCodeCommand> parsed;
+  Stratum::parseFile(text, std::back_inserter(parsed));
+
+  // Text -> binary keeps every command exactly.
+  Bin::encode(text, binary);
+  const Bin::Reader reader(binary);
+  assert(reader.size() == parsed.size());
+  std::vector<Stratum::GCodeCommand> loaded;
+  reader.forEach([&](const Stratum::CommandView& cmd)
+                 { loaded.push_back(Stratum::toCommand(cmd)); });
+  assert(sameCommands(loaded, parsed));
+  assert(sameCommands({reader.command(5)}, {parsed[5]}));
+
+  // Quoted values point into the mapped string pool.
+  Stratum::CommandView view;
+  reader.command(4, view);
+  assert(view.command == "M701");
+  assert(view.arguments[0].is_text && view.arguments[0].text == "layer1.png");
+
+  // Binary -> text -> binary is lossless.
+  Bin::decode(binary, back);
+  std::vector<Stratum::GCodeCommand> reparsed;
+  Stratum::parseFile(back, std::back_inserter(reparsed));
+  assert(sameCommands(reparsed, parsed));
+  Bin::encode(back, again);
+  assert(slurp(again) == slurp(binary));
+
+  // Owning commands encode the same way as parsed views.
+  {
+    Bin::Writer writer(again);
+    for (const auto& cmd : parsed)
+      writer.add(cmd);
+    assert(writer.size() == parsed.size());
+  }
+  assert(slurp(again) == slurp(binary));
+
+  // Damaged files are rejected.
+  std::string bytes = slurp(binary);
+  {
+    std::ofstream out(again, std::ios::binary);
+    out << bytes.substr(0, bytes.size() - 1);
+  }
+  assert(throws([&] { Bin::Reader bad(again); }));
+  bytes[0] = 'X';
+  {
+    std::ofstream out(again, std::ios::binary);
+    out << bytes;
+  }
+  assert(throws([&] { Bin::Reader bad(again); }));
+
+  // Values the text form cannot carry are refused rather than altered.
+  std::vector<std::string> lines;
+  Stratum::GCodeEmitter gcode {Stratum::LineSink(std::back_inserter(lines))};
+  Stratum::CommandView nan;
+  nan.command = "G1";
+  nan.arguments.push_back({'X', false, std::numeric_limits<double>::quiet_NaN(), {}});
+  assert(throws([&] { Bin::emitCommand(gcode, nan); }));
+
+  std::filesystem::remove(text);
+  std::filesystem::remove(binary);
+  std::filesystem::remove(back);
+  std::filesystem::remove(again);
+  return 0;
+}
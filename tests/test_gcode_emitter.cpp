@@ -0,0 +1,132 @@
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gcode_generator.h>
+
+#include "stl_fixtures.h"
+
+namespace
+{
+// Keeps every block handed to it.
+struct RecordingSink
+{
+  std::vector<std::string>* blocks;
+  void operator()(std::string_view b) { blocks->emplace_back(b); }
+};
+
+std::string slurp(const std::filesystem::path& p)
+{
+  std::ifstream f(p, std::ios::binary);
+  return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+}  // namespace
+
+int main()
+{
+  // Numbers are formatted exactly as the ostream code they replace.
+  const double values[] = {0.0,     -0.0,    1.0,       -2.5,   0.00005,
+                           0.00004, 123.456, -987.65432, 1e-7, 1e7,
+                           3.14159265358979, 99999.99995, 0.1 + 0.2};
+  std::vector<std::string> lines;
+  {
+    Stratum::GCodeEmitter gcode {
+        Stratum::LineSink(std::back_inserter(lines)), 0};
+    for (double v : values) {
+      gcode.text("G1").fixed('X', v).general('S', v).end();
+      gcode.text("; ").number(v, 6).end();
+    }
+    gcode.text("M701 P\"layer").digits(7, 4).text(".png\"").integer('I', -3);
+    gcode.end();
+  }
+  std::size_t k = 0;
+  for (double v : values) {
+    std::ostringstream a;
+    a << "G1 X" << std::fixed << std::setprecision(4) << v;
+    std::ostringstream b;
+    b << " S" << v;
+    assert(lines[k++] == a.str() + b.str());
+    assert(lines[k++] == "; " + std::to_string(v));
+  }
+  assert(lines[k++] == "M701 P\"layer0007.png\" I-3");
+  assert(k == lines.size());
+
+  // Text reaches the sink in blocks of whole lines once the block size is
+  // reached, and the rest on destruction.
+  std::vector<std::string> blocks;
+  {
+    Stratum::GCodeEmitter gcode {RecordingSink {&blocks}, 64};
+    for (int i = 0; i < 20; ++i)
+      gcode.text("G0").integer('X', i).end();
+    assert(!blocks.empty());
+    gcode.text("G1");  // incomplete lines stay in the buffer
+    gcode.flush();
+    gcode.end();
+  }
+  std::string joined;
+  for (const auto& b : blocks) {
+    assert(b.back() == '\n');
+    joined += b;
+  }
+  std::string expected;
+  for (int i = 0; i < 20; ++i)
+    expected += "G0 X" + std::to_string(i) + "\n";
+  assert(joined == expected + "G1\n");
+
+  // Lines longer than the buffer are kept whole.
+  blocks.clear();
+  {
+    Stratum::GCodeEmitter gcode {RecordingSink {&blocks}, 16};
+    gcode.comment(std::string(10000, 'x'));
+  }
+  assert(blocks.size() == 1 && blocks[0].size() == 10003);
+
+  // The output-iterator helpers write one line each.
+  {
+    std::vector<std::string> lines;
+    auto out = std::back_inserter(lines);
+    Stratum::comment(out, "note");
+    Stratum::cmd(out, "G28");
+    assert((lines == std::vector<std::string> {"; note", "G28"}));
+  }
+
+  // File output matches the output-iterator interface.
+  const std::filesystem::path stl = "emitter_test.stl";
+  writeTetrahedron(stl);
+  Stratum::SLAConfig sla;
+  sla.spot_radius = 0.05;
+  sla.layer_height = 0.2;
+  std::vector<std::string> gcode;
+  Stratum::generateGCode(stl, sla, std::back_inserter(gcode));
+  const std::filesystem::path file = "emitter_test.gcode";
+  Stratum::writeGCodeFile(stl, sla, file);
+  std::string text;
+  for (const auto& line : gcode)
+    text += line + "\n";
+  assert(gcode.size() > 100 && slurp(file) == text);
+
+#if STRATUM_HAS_FD
+  std::FILE* tmp = std::tmpfile();
+  {
+    Stratum::GCodeEmitter fd_gcode {Stratum::FdSink(fileno(tmp))};
+    Stratum::generateGCode(stl, sla, fd_gcode);
+  }
+  std::rewind(tmp);
+  std::string from_fd;
+  for (int c; (c = std::fgetc(tmp)) != EOF;)
+    from_fd.push_back(static_cast<char>(c));
+  std::fclose(tmp);
+  assert(from_fd == text);
+#endif
+
+  std::filesystem::remove(stl);
+  std::filesystem::remove(file);
+  return 0;
+}
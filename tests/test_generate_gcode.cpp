@@ -1,11 +1,81 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include <gcode_generator.h>
 
+#include "stl_fixtures.h"
+
+namespace
+{
+std::string slurp(const std::filesystem::path& p)
+{
+  std::ifstream f(p, std::ios::binary);
+  return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+std::vector<std::string> exposures(const std::vector<std::string>& gcode)
+{
+  std::vector<std::string> m701;
+  for (const auto& line : gcode)
+    if (line.rfind("M701", 0) == 0)
+      m701.push_back(line);
+  return m701;
+}
+
+// Output iterator that checks, as each exposure line arrives, that its mask
+// is on disk and the next layer's is not yet.
+struct ProgressProbe
+{
+  std::filesystem::path dir;
+  int* seen;
+
+  ProgressProbe& operator*() { return *this; }
+  ProgressProbe& operator++() { return *this; }
+  ProgressProbe operator++(int) { return *this; }
+  ProgressProbe& operator=(const std::string& line)
+  {
+    if (line.rfind("M701 P\"layer", 0) == 0) {
+      const int layer = std::stoi(line.substr(12, 4));
+      char next[32];
+      std::snprintf(next, sizeof(next), "layer%04d.png", layer + 1);
+      assert(std::filesystem::exists(dir / line.substr(7, 13)));
+      assert(!std::filesystem::exists(dir / next));
+      ++*seen;
+    }
+    return *this;
+  }
+};
+
+// Scanline kernel that counts the layers it rasterizes.
+struct CountingKernel
+{
+  static constexpr std::string_view kName = "counting";
+  static inline int calls = 0;
+
+  template<typename SpanFn>
+  static void spans(int w,
+                    int h,
+                    double pitch,
+                    const std::vector<Stratum::Slicer::Segment2D>& segments,
+                    double offset_x,
+                    double offset_y,
+                    SpanFn&& fill,
+                    Stratum::Slicer::RasterScratch& scratch)
+  {
+    ++calls;
+    Stratum::Slicer::ScanlineKernel::spans(
+        w, h, pitch, segments, offset_x, offset_y, fill, scratch);
+  }
+};
+}  // namespace
+
 int main()
 {
   const std::filesystem::path path = "test.stl";
@@ -40,5 +110,136 @@ int main()
 
   std::filesystem::remove(path);
   std::filesystem::remove_all(cfg.png_dir);
+
+  // The parallel layer pipeline produces the same G-code and masks.
+  const std::filesystem::path pyramid = "pyramid.stl";
+  writePyramid(pyramid);
+
+  Stratum::DLPConfig dlp;
+  dlp.cols = 64;
+  dlp.rows = 48;
+  dlp.pixel_pitch_mm = 0.1;
+  dlp.layer_height = 0.2;
+  dlp.png_dir = "layers_serial";
+
+  std::vector<std::string> serial;
+  Stratum::generateGCode(pyramid, dlp, std::back_inserter(serial));
+
+  dlp.png_dir = "layers_parallel";
+  dlp.workers = 4;
+  dlp.max_inflight_layers = 3;
+  std::vector<std::string> parallel;
+  Stratum::generateGCode(pyramid, dlp, std::back_inserter(parallel));
+
+  assert(serial.size() == parallel.size());
+  for (std::size_t i = 0; i + 1 < serial.size(); ++i)
+    assert(serial[i] == parallel[i]);
+  int layers = 0;
+  for (const auto& e : std::filesystem::directory_iterator("layers_serial")) {
+    assert(slurp(e.path())
+           == slurp("layers_parallel" / e.path().filename()));
+    ++layers;
+  }
+  assert(layers == 20);
+
+  // Every layer of a box has the same mask: one PNG is written and reused.
+  const std::filesystem::path box = "box.stl";
+  writeBox(box);
+  dlp.png_dir = "layers_dedup";
+  dlp.workers = 1;
+  dlp.layer_height = 0.25;
+  std::vector<std::string> dedup;
+  Stratum::generateGCode(box, dlp, std::back_inserter(dedup));
+  const auto reused = exposures(dedup);
+  assert(reused.size() == 8);
+  for (const auto& line : reused)
+    assert(line.rfind("M701 P\"layer0001.png\" ", 0) == 0);
+
+  // The dedup ratio is noted in the G-code only on request.
+  const auto summary = [](const std::vector<std::string>& gcode)
+  {
+    return std::count_if(gcode.begin(),
+                         gcode.end(),
+                         [](const std::string& line)
+                         {
+                           return line.rfind(
+                                      "; Layer masks: 1 stored for 8 layers, "
+                                      "7 reused",
+                                      0)
+                               == 0;
+                         });
+  };
+  assert(summary(dedup) == 0);
+  dlp.dedup_summary = true;
+  std::vector<std::string> noted;
+  Stratum::generateGCode(box, dlp, std::back_inserter(noted));
+  assert(summary(noted) == 1 && noted.size() == dedup.size() + 1);
+  dlp.dedup_summary = false;
+  assert(std::distance(std::filesystem::directory_iterator("layers_dedup"),
+                       std::filesystem::directory_iterator())
+         == 1);
+
+  // Without dedup every layer gets its own, identical file.
+  dlp.png_dir = "layers_nodedup";
+  dlp.dedup_layers = false;
+  std::vector<std::string> plain;
+  Stratum::generateGCode(box, dlp, std::back_inserter(plain));
+  assert(exposures(plain).size() == 8);
+  for (const auto& e : std::filesystem::directory_iterator("layers_nodedup"))
+    assert(slurp(e.path()) == slurp("layers_dedup/layer0001.png"));
+
+  // The raster engine takes its mask format and span kernel as policies:
+  // byte masks match single-sample coverage masks exactly.
+  const auto engine = [&](auto run, const char* dir)
+  {
+    dlp.png_dir = dir;
+    std::vector<std::string> lines;
+    Stratum::GCodeEmitter gcode {Stratum::LineSink(std::back_inserter(lines))};
+    run(gcode);
+    gcode.flush();
+    return lines;
+  };
+  dlp.dedup_layers = true;
+  const auto bytes = engine(
+      [&](auto& gcode)
+      {
+        Stratum::generateMaskGCode<Stratum::Raster::PixelPitch,
+                                   Stratum::Raster::Bytes>(pyramid, dlp, gcode);
+      },
+      "layers_bytes");
+  const auto coverage = engine(
+      [&](auto& gcode)
+      {
+        Stratum::generateMaskGCode<Stratum::Raster::PixelPitch,
+                                   Stratum::Raster::Greyscale,
+                                   CountingKernel>(pyramid, dlp, gcode);
+      },
+      "layers_coverage");
+  assert(bytes.size() == coverage.size());
+  for (std::size_t i = 0; i + 1 < bytes.size(); ++i)
+    assert(bytes[i] == coverage[i]);
+  assert(exposures(bytes).size() == 16);
+  assert(CountingKernel::calls == 16);
+  for (const auto& e : std::filesystem::directory_iterator("layers_bytes"))
+    assert(slurp(e.path()) == slurp("layers_coverage" / e.path().filename()));
+
+  // The iterator overload hands over every line as it is generated, so a
+  // consumer can follow the job layer by layer.
+  dlp.png_dir = "layers_progress";
+  dlp.dedup_layers = false;
+  std::filesystem::remove_all(dlp.png_dir);
+  int progress = 0;
+  Stratum::generateGCode(pyramid, dlp, ProgressProbe {dlp.png_dir, &progress});
+  assert(progress == 16);
+  std::filesystem::remove_all("layers_progress");
+
+  std::filesystem::remove_all("layers_bytes");
+  std::filesystem::remove_all("layers_coverage");
+  std::filesystem::remove(box);
+  std::filesystem::remove_all("layers_dedup");
+  std::filesystem::remove_all("layers_nodedup");
+  std::filesystem::remove(pyramid);
+  std::filesystem::remove_all("layers_serial");
+  std::filesystem::remove_all("layers_parallel");
   return 0;
 }
@@ -0,0 +1,111 @@
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <gcode_generator.h>
+
+using Stratum::Slicer::Triangle;
+using Stratum::Slicer::Vec3;
+
+namespace
+{
+// Unit cube with outward-facing (counter-clockwise) triangles.
+std::vector<Triangle> cube()
+{
+  const Vec3 v[8] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                     {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+  const int f[12][3] = {{0, 2, 1}, {0, 3, 2}, {4, 5, 6}, {4, 6, 7},
+                        {0, 1, 5}, {0, 5, 4}, {1, 2, 6}, {1, 6, 5},
+                        {2, 3, 7}, {2, 7, 6}, {3, 0, 4}, {3, 4, 7}};
+  std::vector<Triangle> tris;
+  for (const auto& t : f)
+    tris.push_back({v[t[0]], v[t[1]], v[t[2]]});
+  return tris;
+}
+
+double signedArea(const std::vector<Stratum::Slicer::Vec2>& p)
+{
+  double a = 0.0;
+  for (std::size_t i = 0; i < p.size(); ++i) {
+    const auto& q = p[(i + 1) % p.size()];
+    a += p[i].x * q.y - q.x * p[i].y;
+  }
+  return a / 2.0;
+}
+}  // namespace
+
+int main()
+{
+  const auto tris = cube();
+  const auto mesh = Stratum::Slicer::buildIndexedMesh(tris);
+  assert(mesh.vertexCount() == 8);
+  assert(mesh.faceCount() == 12);
+  for (std::size_t f = 0; f < mesh.faceCount(); ++f) {
+    for (int e = 0; e < 3; ++e) {
+      const auto g = mesh.adjacent[3 * f + e];
+      assert(g != Stratum::Slicer::kNoFace);
+      bool back = false;
+      for (int k = 0; k < 3; ++k)
+        back = back || mesh.adjacent[3 * g + k] == f;
+      assert(back);
+    }
+  }
+
+  // A closed mesh slices into one closed, consistently oriented loop that
+  // covers the same segments as the triangle-soup slicer.
+  Stratum::Slicer::ContourSlicer<double> slicer(mesh);
+  const auto contours = slicer.slice(0.5);
+  assert(contours.size() == 1);
+  assert(contours[0].closed);
+  assert(contours[0].points.size() == 8);
+  assert(std::abs(std::abs(signedArea(contours[0].points)) - 1.0) < 1e-12);
+  assert(Stratum::Slicer::contourSegments(contours).size()
+         == Stratum::Slicer::sliceTriangles(tris, 0.5).size());
+  assert(slicer.slice(2.0).empty());
+
+  // Float storage welds the same way.
+  const auto fmesh = Stratum::Slicer::buildIndexedMesh<float>(tris);
+  assert(fmesh.vertexCount() == 8);
+  Stratum::Slicer::ContourSlicer<float> fslicer(fmesh);
+  assert(fslicer.slice(0.25).size() == 1);
+
+  // Removing a side face leaves a single open polyline.
+  auto open = tris;
+  open.erase(open.begin() + 4);
+  const auto omesh = Stratum::Slicer::buildIndexedMesh(open);
+  Stratum::Slicer::ContourSlicer<double> oslicer(omesh);
+  const auto pieces = oslicer.slice(0.5);
+  assert(pieces.size() == 1);
+  assert(!pieces[0].closed);
+  assert(pieces[0].points.size() == 8);
+  assert(contours[0].area == signedArea(contours[0].points));
+
+  // The stitcher rejoins shuffled, reversed segments whose endpoints differ
+  // by less than the tolerance, and returns an open chain in one piece.
+  using Stratum::Slicer::Segment2D;
+  const std::vector<Segment2D> soup = {
+      {{1, 1}, {0, 1}},
+      {{5, 0}, {6, 0}},
+      {{0, 0}, {1, 0 + 1e-9}},
+      {{0, 1}, {0, 1e-8}},
+      {{6, 0}, {6, 1}},
+      {{1, 1}, {1, 0}},
+      {{2, 2}, {2, 2}},
+  };
+  const auto stitched = Stratum::Slicer::stitchContours(soup);
+  assert(stitched.size() == 2);
+  const auto& chain = stitched[0];
+  assert(!chain.closed && chain.points.size() == 3);
+  assert(chain.points.front().x == 5 || chain.points.back().x == 5);
+  const auto& square = stitched[1];
+  assert(square.closed && square.points.size() == 4);
+  assert(std::abs(std::abs(square.area) - 1.0) < 1e-6);
+  assert(square.area == signedArea(square.points));
+
+  // Stitching the open slice of the cracked cube gives back its polyline.
+  const auto rejoined = Stratum::Slicer::stitchContours(
+      Stratum::Slicer::contourSegments(pieces));
+  assert(rejoined.size() == 1 && !rejoined[0].closed);
+  assert(rejoined[0].points.size() == 8);
+  return 0;
+}
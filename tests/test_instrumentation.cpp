@@ -0,0 +1,153 @@
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gcode_generator.h>
+#include <gcode_parser.h>
+
+#include "stl_fixtures.h"
+
+namespace
+{
+using Stratum::Instrument::Counter;
+using Stratum::Instrument::Profile;
+
+// Layers seen per stage.
+std::map<std::string, std::set<int>> stageLayers(const Profile& profile)
+{
+  std::map<std::string, std::set<int>> stages;
+  for (const auto& e : profile.events())
+    stages[e.stage].insert(e.layer);
+  return stages;
+}
+
+std::uintmax_t directoryBytes(const std::filesystem::path& dir)
+{
+  std::uintmax_t n = 0;
+  for (const auto& e : std::filesystem::directory_iterator(dir))
+    n += e.file_size();
+  return n;
+}
+}  // namespace
+
+int main()
+{
+  const std::filesystem::path pyramid = "instrumented_pyramid.stl";
+  writePyramid(pyramid);
+
+  Stratum::DLPConfig dlp;
+  dlp.cols = 64;
+  dlp.rows = 48;
+  dlp.pixel_pitch_mm = 0.1;
+  dlp.layer_height = 0.2;
+  dlp.png_dir = "instrumented_serial";
+
+  // Nothing is recorded without an attached profile.
+  std::vector<std::string> unobserved;
+  Stratum::generateGCode(pyramid, dlp, std::back_inserter(unobserved));
+  assert(Stratum::Instrument::current() == nullptr);
+
+  // Every layer is sliced, rasterized, encoded and emitted once; the
+  // counters add up across layers.
+  Profile serial;
+  std::vector<std::string> gcode;
+  {
+    Stratum::Instrument::Attach attach(serial);
+    Stratum::generateGCode(pyramid, dlp, std::back_inserter(gcode));
+  }
+  assert(gcode == unobserved);
+  auto stages = stageLayers(serial);
+  assert(stages["read_stl"] == std::set<int> {-1});
+  assert(stages["generate"] == std::set<int> {-1});
+  for (const char* stage : {"slice", "rasterize", "encode", "emit"}) {
+    assert(stages[stage].size() == 20);
+    assert(*stages[stage].begin() == 0 && *stages[stage].rbegin() == 19);
+  }
+  assert(serial.events().size() == 2 + 4 * 20);
+  assert(serial.counter(Counter::TrianglesTested) > 0);
+  assert(serial.counter(Counter::Segments) >= 4 * 20);
+  assert(serial.counter(Counter::PixelsSet) > 0);
+  assert(serial.counter(Counter::BytesEncoded) == directoryBytes(dlp.png_dir));
+  assert(serial.counter(Counter::MasksStored)
+         == static_cast<std::uint64_t>(std::distance(
+             std::filesystem::directory_iterator(dlp.png_dir),
+             std::filesystem::directory_iterator())));
+  assert(serial.counter(Counter::MasksStored)
+             + serial.counter(Counter::MasksReused)
+         == 20);
+  assert(serial.counter(Counter::Allocations) > 0);
+  assert(serial.peakRss() > 0);
+
+  // The worker pipeline records the same stages from its own threads.
+  Profile parallel;
+  dlp.png_dir = "instrumented_parallel";
+  dlp.workers = 2;
+  {
+    Stratum::Instrument::Attach attach(parallel);
+    Stratum::writeGCodeFile(pyramid, dlp, "instrumented.gcode");
+  }
+  stages = stageLayers(parallel);
+  for (const char* stage : {"slice", "rasterize", "encode", "emit"})
+    assert(stages[stage].size() == 20);
+  for (Counter c : {Counter::TrianglesTested,
+                    Counter::Segments,
+                    Counter::PixelsSet,
+                    Counter::BytesEncoded,
+                    Counter::MasksStored,
+                    Counter::MasksReused})
+    assert(parallel.counter(c) == serial.counter(c));
+
+  // Parsing counts the commands it hands out.
+  Profile parse;
+  std::vector<Stratum::GCodeCommand> commands;
+  {
+    Stratum::Instrument::Attach attach(parse);
+    Stratum::parseFile("instrumented.gcode", std::back_inserter(commands));
+  }
+  assert(parse.counter(Counter::Commands) == commands.size());
+  assert(stageLayers(parse)["parse_gcode"] == std::set<int> {-1});
+
+  // Laser SLA splits each layer into slicing, contours and hatching.
+  Stratum::SLAConfig sla;
+  sla.spot_radius = 0.1;
+  sla.layer_height = 0.5;
+  Profile laser;
+  std::vector<std::string> sla_gcode;
+  {
+    Stratum::Instrument::Attach attach(laser);
+    Stratum::generateGCode(pyramid, sla, std::back_inserter(sla_gcode));
+  }
+  stages = stageLayers(laser);
+  assert(stages["slice"].size() == 8);
+  assert(stages["contours"].size() == 8);
+  assert(stages["hatch"].size() == 8);
+  assert(laser.counter(Counter::Segments) > 0);
+
+  // Both exports carry the per-layer stages and the counters.
+  std::ostringstream json, trace;
+  serial.writeJson(json);
+  serial.writeChromeTrace(trace);
+  assert(json.str().find("\"slice\": {\"count\": 20,") != std::string::npos);
+  assert(json.str().find("{\"layer\": 19, ") != std::string::npos);
+  assert(json.str().find("\"pixels_set\": "
+                         + std::to_string(serial.counter(Counter::PixelsSet)))
+         != std::string::npos);
+  assert(trace.str().rfind("{\"traceEvents\": [", 0) == 0);
+  assert(trace.str().find("\"name\": \"rasterize\", \"ph\": \"X\"")
+         != std::string::npos);
+  assert(trace.str().find("\"args\": {\"layer\": 19}") != std::string::npos);
+  assert(trace.str().find("\"ph\": \"C\"") != std::string::npos);
+
+  std::filesystem::remove(pyramid);
+  std::filesystem::remove("instrumented.gcode");
+  std::filesystem::remove_all("instrumented_serial");
+  std::filesystem::remove_all("instrumented_parallel");
+  return 0;
+}
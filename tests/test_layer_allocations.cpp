@@ -0,0 +1,93 @@
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <gcode_generator.h>
+
+namespace
+{
+// Records the allocation count when the header's G90 line and every M701
+// line arrive, without allocating itself.
+struct ExposureProbe
+{
+  std::vector<long>* counts;
+
+  ExposureProbe& operator*() { return *this; }
+  ExposureProbe& operator++() { return *this; }
+  ExposureProbe operator++(int) { return *this; }
+  ExposureProbe& operator=(const std::string& line)
+  {
+    if (line == "G90" || line.rfind("M701", 0) == 0)
+      counts->push_back(static_cast<long>(
+          Stratum::Instrument::allocationCount().load()));
+    return *this;
+  }
+};
+
+// Cone of radius 3 and height 4 with 96 sides, so every layer differs and
+// none is larger than the first.
+void writeCone(const std::filesystem::path& path)
+{
+  std::ofstream out(path);
+  const int n = 96;
+  const double pi = std::acos(-1.0);
+  const auto facet = [&](double ax, double ay, double az,
+                         double bx, double by, double bz,
+                         double cx, double cy, double cz)
+  {
+    out << "facet normal 0 0 0\nouter loop\n"
+        << "vertex " << ax << " " << ay << " " << az << "\n"
+        << "vertex " << bx << " " << by << " " << bz << "\n"
+        << "vertex " << cx << " " << cy << " " << cz << "\n"
+        << "endloop\nendfacet\n";
+  };
+  out << "solid cone\n";
+  for (int i = 0; i < n; ++i) {
+    const double a0 = 2 * pi * i / n, a1 = 2 * pi * (i + 1) / n;
+    const double x0 = 3 * std::cos(a0), y0 = 3 * std::sin(a0);
+    const double x1 = 3 * std::cos(a1), y1 = 3 * std::sin(a1);
+    facet(x0, y0, 0, x1, y1, 0, 0, 0, 4);
+    facet(0, 0, 0, x1, y1, 0, x0, y0, 0);
+  }
+  out << "endsolid cone\n";
+}
+}  // namespace
+
+int main()
+{
+  const std::filesystem::path stl = "alloc_cone.stl";
+  writeCone(stl);
+
+  Stratum::DLPConfig cfg;
+  cfg.cols = 160;
+  cfg.rows = 120;
+  cfg.pixel_pitch_mm = 0.05;
+  cfg.layer_height = 0.1;
+  cfg.archive_path = "alloc_test/job.slyr";
+
+  // After the first layer, slicing, rasterizing, encoding, storing and
+  // emitting a layer allocate nothing, for binary and anti-aliased masks.
+  for (int antialias : {1, 4}) {
+    cfg.antialias = antialias;
+    std::vector<long> counts;
+    counts.reserve(1024);
+    {
+      // Block size 0 hands every line to the probe as soon as it ends.
+      Stratum::GCodeEmitter gcode {Stratum::LineSink(ExposureProbe {&counts}),
+                                   0};
+      Stratum::generateGCode(stl, cfg, gcode);
+    }
+    assert(counts.size() == 1 + 40);
+    // The first layer sizes the buffers, so sampling really happens during
+    // the run; from then on every exposure sees the same count.
+    assert(counts[0] < counts[1]);
+    assert(counts.back() == counts[1]);
+  }
+
+  std::filesystem::remove(stl);
+  std::filesystem::remove_all("alloc_test");
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gcode_generator.h>
+
+#include "stl_fixtures.h"
+
+int main()
+{
+  // Round trip in every encoding, including an empty and a full layer.
+  std::vector<Stratum::BitMask> masks;
+  for (int k = 0; k < 4; ++k) {
+    Stratum::BitMask m(45, 31);
+    for (int y = 0; y < m.height(); ++y) {
+      if (k == 1)
+        m.setSpan(y, 0, m.width());
+      else if (k >= 2)
+        m.setSpan(y, (y * k) % 20, 20 + (y * 7) % 25);
+    }
+    masks.push_back(m);
+  }
+
+  const std::filesystem::path file = "layers_test.slyr";
+  for (std::uint32_t enc : {Stratum::LayerArchive::kRaw,
+                            Stratum::LayerArchive::kRle,
+                            Stratum::LayerArchive::kDeflate})
+  {
+    {
+      Stratum::LayerArchive::Writer w(file, 45, 31, enc);
+      for (std::size_t i = 0; i < masks.size(); ++i)
+        assert(w.add(masks[i]) == i);
+      w.close();
+    }
+    Stratum::LayerArchive::Reader r(file);
+    assert(r.width() == 45 && r.height() == 31);
+    assert(r.encoding() == enc);
+    assert(r.size() == masks.size());
+    Stratum::BitMask out;
+    for (std::uint32_t i = r.size(); i-- > 0;) {
+      r.layer(i, out);
+      assert(out == masks[i]);
+    }
+    if (enc == Stratum::LayerArchive::kRle)
+      assert(r.payload(0).size() < masks[0].bytes().size() / 8);
+
+    bool threw = false;
+    try {
+      r.payload(r.size());
+    } catch (const std::out_of_range&) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
+  // Greyscale layers need a depth 8 archive.
+  {
+    Stratum::GreyMask g(45, 31);
+    for (int y = 0; y < g.height(); ++y)
+      for (int x = 0; x < g.width(); ++x)
+        g.set(x, y, static_cast<uint8_t>((x * 7 + y * 3) & 0xFF));
+    {
+      Stratum::LayerArchive::Writer w(
+          file, 45, 31, Stratum::LayerArchive::kDeflate, 8);
+      w.add(g);
+      bool threw = false;
+      try {
+        w.add(masks[0]);
+      } catch (const std::invalid_argument&) {
+        threw = true;
+      }
+      assert(threw);
+    }
+    Stratum::LayerArchive::Reader r(file);
+    assert(r.depth() == 8 && r.size() == 1);
+    assert(r.greyLayer(0) == g);
+  }
+  std::filesystem::remove(file);
+
+  // Generation into an archive references layers by index.
+  const std::filesystem::path stl = "archive_test.stl";
+  writeTetrahedron(stl);
+
+  Stratum::DLPConfig cfg;
+  cfg.cols = 40;
+  cfg.rows = 40;
+  cfg.pixel_pitch_mm = 0.1;
+  cfg.layer_height = 0.25;
+  cfg.png_dir = "archive_test_png";
+  cfg.archive_path = "archive_test/job.slyr";
+
+  std::vector<std::string> gcode;
+  Stratum::generateGCode(stl, cfg, std::back_inserter(gcode));
+  assert(!std::filesystem::exists(cfg.png_dir));
+  assert(gcode.back() == "; Layer archive stored in archive_test/job.slyr");
+
+  Stratum::LayerArchive::Reader r(cfg.archive_path);
+  std::uint32_t expected = 0;
+  for (const auto& line : gcode) {
+    if (line.rfind("M701", 0) == 0) {
+      assert(line.rfind("M701 L" + std::to_string(expected) + " ", 0) == 0);
+      assert(r.layer(expected).count() > 0);
+      ++expected;
+    }
+  }
+  assert(expected == 8 && r.size() == expected);
+
+
+  // Anti-aliased generation stores 8-bit coverage with partial pixels.
+  cfg.antialias = 4;
+  gcode.clear();
+  Stratum::generateGCode(stl, cfg, std::back_inserter(gcode));
+  {
+    Stratum::LayerArchive::Reader grey(cfg.archive_path);
+    assert(grey.depth() == 8 && grey.size() == 8);
+    const Stratum::GreyMask first = grey.greyLayer(0);
+    bool partial = false;
+    for (uint8_t v : first.bytes())
+      partial = partial || (v > 0 && v < 255);
+    assert(partial);
+  }
+
+  std::filesystem::remove(stl);
+  std::filesystem::remove_all("archive_test");
+  return 0;
+}
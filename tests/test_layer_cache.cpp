@@ -0,0 +1,212 @@
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gcode_generator.h>
+#include <layer_cache.h>
+
+#include "stl_fixtures.h"
+
+namespace
+{
+std::vector<std::string> generate(const std::filesystem::path& stl,
+                                  const Stratum::DLPConfig& cfg)
+{
+  std::vector<std::string> gcode;
+  Stratum::generateGCode(stl, cfg, std::back_inserter(gcode));
+  return gcode;
+}
+
+// Modification time of every file in `dir`.
+std::map<std::string, std::filesystem::file_time_type> snapshot(
+    const std::filesystem::path& dir)
+{
+  std::map<std::string, std::filesystem::file_time_type> files;
+  for (const auto& e : std::filesystem::directory_iterator(dir))
+    files[e.path().filename().string()] = e.last_write_time();
+  return files;
+}
+
+std::size_t entries(const std::filesystem::path& dir)
+{
+  return static_cast<std::size_t>(
+      std::distance(std::filesystem::directory_iterator(dir),
+                    std::filesystem::directory_iterator()));
+}
+
+// Layer plan entries in the cache directory `dir`, leaving out mesh records.
+std::size_t plans(const std::filesystem::path& dir)
+{
+  std::size_t n = 0;
+  for (const auto& e : std::filesystem::directory_iterator(dir))
+    n += e.path().extension() == ".layers";
+  return n;
+}
+
+// Equal apart from the trailing note naming the mask directory.
+bool sameJob(const std::vector<std::string>& a,
+             const std::vector<std::string>& b)
+{
+  return a.size() == b.size()
+      && std::equal(a.begin(), a.end() - 1, b.begin());
+}
+}  // namespace
+
+int main()
+{
+  const std::filesystem::path stl = "cached_pyramid.stl";
+  const std::filesystem::path cache = "layer_cache";
+  writePyramid(stl);
+  std::filesystem::remove_all(cache);
+
+  // Entries round-trip and only match their own key.
+  {
+    Stratum::LayerCache::Key key(Stratum::LayerCache::hashFile(stl));
+    key.add(std::string_view("DLPConfig")).add(0.05);
+    Stratum::LayerCache::Plan plan;
+    plan.base_z = -1.25;
+    plan.layers = {-1, 0, 0, 2};
+    plan.stored = 2;
+    plan.skipped = 1;
+    plan.outputs = {{123, 456}, {7, -8}};
+    const auto file = Stratum::LayerCache::entryPath(cache, key);
+    assert(file.parent_path() == cache);
+    assert(file.filename().string().size() == 32 + 7);
+    Stratum::LayerCache::save(file, key, plan);
+
+    Stratum::LayerCache::Plan loaded;
+    assert(Stratum::LayerCache::load(file, key, loaded));
+    assert(loaded.base_z == plan.base_z && loaded.layers == plan.layers);
+    assert(loaded.stored == 2 && loaded.skipped == 1);
+    assert(loaded.outputs == plan.outputs);
+
+    Stratum::LayerCache::Key other(Stratum::LayerCache::hashFile(stl));
+    other.add(std::string_view("DLPConfig")).add(0.1);
+    assert(Stratum::LayerCache::entryPath(cache, other) != file);
+    assert(!Stratum::LayerCache::load(file, other, loaded));
+
+    std::filesystem::resize_file(file, 40);
+    assert(!Stratum::LayerCache::load(file, key, loaded));
+    assert(!Stratum::LayerCache::load(cache / "missing.layers", key, loaded));
+    std::filesystem::remove_all(cache);
+  }
+
+  // The mesh hash is recorded once and read back while the STL keeps its
+  // size and modification time.
+  {
+    const auto hash = Stratum::LayerCache::hashFile(stl);
+    assert(Stratum::LayerCache::meshHash(cache, stl) == hash);
+    std::filesystem::path record;
+    for (const auto& e : std::filesystem::directory_iterator(cache))
+      if (e.path().extension() == ".mesh")
+        record = e.path();
+    assert(!record.empty());
+
+    // Only the recorded value is used: a planted hash is returned as is.
+    const auto size = std::filesystem::file_size(record);
+    {
+      std::fstream f(record, std::ios::binary | std::ios::in | std::ios::out);
+      f.seekp(static_cast<std::streamoff>(size - 16));
+      f.write("0123456789abcdef", 16);
+    }
+    assert(Stratum::LayerCache::meshHash(cache, stl) != hash);
+
+    // A changed mesh is hashed again.
+    std::filesystem::last_write_time(
+        stl,
+        std::filesystem::last_write_time(stl) + std::chrono::seconds(1));
+    assert(Stratum::LayerCache::meshHash(cache, stl) == hash);
+    assert(Stratum::LayerCache::meshHash(cache, stl) == hash);
+    std::filesystem::remove_all(cache);
+  }
+
+  Stratum::DLPConfig cfg;
+  cfg.cols = 64;
+  cfg.rows = 48;
+  cfg.pixel_pitch_mm = 0.1;
+  cfg.layer_height = 0.2;
+  cfg.png_dir = "cached_layers";
+  cfg.layer_cache_dir = cache;
+
+  // The first run slices and stores the masks and records the plan.
+  const auto first = generate(stl, cfg);
+  assert(plans(cache) == 1);
+  const auto masks = snapshot(cfg.png_dir);
+  assert(masks.size() == 20);
+
+  // Changing only emission settings rewrites the G-code from the plan
+  // without touching a mask; the text matches a run without the cache.
+  Stratum::DLPConfig changed = cfg;
+  changed.exposure_s = 2.5;
+  changed.intensity_pct = 80;
+  changed.final_lift_mm = 12;
+  changed.layer_feed = 30;
+  changed.lift_feed = 240;
+  changed.workers = 2;
+  const auto replayed = generate(stl, changed);
+  assert(snapshot(cfg.png_dir) == masks);
+  assert(plans(cache) == 1);
+
+  Stratum::DLPConfig fresh = changed;
+  fresh.layer_cache_dir.clear();
+  fresh.png_dir = "uncached_layers";
+  const auto expected = generate(stl, fresh);
+  assert(sameJob(replayed, expected));
+  assert(replayed.back() == "; PNG layers stored in cached_layers");
+  assert(replayed != first);
+  bool saw_move = false, saw_exposure = false;
+  for (const auto& line : replayed) {
+    saw_move = saw_move || line == "G1 Z0.2000 F30";
+    saw_exposure =
+        saw_exposure || line == "M701 P\"layer0001.png\" S2.5 I80";
+  }
+  assert(saw_move && saw_exposure);
+
+  // A geometry setting is part of the key: a new entry and new masks.
+  Stratum::DLPConfig thicker = cfg;
+  thicker.layer_height = 0.4;
+  const auto coarse = generate(stl, thicker);
+  assert(plans(cache) == 2);
+  assert(entries(cfg.png_dir) == 20);  // layers 1..10 rewritten
+  assert(snapshot(cfg.png_dir) != masks);
+
+  // The first entry's masks were overwritten, so it misses and regenerates.
+  const auto again = generate(stl, cfg);
+  assert(again == first);
+  const auto rewritten = snapshot(cfg.png_dir);
+  assert(generate(stl, cfg) == first);
+  assert(snapshot(cfg.png_dir) == rewritten);
+
+  // A deleted mask is a miss as well.
+  std::filesystem::remove(cfg.png_dir / "layer0005.png");
+  assert(generate(stl, cfg) == first);
+  assert(std::filesystem::exists(cfg.png_dir / "layer0005.png"));
+
+  // Archive jobs reuse their archive the same way.
+  Stratum::DLPConfig archived = cfg;
+  archived.archive_path = "cached_layers.slyr";
+  const auto packed = generate(stl, archived);
+  const auto archive_time =
+      std::filesystem::last_write_time(archived.archive_path);
+  archived.exposure_s = 4;
+  const auto repacked = generate(stl, archived);
+  assert(std::filesystem::last_write_time(archived.archive_path)
+         == archive_time);
+  archived.layer_cache_dir.clear();
+  archived.archive_path = "uncached_layers.slyr";
+  assert(sameJob(repacked, generate(stl, archived)));
+  assert(repacked != packed);
+
+  std::filesystem::remove(stl);
+  std::filesystem::remove_all(cache);
+  std::filesystem::remove_all("cached_layers");
+  std::filesystem::remove_all("uncached_layers");
+  std::filesystem::remove("cached_layers.slyr");
+  std::filesystem::remove("uncached_layers.slyr");
+  return 0;
+}
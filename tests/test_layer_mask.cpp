@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <gcode_generator.h>
+
+int main()
+{
+  // Span set/clear against a naive byte mask, across byte boundaries.
+  const int w = 77, h = 3;
+  Stratum::BitMask bits(w, h);
+  std::vector<uint8_t> ref(static_cast<std::size_t>(w) * h, 0);
+  const int spans[][4] = {{0, 0, 1, 1},   {0, 3, 5, 1},   {0, 6, 70, 1},
+                          {1, 8, 16, 1},  {1, 9, 77, 1},  {1, 20, 33, 0},
+                          {2, -4, 90, 1}, {2, 7, 9, 0},   {2, 64, 72, 0},
+                          {0, 40, 40, 1}};
+  for (const auto& s : spans) {
+    if (s[3])
+      bits.setSpan(s[0], s[1], s[2]);
+    else
+      bits.clearSpan(s[0], s[1], s[2]);
+    for (int x = std::max(0, s[1]); x < std::min(w, s[2]); ++x)
+      ref[static_cast<std::size_t>(s[0]) * w + x] = static_cast<uint8_t>(s[3]);
+  }
+  std::size_t on = 0;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      assert(bits.get(x, y) == (ref[static_cast<std::size_t>(y) * w + x] != 0));
+      on += ref[static_cast<std::size_t>(y) * w + x];
+    }
+    // Row padding bits stay clear.
+    assert((bits.row(y)[bits.stride() - 1] & 0x07u) == 0);
+  }
+  assert(bits.count() == on);
+
+  // Packed and byte rasterization agree.
+  std::vector<Stratum::Slicer::Segment2D> tri = {{{0.5, 0.5}, {6.0, 1.0}},
+                                                 {{6.0, 1.0}, {2.0, 4.5}},
+                                                 {{2.0, 4.5}, {0.5, 0.5}}};
+  std::vector<uint8_t> bytes(static_cast<std::size_t>(w) * 60, 0);
+  Stratum::BitMask packed(w, 60);
+  Stratum::Slicer::rasterizeCenteredSegments(bytes, w, 60, 0.08, tri, 0.1, 0.0);
+  Stratum::Slicer::rasterizeCenteredSegments(packed, 0.08, tri, 0.1, 0.0);
+  std::size_t set = 0;
+  for (int y = 0; y < 60; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const bool b = bytes[static_cast<std::size_t>(y) * w + x] != 0;
+      assert(packed.get(x, y) == b);
+      set += b;
+    }
+  }
+  assert(set > 0 && packed.count() == set);
+
+  // Equal masks hash equally; a single pixel changes the hash.
+  Stratum::BitMask copy = packed;
+  assert(copy.hash() == packed.hash());
+  copy.set(w - 1, 59, !copy.get(w - 1, 59));
+  assert(!(copy.hash() == packed.hash()));
+  assert(!(Stratum::BitMask(8, 2).hash() == Stratum::BitMask(16, 1).hash()));
+
+  // Coverage with one sample is the binary mask; with 4 x 4 samples partial
+  // pixels get their covered area.
+  Stratum::GreyMask cover(w, 60);
+  Stratum::Slicer::rasterizeCoverage(cover, 0.08, 1, tri, 0.1, 0.0);
+  for (int y = 0; y < 60; ++y)
+    for (int x = 0; x < w; ++x)
+      assert(cover.get(x, y) == (packed.get(x, y) ? 255 : 0));
+
+  std::vector<Stratum::Slicer::Segment2D> rect = {{{0.5, 0.0}, {3.25, 0.0}},
+                                                  {{3.25, 0.0}, {3.25, 2.0}},
+                                                  {{3.25, 2.0}, {0.5, 2.0}},
+                                                  {{0.5, 2.0}, {0.5, 0.0}}};
+  Stratum::GreyMask aa(5, 3);
+  Stratum::Slicer::rasterizeCoverage(aa, 1.0, 4, rect, 0.0, 0.0);
+  for (int y = 0; y < 2; ++y) {
+    assert(aa.get(0, y) == 128 && aa.get(1, y) == 255 && aa.get(2, y) == 255);
+    assert(aa.get(3, y) == 64 && aa.get(4, y) == 0);
+  }
+  for (int x = 0; x < 5; ++x)
+    assert(aa.get(x, 2) == 0);
+
+  // The greyscale PNG keeps every coverage value.
+  const std::filesystem::path grey_png = "mask_test_grey.png";
+  Stratum::writeFileBytes(grey_png, [&]
+  {
+    std::vector<uint8_t> bytes;
+    Stratum::encodeGreyPNG(bytes, aa);
+    return bytes;
+  }());
+  {
+    std::vector<unsigned char> decoded;
+    unsigned gw = 0, gh = 0;
+    assert(lodepng::decode(decoded, gw, gh, grey_png.string(), LCT_GREY, 8)
+           == 0);
+    assert(gw == 5 && gh == 3);
+    assert(decoded == aa.bytes());
+  }
+  std::filesystem::remove(grey_png);
+
+  // The PNG round-trips as a 1-bit greyscale image.
+  const std::filesystem::path png = "mask_test.png";
+  Stratum::writeMonoPNG(png, packed);
+  std::vector<unsigned char> grey;
+  unsigned pw = 0, ph = 0;
+  assert(lodepng::decode(grey, pw, ph, png.string(), LCT_GREY, 8) == 0);
+  assert(pw == static_cast<unsigned>(w) && ph == 60);
+  for (int y = 0; y < 60; ++y)
+    for (int x = 0; x < w; ++x)
+      assert((grey[static_cast<std::size_t>(y) * w + x] == 255)
+             == packed.get(x, y));
+
+  std::filesystem::remove(png);
+  return 0;
+}
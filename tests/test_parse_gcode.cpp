@@ -1,8 +1,12 @@
 #include <cassert>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <variant>
 #include <vector>
 
@@ -49,6 +53,190 @@ int main()
   assert(std::holds_alternative<double>(cmds[2].arguments[1].value));
   assert(std::get<double>(cmds[2].arguments[1].value) == 0.0);
 
+  // The in-place parser sees the same commands, with arguments pointing into
+  // the text; CRLF line ends are stripped.
+  const std::string_view text = "G1 X-1.5 Y.25 E\r\n"
+                                "M701 P\"layer 1.png\" S2 ; expose\r\n"
+                                "G28\r\n"
+                                "M6054 A1 B2 C3 D4 E5 F6 G7 H8 I9 J10";
+  std::vector<std::string> names;
+  Stratum::forEachCommand(text,
+                          [&](const Stratum::CommandView& cmd)
+                          {
+                            names.emplace_back(cmd.command);
+                            const auto owned = Stratum::toCommand(cmd);
+                            assert(owned.arguments.size() == cmd.arguments.size());
+                            if (cmd.command == "G1") {
+                              assert(cmd.arguments.size() == 3);
+                              assert(cmd.arguments[0].number == -1.5);
+                              assert(cmd.arguments[1].number == 0.25);
+                              assert(cmd.arguments[2].letter == 'E');
+                              assert(cmd.arguments[2].number == 0.0);
+                            } else if (cmd.command == "M701") {
+                              const auto& file = cmd.arguments[0];
+                              assert(file.is_text && file.text == "layer 1.png");
+                              assert(file.text.data() > text.data()
+                                     && file.text.data() < text.data() + text.size());
+                              assert(std::get<std::string>(owned.arguments[0].value)
+                                     == "layer 1.png");
+                              assert(cmd.arguments[1].number == 2.0);
+                            } else if (cmd.command == "M6054") {
+                              // More arguments than fit inline.
+                              assert(cmd.arguments.size() == 10);
+                              for (std::size_t i = 0; i < 10; ++i) {
+                                assert(cmd.arguments[i].letter == char('A' + i));
+                                assert(cmd.arguments[i].number == double(i + 1));
+                              }
+                            }
+                          });
+  assert((names == std::vector<std::string> {"G1", "M701", "G28", "M6054"}));
+
+  // Malformed arguments are reported.
+  const auto fails = [](std::string_view line)
+  {
+    try {
+      Stratum::parseLine(line);
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+  assert(fails("G1 1.0"));
+  assert(fails("G1 X-"));
+  assert(fails("M701 P\"open"));
+
+  // Chunked parallel parsing matches the serial parser, in order, and
+  // reports the first malformed line.
+  std::string big;
+  for (int i = 0; i < 5000; ++i) {
+    big += "G1 X" + std::to_string(i) + " Y-" + std::to_string(i % 7) + "\n";
+    if (i % 100 == 0)
+      big += "; layer " + std::to_string(i / 100) + "\nM701 P\"l.png\"\n";
+  }
+  std::vector<Stratum::GCodeCommand> serial;
+  Stratum::forEachCommand(big,
+                          [&](const Stratum::CommandView& cmd)
+                          { serial.push_back(Stratum::toCommand(cmd)); });
+  const auto chunked = Stratum::parseCommands(big, 4, 1000);
+  assert(chunked.size() == serial.size() && serial.size() == 5050);
+  for (std::size_t i = 0; i < serial.size(); ++i) {
+    assert(chunked[i].command == serial[i].command);
+    assert(chunked[i].arguments.size() == serial[i].arguments.size());
+    for (std::size_t k = 0; k < serial[i].arguments.size(); ++k) {
+      assert(chunked[i].arguments[k].letter == serial[i].arguments[k].letter);
+      assert(chunked[i].arguments[k].value == serial[i].arguments[k].value);
+    }
+  }
+  std::string bad = big;
+  bad.insert(bad.size() / 2, "\nG1 X1 oops\n");
+  bad.insert(bad.size() * 3 / 4, "\nG1 X1 Y\"\n");
+  std::string message;
+  try {
+    Stratum::parseCommands(bad, 4, 1000);
+  } catch (const std::runtime_error& e) {
+    message = e.what();
+  }
+  assert(message == "Invalid numeric value in argument: ");
+
+  {
+    std::ofstream big_out(path, std::ios::binary);
+    big_out << big;
+  }
+  std::vector<Stratum::GCodeCommand> from_file;
+  Stratum::parseFileParallel(path, std::back_inserter(from_file), 3);
+  assert(from_file.size() == serial.size());
+  assert(from_file.back().command == "G1");
+  assert(std::get<double>(from_file.back().arguments[0].value) == 4999.0);
+
+  // The pull-based stream yields the same commands through a buffer much
+  // smaller than the file, and a line longer than the buffer; reading can
+  // stop early and resume from the reported offset.
+  static_assert(std::input_iterator<Stratum::CommandStream::iterator>);
+  big += "M6054 " + std::string(40, ' ') + "A1 B2\n";
+  {
+    std::ofstream big_out(path, std::ios::binary);
+    big_out << big;
+  }
+  std::vector<std::string> all;
+  Stratum::forEachCommand(big,
+                          [&](const Stratum::CommandView& cmd)
+                          { all.emplace_back(cmd.command); });
+  std::vector<std::string> streamed;
+  std::uint64_t resume = 0;
+  {
+    Stratum::CommandStream stream(path, 0, 16);
+    for (const Stratum::CommandView& cmd : stream) {
+      streamed.emplace_back(cmd.command);
+      if (streamed.size() == 1234)
+        break;
+    }
+    resume = stream.offset();
+    assert(big.compare(stream.lineOffset(), 2, "G1") == 0);
+  }
+  {
+    Stratum::CommandStream stream(path, resume, 16);
+    while (const Stratum::CommandView* cmd = stream.next())
+      streamed.emplace_back(cmd->command);
+    assert(stream.offset() == big.size());
+  }
+  assert(streamed == all);
+
+  std::size_t in_memory = 0;
+  auto text_stream = Stratum::CommandStream::fromText(big, resume);
+  for (const Stratum::CommandView& cmd : text_stream)
+    assert(cmd.command == all[1234 + in_memory++]);
+  assert(1234 + in_memory == all.size());
+
+#if STRATUM_HAS_MMAP
+  // A FIFO cannot be mapped; parseFile and readGCode read it through a
+  // buffer instead and see the same commands.
+  const std::filesystem::path fifo = "test_gcode.fifo";
+  std::filesystem::remove(fifo);
+  assert(::mkfifo(fifo.c_str(), 0600) == 0);
+  const auto feed = [&]
+  {
+    return std::thread(
+        [&]
+        {
+          std::ofstream writer(fifo, std::ios::binary);
+          writer << big;
+        });
+  };
+  std::thread writer = feed();
+  std::vector<Stratum::GCodeCommand> piped;
+  Stratum::parseFile(fifo, std::back_inserter(piped));
+  writer.join();
+  assert(piped.size() == all.size());
+  for (std::size_t i = 0; i < all.size(); ++i)
+    assert(piped[i].command == all[i]);
+
+  writer = feed();
+  const auto read = Stratum::readGCode(fifo, 2);
+  writer.join();
+  assert(read.size() == all.size());
+  assert(read.back().command == all.back());
+  std::filesystem::remove(fifo);
+#endif
+
+  // A missing file reports the same error through every entry point.
+  const auto missing = path.string() + ".missing";
+  const auto openError = [&](auto&& parse)
+  {
+    std::string what;
+    try {
+      parse();
+    } catch (const std::runtime_error& e) {
+      what = e.what();
+    }
+    return what;
+  };
+  std::vector<Stratum::GCodeCommand> none;
+  assert(openError([&]
+                   { Stratum::parseFile(missing, std::back_inserter(none)); })
+         == "Failed to open " + missing);
+  assert(openError([&] { Stratum::readGCode(missing); })
+         == "Failed to open " + missing);
+
   std::filesystem::remove(path);
   return 0;
 }
@@ -0,0 +1,76 @@
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <gcode_generator.h>
+
+namespace
+{
+void checkRoundTrip(const Stratum::BitMask& mask, int level)
+{
+  std::vector<uint8_t> png;
+  Stratum::Png::encodeMono(png, mask, level);
+
+  std::vector<unsigned char> grey;
+  unsigned w = 0, h = 0;
+  assert(lodepng::decode(grey, w, h, png, LCT_GREY, 8) == 0);
+  assert(w == static_cast<unsigned>(mask.width()));
+  assert(h == static_cast<unsigned>(mask.height()));
+  for (int y = 0; y < mask.height(); ++y)
+    for (int x = 0; x < mask.width(); ++x)
+      assert((grey[static_cast<std::size_t>(y) * w + x] == 255)
+             == mask.get(x, y));
+}
+}  // namespace
+
+int main()
+{
+  // Sparse mask: a disc and a few stripes, wide enough that rows contain
+  // runs longer than one deflate match and the stream spans several IDATs.
+  Stratum::BitMask mask(4099, 300);
+  for (int y = 0; y < mask.height(); ++y) {
+    const int dy = y - 150;
+    for (int x = 0; x < mask.width(); ++x) {
+      const int dx = x - 2000;
+      if (dx * dx + dy * dy < 120 * 120)
+        mask.set(x, y);
+    }
+    if (y % 37 < 5)
+      mask.setSpan(y, 100 + y, 3900 - y);
+    if (y % 3 == 0)
+      mask.set(4098, y);
+  }
+  for (int level : {Stratum::Png::kStore, Stratum::Png::kRle,
+                    Stratum::Png::kDeflate})
+    checkRoundTrip(mask, level);
+
+  // Noisy rows defeat run-length coding and exercise the literal path.
+  Stratum::BitMask noise(61, 17);
+  std::uint32_t seed = 12345;
+  for (int y = 0; y < noise.height(); ++y)
+    for (int x = 0; x < noise.width(); ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      noise.set(x, y, (seed >> 28) & 1u);
+    }
+  for (int level : {Stratum::Png::kStore, Stratum::Png::kRle,
+                    Stratum::Png::kDeflate})
+    checkRoundTrip(noise, level);
+
+  // RLE output of a mostly empty panel is a small fraction of the raw bits.
+  Stratum::BitMask empty(3840, 2160);
+  empty.setSpan(1000, 10, 20);
+  std::vector<uint8_t> png;
+  Stratum::Png::encodeMono(png, empty, Stratum::Png::kRle);
+  assert(png.size() < empty.bytes().size() / 50);
+
+  // writeMonoPNG still supports lodepng's encoder.
+  const std::filesystem::path file = "png_encoder_test.png";
+  Stratum::writeMonoPNG(file, noise, Stratum::Png::kLodepng);
+  std::vector<unsigned char> grey;
+  unsigned w = 0, h = 0;
+  assert(lodepng::decode(grey, w, h, file.string(), LCT_GREY, 8) == 0);
+  assert(w == 61 && h == 17);
+  std::filesystem::remove(file);
+  return 0;
+}
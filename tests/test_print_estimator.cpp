@@ -0,0 +1,128 @@
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include <gcode_generator.h>
+#include <print_estimator.h>
+
+#include "stl_fixtures.h"
+
+namespace
+{
+bool near(double a, double b)
+{
+  return std::abs(a - b) < 1e-9;
+}
+
+Stratum::PrintEstimate estimate(std::string_view text,
+                                const Stratum::EstimatorConfig& cfg = {})
+{
+  Stratum::PrintEstimator estimator(cfg);
+  estimator.addText(text);
+  return estimator.report();
+}
+}  // namespace
+
+int main()
+{
+  // Constant feed: 10 mm at 600 mm/min is one second.
+  auto r = estimate("G21\nG90\nG1 X10 F600\n");
+  assert(near(r.total_s, 1.0) && near(r.travel_mm, 10.0));
+
+  // Acceleration adds v / a to a move long enough to reach the feed rate,
+  // and a short move is a triangle profile.
+  Stratum::EstimatorConfig accel;
+  accel.xy_acceleration = 100.0;
+  r = estimate("G1 X10 F600\nG1 X10.5\n", accel);
+  assert(near(r.total_s, 1.1 + 2 * std::sqrt(0.5 / 100.0)));
+
+  // Relative inches, a G0 rapid that keeps the modal feed, and dwells.
+  r = estimate("G20\nG91\nG0 X1 F60\nG0 X1\nG4 P500\nG4 S2\n");
+  assert(near(r.rapid_mm, 50.8) && near(r.motion_s, 2 * 25.4 / 25.4));
+  assert(near(r.dwell_s, 2.5) && near(r.total_s, 4.5));
+
+  // A quarter circle of radius 10 at 10 mm/s.
+  r = estimate("G1 X10 Y0 F600\nG3 X0 Y10 I-10 J0\n");
+  assert(near(r.travel_mm, 10 + 5 * std::numbers::pi));
+  assert(near(r.total_s, 1 + 0.5 * std::numbers::pi));
+  r = estimate("G1 X10 Y0 F600\nG2 X10 Y0 I-10 J0\n");
+  assert(near(r.travel_mm, 10 + 20 * std::numbers::pi));
+
+  // Laser exposure counts feed moves with the laser on, not rapids; layers
+  // split at the first Z move after an exposure, so a peel stays in its
+  // layer.
+  r = estimate("G1 Z0.1 F600\n"
+               "M3 S50\nG0 X10\nG1 X20\nM5\n"  // 1 s exposed
+               "G1 Z5\nG1 Z0.2\n"  // peel
+               "M701 P\"layer0002.png\" S2.5 I100\n"
+               "G1 Z0.3\nM701 L1 S2.5\n"
+               "G1 Z10\n");
+  assert(near(r.exposure_s, 6.0));
+  assert(r.layers.size() == 3);
+  assert(near(r.layers[0].z, 0.1) && near(r.layers[0].exposure_s, 1.0));
+  assert(near(r.layers[1].z, 0.2) && near(r.layers[1].exposure_s, 2.5));
+  assert(near(r.layers[1].time_s, 2.5 + (4.9 + 4.8) / 10));
+  assert(near(r.layers[2].z, 0.3));
+  double sum = 0.0;
+  for (const auto& l : r.layers)
+    sum += l.time_s;
+  assert(near(sum, r.total_s));
+
+  // Generated jobs: every DLP exposure is one layer, and owning commands
+  // from parseFile give the same estimate as the generated lines.
+  const std::filesystem::path box = "estimate_box.stl";
+  writeBox(box);
+  Stratum::DLPConfig dlp;
+  dlp.cols = 64;
+  dlp.rows = 48;
+  dlp.pixel_pitch_mm = 0.1;
+  dlp.layer_height = 0.25;
+  dlp.exposure_s = 3.0;
+  dlp.png_dir = "estimate_layers";
+  std::vector<std::string> lines;
+  Stratum::generateGCode(box, dlp, std::back_inserter(lines));
+  Stratum::PrintEstimator generated;
+  for (const auto& line : lines)
+    generated.addText(line);
+  const auto job = generated.report();
+  assert(job.layers.size() == 8 && near(job.exposure_s, 24.0));
+  for (const auto& l : job.layers)
+    assert(near(l.exposure_s, 3.0));
+
+  const std::filesystem::path file = "estimate.gcode";
+  {
+    std::ofstream out(file);
+    for (const auto& line : lines)
+      out << line << "\n";
+  }
+  std::vector<Stratum::GCodeCommand> cmds;
+  Stratum::parseFile(file, std::back_inserter(cmds));
+  Stratum::PrintEstimator parsed;
+  for (const auto& cmd : cmds)
+    parsed.add(cmd);
+  assert(near(parsed.report().total_s, job.total_s));
+  assert(near(Stratum::estimatePrint(file).total_s, job.total_s));
+
+  // Laser SLA jobs are exposed by the laser-on feed moves.
+  Stratum::SLAConfig sla;
+  sla.layer_height = 0.5;
+  std::vector<std::string> sla_lines;
+  Stratum::generateGCode(box, sla, std::back_inserter(sla_lines));
+  Stratum::PrintEstimator laser;
+  for (const auto& line : sla_lines)
+    laser.addText(line);
+  const auto sla_job = laser.report();
+  assert(sla_job.layers.size() == 4);
+  for (const auto& l : sla_job.layers)
+    assert(l.exposure_s > 0.0 && l.exposure_s < l.time_s);
+
+  std::filesystem::remove(file);
+  std::filesystem::remove(box);
+  std::filesystem::remove_all(dlp.png_dir);
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gcode_generator.h>
+
+namespace
+{
+void writeFloat(std::ofstream& out, float v)
+{
+  char b[4];
+  std::memcpy(b, &v, sizeof(b));
+  out.write(b, sizeof(b));
+}
+
+// Stream-based reference for the ASCII reader.
+std::vector<Stratum::Slicer::Triangle> referenceAscii(const std::string& text)
+{
+  std::istringstream f(text);
+  std::vector<Stratum::Slicer::Triangle> tris;
+  std::string line;
+  Stratum::Slicer::Vec3 v[3];
+  int n = 0;
+  while (std::getline(f, line)) {
+    std::istringstream iss(line);
+    std::string token;
+    iss >> token;
+    if (token == "vertex") {
+      iss >> v[n].x >> v[n].y >> v[n].z;
+      if (++n == 3) {
+        tris.push_back({v[0], v[1], v[2]});
+        n = 0;
+      }
+    }
+  }
+  return tris;
+}
+
+bool sameVec(const Stratum::Slicer::Vec3& a, const Stratum::Slicer::Vec3& b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+}  // namespace
+
+int main()
+{
+  const std::filesystem::path path = "test_binary.stl";
+  {
+    std::ofstream out(path, std::ios::binary);
+    // Many CAD tools start binary headers with "solid" too.
+    std::string header = "solid exported by CAD";
+    header.resize(80, ' ');
+    out.write(header.data(), 80);
+    const std::uint32_t count = 2;
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    const float facets[2][9] = {{0, 0, 0, 1, 0, 1, 0, 1, 0},
+                                {0, 0, 0, 0, 1, 0, -1, 0, 2}};
+    for (const auto& f : facets) {
+      for (int i = 0; i < 3; ++i)
+        writeFloat(out, 0.0f);  // normal
+      for (float v : f)
+        writeFloat(out, v);
+      out.write("\0\0", 2);  // attribute byte count
+    }
+  }
+
+  Stratum::Bounds3D bb;
+  const auto tris = Stratum::Slicer::readStl(path, bb);
+  assert(tris.size() == 2);
+  assert(tris[0].v2.x == 1.0 && tris[0].v2.z == 1.0);
+  assert(tris[1].v3.x == -1.0 && tris[1].v3.z == 2.0);
+  assert(bb.min_x == -1.0 && bb.max_x == 1.0);
+  assert(bb.min_y == 0.0 && bb.max_y == 1.0);
+  assert(bb.min_z == 0.0 && bb.max_z == 2.0);
+
+  Stratum::SLAConfig cfg;
+  cfg.spot_radius = 0.1;
+  cfg.layer_height = 0.5;
+  cfg.final_lift_mm = 0.0;
+
+  std::vector<std::string> gcode;
+  Stratum::generateGCode(path, cfg, std::back_inserter(gcode));
+  assert(gcode.size() > 3);
+  assert(gcode[0] == "; **** Laser SLA Print ****");
+  assert(gcode.back() == "M30");
+
+#if STRATUM_HAS_MMAP
+  // A FIFO reports no size and cannot be mapped; it is read through a buffer
+  // and decodes to the same triangles.
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  const std::filesystem::path fifo = "test_stl.fifo";
+  std::filesystem::remove(fifo);
+  assert(::mkfifo(fifo.c_str(), 0600) == 0);
+  std::thread writer(
+      [&]
+      {
+        std::ofstream out(fifo, std::ios::binary);
+        out << bytes;
+      });
+  Stratum::Bounds3D piped_bb;
+  const auto piped = Stratum::Slicer::readStl(fifo, piped_bb);
+  writer.join();
+  assert(piped.size() == tris.size());
+  for (std::size_t i = 0; i < tris.size(); ++i)
+    assert(sameVec(piped[i].v3, tris[i].v3));
+  assert(piped_bb.min_x == bb.min_x && piped_bb.max_z == bb.max_z);
+  std::filesystem::remove(fifo);
+#endif
+
+  std::filesystem::remove(path);
+
+  // ASCII: mixed whitespace, exponents and CRLF line endings, parsed both on
+  // one thread and split into many small chunks.
+  std::ostringstream ascii;
+  ascii << "solid test\r\n";
+  for (int i = 0; i < 500; ++i) {
+    ascii << "  facet normal 0 0 1\r\n    outer loop\n";
+    ascii << "\tvertex " << i * 0.1 << " -1.5e-3 +" << i << "\r\n";
+    ascii << "      vertex  " << 1.0 / (i + 1) << "\t2.25E+1 0\n";
+    ascii << "      vertex -0 " << i << ".125 " << i * 0.7 << "\n";
+    ascii << "    endloop\n  endfacet\n";
+  }
+  ascii << "endsolid test\n";
+  const std::string text = ascii.str();
+
+  const auto ref = referenceAscii(text);
+  Stratum::Bounds3D bb1, bb2;
+  const auto serial = Stratum::Slicer::readAsciiStl(text, bb1, 1);
+  const auto chunked = Stratum::Slicer::readAsciiStl(text, bb2, 7, 1);
+  assert(serial.size() == ref.size() && chunked.size() == ref.size());
+  for (std::size_t i = 0; i < ref.size(); ++i) {
+    for (const auto* t : {&serial[i], &chunked[i]}) {
+      assert(sameVec(t->v1, ref[i].v1));
+      assert(sameVec(t->v2, ref[i].v2));
+      assert(sameVec(t->v3, ref[i].v3));
+    }
+  }
+  assert(bb1.min_x == bb2.min_x && bb1.max_z == bb2.max_z);
+  assert(bb1.max_y == 499.125 && bb1.max_z == 499.0);
+  return 0;
+}
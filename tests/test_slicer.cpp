@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <gcode_generator.h>
+
+using Stratum::Slicer::Segment2D;
+using Stratum::Slicer::Triangle;
+
+namespace
+{
+// A stack of thin, slanted triangles at staggered heights.
+std::vector<Triangle> staircase(int n)
+{
+  std::vector<Triangle> tris;
+  for (int i = 0; i < n; ++i) {
+    const double z0 = 0.1 * i;
+    tris.push_back({{0, 0, z0}, {1, 0, z0 + 0.35}, {0, 1, z0 + 0.2}});
+    tris.push_back({{2, 0, z0 + 0.3}, {3, 1, z0}, {2, 1, z0}});
+  }
+  return tris;
+}
+
+bool sameSet(std::vector<Segment2D> a, std::vector<Segment2D> b)
+{
+  const auto key = [](const Segment2D& s)
+  { return std::make_tuple(s.p1.x, s.p1.y, s.p2.x, s.p2.y); };
+  const auto less = [&](const Segment2D& l, const Segment2D& r)
+  { return key(l) < key(r); };
+  std::sort(a.begin(), a.end(), less);
+  std::sort(b.begin(), b.end(), less);
+  return a.size() == b.size()
+      && std::equal(a.begin(),
+                    a.end(),
+                    b.begin(),
+                    [&](const Segment2D& l, const Segment2D& r)
+                    { return key(l) == key(r); });
+}
+// Brute-force scan: every segment tested against every row.
+void referenceRaster(std::vector<uint8_t>& mask,
+                     int w,
+                     int h,
+                     double pitch,
+                     const std::vector<Segment2D>& segments,
+                     double ox,
+                     double oy)
+{
+  for (int py = 0; py < h; ++py) {
+    const double y = (py + 0.5) * pitch;
+    std::vector<double> xs;
+    for (const auto& s : segments) {
+      const double x1 = s.p1.x + ox, y1 = s.p1.y + oy;
+      const double x2 = s.p2.x + ox, y2 = s.p2.y + oy;
+      if (((y1 <= y && y2 > y) || (y2 <= y && y1 > y))
+          && std::abs(y2 - y1) > 1e-9)
+        xs.push_back(x1 + (x2 - x1) * (y - y1) / (y2 - y1));
+    }
+    std::sort(xs.begin(), xs.end());
+    for (std::size_t i = 0; i + 1 < xs.size(); i += 2) {
+      const int a = static_cast<int>(std::round(xs[i] / pitch));
+      const int b = static_cast<int>(std::round(xs[i + 1] / pitch));
+      for (int px = std::max(0, a); px < std::min(w, b); ++px)
+        mask[static_cast<std::size_t>(py) * w + px] = 1;
+    }
+  }
+}
+}  // namespace
+
+int main()
+{
+  const auto tris = staircase(50);
+  const double base = 0.0;
+  const double height = 0.05;
+  const int count = 110;
+
+  // Layer-by-layer sweep and single-pass sliceAll both match the full scan.
+  Stratum::Slicer::SweepSlicer sweep(tris);
+  for (int l = 0; l < count / 2; ++l) {
+    const double z = base + (l + 0.5) * height;
+    assert(sameSet(sweep.slice(z), Stratum::Slicer::sliceTriangles(tris, z)));
+  }
+
+  Stratum::Slicer::SweepSlicer all(tris);
+  const auto layers = all.sliceAll(base, height, count);
+  assert(layers.size() == static_cast<std::size_t>(count));
+  std::size_t total = 0;
+  for (int l = 0; l < count; ++l) {
+    const double z = base + (l + 0.5) * height;
+    assert(sameSet(layers[l], Stratum::Slicer::sliceTriangles(tris, z)));
+    total += layers[l].size();
+  }
+  assert(total > 0);
+
+  // Planes through a vertex follow the same below/not-below rule.
+  Stratum::Slicer::SweepSlicer exact(tris);
+  assert(sameSet(exact.slice(0.2), Stratum::Slicer::sliceTriangles(tris, 0.2)));
+
+  bool threw = false;
+  try {
+    exact.slice(0.1);
+  } catch (const std::logic_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // The edge-table rasterizer matches the brute-force scan, including edges
+  // that start exactly on a row centre, horizontal edges and off-panel parts.
+  std::vector<Segment2D> polys;
+  const auto ring = [&](double cx, double cy, double r, int n)
+  {
+    for (int i = 0; i < n; ++i) {
+      const double a0 = 2 * M_PI * i / n, a1 = 2 * M_PI * (i + 1) / n;
+      polys.push_back({{cx + r * std::cos(a0), cy + r * std::sin(a0)},
+                       {cx + r * std::cos(a1), cy + r * std::sin(a1)}});
+    }
+  };
+  ring(3.0, 2.0, 1.7, 37);
+  ring(3.0, 2.0, 0.6, 11);
+  ring(0.2, 4.6, 1.0, 9);
+  polys.push_back({{1.0, 0.25}, {2.0, 0.25}});
+  polys.push_back({{4.0, 0.25}, {5.0, 0.75}});
+  polys.push_back({{5.0, 0.75}, {4.0, 1.25}});
+  polys.push_back({{4.0, 1.25}, {4.0, 0.25}});
+
+  const int w = 61, h = 47;
+  for (double pitch : {0.1, 0.125, 0.3}) {
+    std::vector<uint8_t> fast(static_cast<std::size_t>(w) * h, 0);
+    std::vector<uint8_t> ref(fast.size(), 0);
+    Stratum::Slicer::rasterizeCenteredSegments(
+        fast, w, h, pitch, polys, 0.05, -0.2);
+    referenceRaster(ref, w, h, pitch, polys, 0.05, -0.2);
+    assert(fast == ref);
+  }
+  return 0;
+}
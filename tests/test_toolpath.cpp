@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include <gcode_generator.h>
+
+using Stratum::Slicer::Segment2D;
+using Stratum::Slicer::Vec2;
+namespace Toolpath = Stratum::Toolpath;
+
+namespace
+{
+// Closed polygon as segments.
+void addLoop(std::vector<Segment2D>& segs, const std::vector<Vec2>& pts)
+{
+  for (std::size_t i = 0; i < pts.size(); ++i)
+    segs.push_back({pts[i], pts[(i + 1) % pts.size()]});
+}
+
+void addSquare(std::vector<Segment2D>& segs, double x, double y, double size)
+{
+  addLoop(segs, {{x, y}, {x + size, y}, {x + size, y + size}, {x, y + size}});
+}
+
+// Distance from p to the nearest edge of a simplified path.
+double pathDistance(const Toolpath::Path& path, const Vec2& p)
+{
+  const auto& pts = path.points;
+  const std::size_t edges = path.closed ? pts.size() : pts.size() - 1;
+  double best = Toolpath::distance(p, pts.front());
+  for (std::size_t k = 0; k < edges; ++k) {
+    const Vec2& a = pts[k];
+    const Vec2& b = pts[(k + 1) % pts.size()];
+    const Toolpath::Arc arc = path.arcs.empty() ? Toolpath::Arc {} : path.arcs[k];
+    double d;
+    if (arc.turn == 0) {
+      d = Toolpath::detail::segmentDistance(p, a, b);
+    } else {
+      const Vec2& c = arc.center;
+      const auto sweep = [&](const Vec2& q)
+      {
+        double t = arc.turn
+            * (std::atan2(q.y - c.y, q.x - c.x) - std::atan2(a.y - c.y, a.x - c.x));
+        while (t < 0)
+          t += 2 * std::numbers::pi;
+        return t;
+      };
+      d = sweep(p) <= sweep(b)
+          ? std::abs(Toolpath::distance(p, c) - Toolpath::distance(a, c))
+          : std::min(Toolpath::distance(p, a), Toolpath::distance(p, b));
+    }
+    best = std::min(best, d);
+  }
+  return best;
+}
+
+double strokeLength(const std::vector<Toolpath::Stroke>& strokes)
+{
+  double sum = 0.0;
+  for (const auto& s : strokes)
+    sum += Toolpath::distance(s.from, s.to);
+  return sum;
+}
+}  // namespace
+
+int main()
+{
+  // A U shape: the base is one block, and each arm becomes its own block
+  // once the scanlines split into two spans.
+  std::vector<Segment2D> u;
+  addLoop(u, {{0, 0}, {3, 0}, {3, 3}, {2, 3}, {2, 1}, {1, 1}, {1, 3}, {0, 3}});
+  const auto rows = Toolpath::hatchRows(u, 0.1);
+  const auto blocks = Toolpath::hatchBlocks(rows);
+  assert(blocks.size() == 3);
+  std::vector<Toolpath::Stroke> all;
+  for (const auto& b : blocks) {
+    for (std::size_t i = 0; i < b.size(); ++i) {
+      // Back and forth on consecutive lines.
+      assert((b[i].to.x > b[i].from.x) == (i % 2 == 0));
+      if (i > 0)
+        assert(std::abs(b[i].from.y - b[i - 1].from.y - 0.1) < 1e-9);
+    }
+    all.insert(all.end(), b.begin(), b.end());
+  }
+  const auto scan = Toolpath::scanlineStrokes(rows);
+  assert(all.size() == scan.size());
+  assert(std::abs(strokeLength(all) - strokeLength(scan)) < 1e-9);
+
+  // Units along a line, listed out of order: the tour visits them in line
+  // order and runs the reversed one backwards.
+  std::vector<Toolpath::Unit> units = {
+      {{4, 0}, {5, 0}},
+      {{1, 0}, {0.5, 0}},
+      {{2, 0}, {3, 0}},
+  };
+  const auto order = Toolpath::planTour(units, {0, 0});
+  assert((order == std::vector<std::size_t> {1, 2, 0}));
+  assert(units[1].reversed && !units[0].reversed && !units[2].reversed);
+  assert(std::abs(Toolpath::tourTravel(units, order, {0, 0}) - 2.5) < 1e-12);
+
+  // A closed loop is entered at its point nearest to the laser.
+  const std::vector<Vec2> square = {{10, 10}, {11, 10}, {11, 11}, {10, 11}};
+  std::vector<Toolpath::Unit> loops = {{square[0], square[0], &square}};
+  Toolpath::planTour(loops, {12, 12});
+  assert(loops[0].start == 2);
+
+  // The planned tour is shorter than visiting the points as listed.
+  std::vector<Toolpath::Unit> points;
+  for (const Vec2 p : std::vector<Vec2> {
+           {1, 0}, {2, 0}, {0, 1}, {3, 1}, {0, 2}, {3, 2}, {1, 3}, {2, 3}})
+    points.push_back({p, p});
+  std::vector<std::size_t> listed(points.size());
+  for (std::size_t i = 0; i < listed.size(); ++i)
+    listed[i] = i;
+  const auto tour = Toolpath::planTour(points, {0, 0});
+  assert(Toolpath::tourTravel(points, tour, {0, 0})
+         < Toolpath::tourTravel(points, listed, {0, 0}));
+
+  // End to end: a grid of islands is hatched island by island with the same
+  // exposure as the scanline order and much less rapid travel.
+  std::vector<Segment2D> islands;
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      addSquare(islands, 3.0 * i, 3.0 * j, 1.0);
+  const auto grid_rows = Toolpath::hatchRows(islands, 0.05);
+  const auto grid_scan = Toolpath::scanlineStrokes(grid_rows);
+  const auto grid_blocks = Toolpath::hatchBlocks(grid_rows);
+  assert(grid_blocks.size() == 16);
+
+  std::vector<Toolpath::Unit> hatch;
+  for (const auto& b : grid_blocks)
+    hatch.push_back({b.front().from, b.back().to});
+  const auto planned = Toolpath::planTour(hatch, {0, 0});
+  double before = 0.0, after = 0.0;
+  Vec2 at {0, 0};
+  for (const auto& s : grid_scan) {
+    before += Toolpath::distance(at, s.from);
+    at = s.to;
+  }
+  at = {0, 0};
+  std::vector<Toolpath::Stroke> grid_all;
+  for (std::size_t i : planned) {
+    const auto& b = grid_blocks[i];
+    std::vector<Toolpath::Stroke> run(b.begin(), b.end());
+    if (hatch[i].reversed) {
+      std::reverse(run.begin(), run.end());
+      for (auto& s : run)
+        std::swap(s.from, s.to);
+    }
+    for (const auto& s : run) {
+      after += Toolpath::distance(at, s.from);
+      at = s.to;
+    }
+    grid_all.insert(grid_all.end(), run.begin(), run.end());
+  }
+  assert(grid_all.size() == grid_scan.size());
+  assert(std::abs(strokeLength(grid_all) - strokeLength(grid_scan)) < 1e-9);
+  assert(after * 4 < before);
+
+  // Simplification drops collinear points of a square outline.
+  Stratum::Slicer::Contour outline {{{0, 0}, {1, 0}, {2, 0}, {2, 1}, {2, 2},
+                                     {1, 2}, {0, 2}, {0, 1}},
+                                    true};
+  const auto corners = Toolpath::simplifyContour(outline, 1e-3, true);
+  assert(corners.closed && corners.points.size() == 4 && corners.arcs.empty());
+  assert(Toolpath::simplifyContour(outline, 0.0, true).points.size() == 8);
+
+  // A finely tessellated, slightly noisy circle shrinks to a few segments,
+  // or to a few arcs, and stays within the tolerance either way.
+  Stratum::Slicer::Contour circle;
+  circle.closed = true;
+  for (int i = 0; i < 720; ++i) {
+    const double a = 2 * std::numbers::pi * i / 720;
+    const double r = 10.0 + 0.002 * ((i * 7919) % 5 - 2) / 2.0;
+    circle.points.push_back({r * std::cos(a), r * std::sin(a)});
+  }
+  const double tol = 0.0125;
+  const auto lines = Toolpath::simplifyContour(circle, tol, false);
+  const auto arcs = Toolpath::simplifyContour(circle, tol, true);
+  assert(lines.points.size() < 100 && lines.arcs.empty());
+  assert(arcs.points.size() <= 6 && arcs.arcs.size() == arcs.points.size());
+  int fitted = 0;
+  for (const auto& arc : arcs.arcs) {
+    assert(arc.turn >= 0);  // counter-clockwise, as sliced
+    fitted += arc.turn;
+  }
+  assert(fitted >= 2);
+  for (const auto& p : circle.points) {
+    assert(pathDistance(lines, p) <= tol + 1e-9);
+    assert(pathDistance(arcs, p) <= tol + 1e-9);
+  }
+
+  // Open polylines keep their ends.
+  Stratum::Slicer::Contour zigzag;
+  for (int i = 0; i <= 100; ++i)
+    zigzag.points.push_back({0.1 * i, (i % 2) * 0.001});
+  const auto straight = Toolpath::simplifyContour(zigzag, tol, true);
+  assert(!straight.closed && straight.points.size() == 2);
+  assert(straight.points.back().x == zigzag.points.back().x);
+  return 0;
+}